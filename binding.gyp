@@ -8,13 +8,31 @@
         "c++/classes/usbdev.cpp",
         "c++/classes/moc/moc_usbdev.cpp",
         "c++/classes_wrap/videostreamingWrap.cpp",
+        "c++/classes_wrap/frameringWrap.cpp",
         "c++/classes/videostreaming.cpp",
         "c++/classes/moc/moc_videostreaming.cpp",
         "c++/classes/cameraviewer.cpp",
         "c++/classes/moc/moc_cameraviewer.cpp",
+        "c++/classes/frametexture.cpp",
+        "c++/classes/overlaynode.cpp",
+        "c++/classes/framepacer.cpp",
         "c++/classes/otracker.cpp",
+        "c++/classes/trackerworker.cpp",
+        "c++/classes/binoculartracker.cpp",
+        "c++/classes/detectorengine.cpp",
+        "c++/classes/framering.cpp",
+        "c++/classes/gazering.cpp",
+        "c++/classes/shmregistry.cpp",
+        "c++/classes/eyeregion.cpp",
+        "c++/classes/streamsync.cpp",
+        "c++/classes/sessionindex.cpp",
+        "c++/classes/jobscheduler.cpp",
+        "c++/classes/processsupervisor.cpp",
+        "c++/classes/pluginpool.cpp",
         "c++/classes_signals/utilsprocess.cpp",
         "c++/classes_signals/qutils.cpp",
+        "c++/classes_signals/timerservice.cpp",
+        "c++/classes_signals/p2pbus.cpp",
         "c++/classes_signals/oscann_interface.cpp",
         "c++/classes_signals/oscann_adaptor.cpp",
         "c++/classes_signals/moc/moc_oscann_adaptor.cpp",
@@ -109,6 +127,88 @@
           ],
         }]
       ]
+    },
+    {
+      "target_name": "framering_test",
+      "type": "executable",
+      "sources": [
+        "c++/tests/framering_test.cpp",
+        "c++/classes/framering.cpp",
+        "c++/classes/shmregistry.cpp"
+      ],
+      "include_dirs": [
+        "c++/classes",
+        "c++/tests",
+        "/usr/local/include/opencv4",
+        "/usr/local/include",
+      ],
+      'cflags_cc!': [
+        '-fno-rtti',
+        '-fno-exceptions',
+      ],
+      'cflags_cc+': [
+        '-frtti',
+        '-fexceptions'
+      ],
+      'libraries': [
+        '-L/usr/local/lib',
+        '-lopencv_core',
+        '-lrt',
+        '-lpthread',
+      ],
+    },
+    {
+      "target_name": "eyeregion_test",
+      "type": "executable",
+      "sources": [
+        "c++/tests/eyeregion_test.cpp",
+        "c++/classes/eyeregion.cpp",
+        "c++/classes/framering.cpp",
+        "c++/classes/shmregistry.cpp"
+      ],
+      "include_dirs": [
+        "c++/classes",
+        "c++/tests",
+        "/usr/local/include/opencv4",
+        "/usr/local/include",
+      ],
+      'cflags_cc!': [
+        '-fno-rtti',
+        '-fno-exceptions',
+      ],
+      'cflags_cc+': [
+        '-frtti',
+        '-fexceptions'
+      ],
+      'libraries': [
+        '-L/usr/local/lib',
+        '-lopencv_core',
+        '-lrt',
+        '-lpthread',
+      ],
+    },
+    {
+      "target_name": "streamsync_test",
+      "type": "executable",
+      "sources": [
+        "c++/tests/streamsync_test.cpp",
+        "c++/classes/streamsync.cpp"
+      ],
+      "include_dirs": [
+        "c++/classes",
+        "c++/tests",
+      ],
+      'cflags_cc!': [
+        '-fno-rtti',
+        '-fno-exceptions',
+      ],
+      'cflags_cc+': [
+        '-frtti',
+        '-fexceptions'
+      ],
+      'libraries': [
+        '-lpthread',
+      ],
     }
   ]
 }
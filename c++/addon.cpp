@@ -1,10 +1,12 @@
 #include <node.h>
 #include "usbdevWrap.h"
+#include "frameringWrap.h"
 
 using namespace v8;
 
 void InitAll(Local<Object> exports) {
   usbdevWrap::Init(exports);
+  frameringWrap::Init(exports);
 }
 
 NODE_MODULE(NODE_GYP_MODULE_NAME, InitAll);
@@ -0,0 +1,136 @@
+#include "binoculartracker.h"
+
+//Low resolution pass: frame scale and share of the half width taken by an eye region
+#define LOCATE_SCALE        4
+#define LOCATE_BLUR         5
+#define EYE_ROI_WIDTH       0.8
+//The pupil is the darkest blob only when it clearly is: otherwise the whole half is searched
+#define PUPIL_CONTRAST      0.6
+//Frames without any eye before the regions are located again
+#define RELOCATE_FRAMES     30
+
+binocularTracker::binocularTracker() : m_userRois(false), m_lostFrames(0){
+    m_trackers[BINOCULAR_LEFT].setID(BINOCULAR_LEFT);
+    m_trackers[BINOCULAR_RIGHT].setID(BINOCULAR_RIGHT);
+}
+void binocularTracker::setEyeRois(const cv::Rect& left, const cv::Rect& right){
+    if(left.area() == 0 || right.area() == 0){
+        clearEyeRois();
+        return;
+    }
+    m_rois[BINOCULAR_LEFT] = left;
+    m_rois[BINOCULAR_RIGHT] = right;
+    m_userRois = true;
+    m_lostFrames = 0;
+}
+void binocularTracker::clearEyeRois(){
+    m_rois[BINOCULAR_LEFT] = cv::Rect();
+    m_rois[BINOCULAR_RIGHT] = cv::Rect();
+    m_userRois = false;
+    m_lostFrames = 0;
+}
+bool binocularTracker::locateEyes(const cv::Mat& frame){
+    if(frame.cols < 2*LOCATE_SCALE || frame.rows < LOCATE_SCALE){
+        m_errorMsg = "ERROR 01: binocularTracker - frame too small";
+        return false;
+    }
+    cv::Mat grey;
+    if(frame.channels() == 3)
+        cv::cvtColor(frame, grey, cv::COLOR_RGB2GRAY);
+    else
+        grey = frame;
+    cv::resize(grey, m_small, cv::Size(frame.cols/LOCATE_SCALE, frame.rows/LOCATE_SCALE), 0, 0, cv::INTER_AREA);
+    cv::GaussianBlur(m_small, m_small, cv::Size(LOCATE_BLUR, LOCATE_BLUR), 0);
+    const int half = frame.cols/2;
+    const int width = std::min(half, cvRound(half*EYE_ROI_WIDTH));
+    const int height = std::min(frame.rows, width*3/4);
+    for(int eye=0;eye<BINOCULAR_EYES;eye++){
+        const cv::Rect side(eye == BINOCULAR_LEFT ? 0 : half, 0, eye == BINOCULAR_LEFT ? half : frame.cols - half, frame.rows);
+        const cv::Rect smallSide(side.x/LOCATE_SCALE, 0, side.width/LOCATE_SCALE, m_small.rows);
+        double darkest;
+        cv::Point at;
+        cv::minMaxLoc(m_small(smallSide), &darkest, NULL, &at);
+        if(darkest > PUPIL_CONTRAST*cv::mean(m_small(smallSide))[0]){
+            m_rois[eye] = side;
+            continue;
+        }
+        //Centred on the dark blob, inside its own half
+        cv::Rect roi((smallSide.x + at.x)*LOCATE_SCALE - width/2, at.y*LOCATE_SCALE - height/2, width, height);
+        roi.x = constrain(roi.x, side.x, side.x + side.width - width);
+        roi.y = constrain(roi.y, 0, frame.rows - height);
+        m_rois[eye] = roi & side;
+    }
+    return true;
+}
+void binocularTracker::collect(int eye, int status, eyeMeasure& measure){
+    OTracker& tracker = m_trackers[eye];
+    const cv::Point2d origin(m_rois[eye].x, m_rois[eye].y);
+    measure.status = status;
+    measure.path = status == 0 ? tracker.lastPath() : PATH_NONE;
+    measure.roi = m_rois[eye];
+    if(status != 0){
+        measure.ellipse = cv::RotatedRect();
+        measure.pupil = cv::Point2d(UNKNOWN_POSITION);
+        measure.glints = std::pair<cv::Point2d,cv::Point2d>(cv::Point2d(UNKNOWN_POSITION), cv::Point2d(UNKNOWN_POSITION));
+        return;
+    }
+    measure.ellipse = tracker.ellipse();
+    measure.ellipse.center += cv::Point2f(origin);
+    measure.pupil = tracker.pupilPoint() + origin;
+    measure.glints = tracker.glints();
+    measure.glints.first += origin;
+    measure.glints.second += origin;
+}
+int binocularTracker::measure(const cv::Mat& frame, uint64_t frameId, int64_t timestamp, binocularResult& result){
+    result.frameId = frameId;
+    result.timestamp = timestamp;
+    for(int eye=0;eye<BINOCULAR_EYES;eye++)
+        collect(eye, -1, result.eyes[eye]);
+    const cv::Rect whole(0, 0, frame.cols, frame.rows);
+    if(!m_userRois && (m_rois[BINOCULAR_LEFT].area() == 0 || m_lostFrames >= RELOCATE_FRAMES)){
+        if(!locateEyes(frame))
+            return 0;
+        m_lostFrames = 0;
+    }
+    int status[BINOCULAR_EYES] = {-1, -1};
+    cv::Rect rois[BINOCULAR_EYES];
+    for(int eye=0;eye<BINOCULAR_EYES;eye++)
+        rois[eye] = m_rois[eye] & whole;
+    if(rois[BINOCULAR_LEFT].area() == 0 || rois[BINOCULAR_RIGHT].area() == 0){
+        m_errorMsg = "ERROR 02: binocularTracker - eye region outside the frame";
+        return 0;
+    }
+    for(int eye=0;eye<BINOCULAR_EYES;eye++){
+        m_rois[eye] = rois[eye];
+        //Relocated or set by the user: the tracker's regions and ellipse are in the old crop
+        if(m_measured[eye] != rois[eye]){
+            m_trackers[eye].resetTracking();
+            m_measured[eye] = rois[eye];
+        }
+    }
+    //Views of the frame: measure() copies what it modifies. Pixel constants of the whole frame
+    m_trackers[BINOCULAR_LEFT].setSensorHeight(frame.rows);
+    m_trackers[BINOCULAR_RIGHT].setSensorHeight(frame.rows);
+    const cv::Mat left = frame(rois[BINOCULAR_LEFT]);
+    const cv::Mat right = frame(rois[BINOCULAR_RIGHT]);
+    tbb::parallel_invoke([&]{status[BINOCULAR_LEFT] = m_trackers[BINOCULAR_LEFT].measure(left);},
+                         [&]{status[BINOCULAR_RIGHT] = m_trackers[BINOCULAR_RIGHT].measure(right);});
+    int tracked = 0;
+    for(int eye=0;eye<BINOCULAR_EYES;eye++){
+        collect(eye, status[eye], result.eyes[eye]);
+        if(status[eye] == 0)
+            tracked++;
+    }
+    m_lostFrames = tracked == 0 ? m_lostFrames + 1 : 0;
+    return tracked;
+}
+std::vector<std::pair<int, int>> binocularTracker::getBlinks(int eye){
+    return m_trackers[eye].getBlinks();
+}
+void binocularTracker::clearBlinks(){
+    m_trackers[BINOCULAR_LEFT].clearBlinks();
+    m_trackers[BINOCULAR_RIGHT].clearBlinks();
+}
+std::string binocularTracker::getLastError(){
+    return m_errorMsg;
+}
@@ -0,0 +1,66 @@
+#ifndef BINOCULARTRACKER_H
+#define BINOCULARTRACKER_H
+
+#include <utility>
+#include <vector>
+
+//openCV
+#include <opencv2/core/core.hpp>
+
+#include "otracker.h"
+
+#define BINOCULAR_LEFT      0
+#define BINOCULAR_RIGHT     1
+#define BINOCULAR_EYES      2
+
+/* Both eyes from one camera frame.
+ * Each eye has an OTracker of its own, fed with a view (no copy) of its sub-region of the frame;
+ * the two measure() run at the same time (tbb::parallel_invoke), so a binocular frame costs about
+ * the same as a single-eye one. The regions are given by the user or located with a low
+ * resolution pass over the frame (darkest blob of each half), and located again when both eyes
+ * are lost for a while. Left and right are image sides.
+ * Results are in frame coordinates and share the frame id; blinks are kept per eye. */
+struct eyeMeasure{
+    int status;                     //OTracker::measure return value
+    detectionPath path;
+    cv::Rect roi;                   //Sub-region given to the tracker
+    cv::RotatedRect ellipse;
+    cv::Point2d pupil;
+    std::pair<cv::Point2d,cv::Point2d> glints;
+};
+struct binocularResult{
+    uint64_t frameId;
+    int64_t timestamp;
+    eyeMeasure eyes[BINOCULAR_EYES];
+    bool both() const {return eyes[BINOCULAR_LEFT].status == 0 && eyes[BINOCULAR_RIGHT].status == 0;}
+};
+
+class binocularTracker{
+public:
+    binocularTracker();
+    //Regions in frame coordinates. An empty one turns the automatic location back on
+    void setEyeRois(const cv::Rect& left, const cv::Rect& right);
+    void clearEyeRois();
+    cv::Rect eyeRoi(int eye) const {return m_rois[eye];}
+    //Eyes tracked (0, 1 or 2); the per-eye status is in the result
+    int measure(const cv::Mat& frame, uint64_t frameId, int64_t timestamp, binocularResult& result);
+    std::vector<std::pair<int, int>> getBlinks(int eye);
+    void clearBlinks();
+    OTracker& tracker(int eye) {return m_trackers[eye];}
+    std::string getLastError();
+private:
+    binocularTracker(const binocularTracker&);
+    binocularTracker& operator=(const binocularTracker&);
+    bool locateEyes(const cv::Mat& frame);
+    void collect(int eye, int status, eyeMeasure& measure);
+
+    OTracker m_trackers[BINOCULAR_EYES];
+    cv::Rect m_rois[BINOCULAR_EYES];
+    cv::Rect m_measured[BINOCULAR_EYES];    //Region each tracker's state is relative to
+    bool m_userRois;
+    int m_lostFrames;                   //Consecutive frames without any eye
+    cv::Mat m_small;
+    std::string m_errorMsg;
+};
+
+#endif // BINOCULARTRACKER_H
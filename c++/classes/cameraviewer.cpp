@@ -6,19 +6,28 @@ Pixmap  -> mean: 816.780, std:  254.450
 %CPU(Pixmap)
 30,0 bgVideoCapturer
  3,7 oscann
+Now the texture is created once per size and format and only updated (glTexSubImage2D) when
+the capturer sequence changes; see renderStats() for the current numbers.
 */
 
 
-cameraViewer::cameraViewer() : m_texture(NULL){
+cameraViewer::cameraViewer() : m_front(0), m_legacySeq(0), m_frameSeq(0), m_uploadedSeq(0), m_frameTimestamp(0), m_overlay(NULL), m_ellipseNode(NULL), m_pupilNode(NULL),
+    m_leftGlintNode(NULL), m_rightGlintNode(NULL), m_stimulusNode(NULL), m_ringGeneration(0), m_frameNotifier(NULL), m_texture(NULL){
     setFlag(QQuickItem::ItemHasContents);
     m_logo = QImage(":qml/qtcam/videocapturefilter_QML/images/oscannblue.png");
     m_fromMemory = false;
     m_showPupilDetection = false;
-    m_displayFreq = 0;
+    m_frameWidth = DEFAULT_FRAME_WIDTH;
+    m_frameHeight = DEFAULT_FRAME_HEIGHT;
+    m_presentTimer.setSingleShot(true);
+    connect(&m_presentTimer, &QTimer::timeout, [this](){
+        m_pacer.due();
+        update();
+    });
     setDisplayImagesFlag(false);
     setDisplayImages(true);
     m_updating = false;
-    oTracker = new OTracker();
+    memset(&m_stats, 0, sizeof(m_stats));
 }
 
 void cameraViewer::setupDbus() {
@@ -27,38 +36,62 @@ void cameraViewer::setupDbus() {
     QDBusConnection connection = QDBusConnection::sessionBus();
     connection.registerObject("/main", this);
     connection.registerService("org.oscann.cv");
+    connectPlugins(connection, false);
+    //Peer connections of the plugins, when the GUI listens for them (p2pbus.h)
+    p2pBus::instance().addPeerHandler(this, [this](QDBusConnection peer){
+        peer.registerObject("/main", this);
+        return connectPlugins(peer, true);
+    });
 
+    m_drawStimuli = false;
 
-    capturerIface = new aura::CapturerInterface("org.oscann.video",               //Service Name
+    setFrameGeometry(m_frameWidth, m_frameHeight);
+    m_stimulusPoint = cv::Point(QGuiApplication::primaryScreen()->geometry().width()/2*m_widthFactor, QGuiApplication::primaryScreen()->geometry().height()/2*m_heightFactor);
+}
+//Peer connection: no service names, the members keep the session bus proxies
+QList<QObject*> cameraViewer::connectPlugins(const QDBusConnection& connection, const bool peer){
+    aura::CapturerInterface* capturer = new aura::CapturerInterface(peer ? QString() : "org.oscann.video",               //Service Name
                                          "/capturer",                   //Path
                                          connection, //Connection
                                          this);
-    connect(capturerIface, SIGNAL(newControlAddedDBus(QString, int, int, int, int)), this, SLOT(newControlAddedSlot(QString, int, int, int, int)));
-    connect(capturerIface, SIGNAL(statusChangedDBus(int, int, int, int)), this, SLOT(capturerReady(int, int, int, int)));
-    connect(capturerIface, SIGNAL(updateImageDBus(int, int, int, int)), this, SLOT(updateImageSlot(int, int, int, int)));
+    connect(capturer, SIGNAL(newControlAddedDBus(QString, int, int, int, int)), this, SLOT(newControlAddedSlot(QString, int, int, int, int)));
+    connect(capturer, SIGNAL(statusChangedDBus(int, int, int, int)), this, SLOT(capturerReady(int, int, int, int)));
+    connect(capturer, SIGNAL(updateImageDBus(int, int, int, int)), this, SLOT(updateImageSlot(int, int, int, int)));
 
-
-    displayCTIface = new aura::DisplayCTInterface("org.oscann.dct",
+    aura::DisplayCTInterface* displayCT = new aura::DisplayCTInterface(peer ? QString() : "org.oscann.dct",
                                        "/main",
-                                       QDBusConnection::sessionBus(),
+                                       connection,
                                       this);
-    connect(displayCTIface, SIGNAL(stimulus2SaveDbus(int, int)), this, SLOT(stimulus2SaveSlot(int, int)));
-    connect(displayCTIface, SIGNAL(stimuliOnViewerDBus(bool)), this, SLOT(stimuliOnViewerSlot(bool)));
-
-    m_drawStimuli = false;
-
-    m_widthFactor = (double) 640/QGuiApplication::primaryScreen()->geometry().width();
-    m_heightFactor = (double) 480/QGuiApplication::primaryScreen()->geometry().height();
-    qDebug()<<Q_FUNC_INFO<<" m_widthFactor: "<<m_widthFactor;
-    qDebug()<<Q_FUNC_INFO<<" m_heightFactor: "<<m_heightFactor;
-    m_stimulusPoint = cv::Point(QGuiApplication::primaryScreen()->geometry().width()/2*m_widthFactor, QGuiApplication::primaryScreen()->geometry().height()/2*m_heightFactor);
+    connect(displayCT, SIGNAL(stimulus2SaveDbus(int, int)), this, SLOT(stimulus2SaveSlot(int, int)));
+    connect(displayCT, SIGNAL(stimuliOnViewerDBus(bool)), this, SLOT(stimuliOnViewerSlot(bool)));
+    if(!peer){
+        capturerIface = capturer;
+        displayCTIface = displayCT;
+    }
+    return QList<QObject*>() << capturer << displayCT;
+}
+//Size of the frames in shared memory: staging buffers, tracker and stimulus scale follow it
+void cameraViewer::setFrameGeometry(const int width, const int height){
+    if(width <= 0 || height <= 0)
+        return;
+    if(width != m_frameWidth || height != m_frameHeight){
+        m_stimulusPoint = cv::Point(m_stimulusPoint.x*width/m_frameWidth, m_stimulusPoint.y*height/m_frameHeight);
+        m_frameWidth = width;
+        m_frameHeight = height;
+    }
+    m_widthFactor = (double) m_frameWidth/QGuiApplication::primaryScreen()->geometry().width();
+    m_heightFactor = (double) m_frameHeight/QGuiApplication::primaryScreen()->geometry().height();
+    qDebug()<<Q_FUNC_INFO<<" "<<m_frameWidth<<"x"<<m_frameHeight<<" m_widthFactor: "<<m_widthFactor<<" m_heightFactor: "<<m_heightFactor;
 }
 
 void cameraViewer::stimuliOnViewerSlot(const bool flag){
     m_drawStimuli = flag;
+    update();
 }
 void cameraViewer::stimulus2SaveSlot(const int x, const int y){
     m_stimulusPoint = cv::Point(x*m_widthFactor, y*m_heightFactor);
+    if(m_drawStimuli)
+        update();
 }
 
 void cameraViewer::capturerReady(const int cameraType, const int width, const int height, int fps){
@@ -70,34 +103,17 @@ void cameraViewer::capturerReady(const int cameraType, const int width, const in
     if(cameraType == -1)
         return;
     m_cameraType = cameraType;
-    m_img = m_cameraType == CT.USB_20 ? QImage(QSize(640, cameraHeight()), QImage::Format_RGB888) : m_img = QImage(QSize(640, cameraHeight()), QImage::Format_Grayscale8);
-    switch (fps) {
-    case 30:
-        m_displayConst = 1; //25FPS
-        break;
-    case 60:
-        m_displayConst = 2; //25FPS
-        break;
-    case 100:
-        m_displayConst = 4; //25FPS
-        break;
-    case 120:
-        m_displayConst = 5; //24FPS
-        break;
-    case 240:
-        m_displayConst = 10;//24FPS
-        break;
-    case 480:
-        m_displayConst = 20;//24FPS
-        break;
-    case 520:
-        m_displayConst = 21;//24FPS
-        break;
-    }
-    //TODOFPS: m_img = m_img = QImage(QSize(640, cameraHeight()), QImage::Format_Grayscale8);
+    //The staging buffers are (re)allocated by stagingBuffer() with the new size and format
+    //The preview runs at min(fps, PREVIEW_MAX_FPS), whatever the capture rate
+    m_pacer.setRate(fps);
     mapSharedMemory();
+    if(m_showPupilDetection)
+        startTracker();
     setDisplayImages(true);
 }
+void cameraViewer::startTracker(){
+    m_tracker.start(m_frameWidth, m_frameHeight, m_cameraType == CT.USB_20 ? 3 : 1);
+}
 
 void cameraViewer::changeSettings(QString ctrlName, int value){
     if(ctrlName.compare("Brightness") == 0){
@@ -119,22 +135,72 @@ void cameraViewer::geometryChanged(const QRectF &newGeometry, const QRectF &oldG
 
 //void cameraViewer::mapSharedMemory(const QString cameraName, const int width, const int height){
 void cameraViewer::mapSharedMemory(){
-    try {
-        m_region = new mapped_region(new shared_memory_object(open_only, "m_shared", read_only), read_only);
-    }
-    catch (interprocess_exception& e) {
-        qDebug()<<Q_FUNC_INFO<<"e.what: "<< e.what();
+    //Called on every resolution change: the old mappings are released here, not leaked
+    streamDescriptor desc;
+    if(shmRegistry::instance().find(CAMERA_STREAM, desc) && desc.kind == SHM_FRAME_RING){
+        if(m_ring.isOpen() && desc.generation == m_ringGeneration)
+            return;
+        if(m_ring.open(desc.segment)){
+            m_ringGeneration = desc.generation;
+            m_legacy.unmap();
+            startNotifier(desc.segment);
+            setFrameGeometry(desc.width, desc.height);
+            qDebug()<<Q_FUNC_INFO<<" frame ring "<<desc.segment<<": "<<m_ring.maxWidth()<<"x"<<m_ring.maxHeight()<<" generation "<<desc.generation;
+            return;
+        }
+    }else if(m_ring.open(FRAME_RING_NAME)){
+        m_ringGeneration = 0;
+        m_legacy.unmap();
+        startNotifier(FRAME_RING_NAME);
+        setFrameGeometry(m_ring.maxWidth(), m_ring.maxHeight());
+        qDebug()<<Q_FUNC_INFO<<" frame ring: "<<m_ring.maxWidth()<<"x"<<m_ring.maxHeight();
+        return;
     }
+    qDebug()<<Q_FUNC_INFO<<" "<<QString::fromStdString(m_ring.getLastError())<<". Using m_shared";
+    m_ring.close();
+    m_notifier.stop();
+    setFrameGeometry(cameraWidth(), cameraHeight());
+    if(!m_legacy.map("m_shared", cameraWidth(), cameraHeight(), m_cameraType == CT.USB_20 ? FRAME_RGB888 : FRAME_GRAY8))
+        qDebug()<<Q_FUNC_INFO<<"e.what: "<<QString::fromStdString(m_legacy.getLastError());
 }
 
+void cameraViewer::startNotifier(const char* segment){
+    if(!m_notifier.start(segment)){
+        qDebug()<<Q_FUNC_INFO<<" "<<QString::fromStdString(m_notifier.getLastError())<<". Frames by DBus";
+        return;
+    }
+    if(m_frameNotifier == NULL){
+        //The eventfd is the same for every ring: one notifier for the life of the viewer
+        m_frameNotifier = new QSocketNotifier(m_notifier.fd(), QSocketNotifier::Read, this);
+        connect(m_frameNotifier, &QSocketNotifier::activated, [this](int){
+            if(m_notifier.acknowledge() > 0)
+                frameArrived();
+        });
+    }
+}
+void cameraViewer::frameArrived(){
+    m_displayImagesFlag = true;
+    m_fromMemory = true;
+    m_legacySeq++;
+    //Without ring the tracker has no frame id of its own to wait on
+    if(m_showPupilDetection && !m_ring.isOpen())
+        m_tracker.frameReady();
+    //Hidden: nothing is copied or uploaded. Otherwise a repaint per preview interval,
+    //which takes the newest frame when it runs
+    int64_t wait = m_pacer.frameArrived(isVisible() && window() != NULL);
+    if(wait == 0)
+        update();
+    else if(wait > 0)
+        m_presentTimer.start((wait + 999)/1000);
+}
 void cameraViewer::updateImageSlot(int x, int y, int width, int height){
     try {
         if(width > 0){
-            m_displayImagesFlag = true;
             m_imgPos.setX(x);
             m_imgPos.setY(y);
-            m_fromMemory = true;
-            update();
+            //The ring already woke us up for this frame
+            if(!m_notifier.isRunning())
+                frameArrived();
         }
         else{
             QTimer::singleShot(32, this, SLOT(loadLogo()));
@@ -144,59 +210,171 @@ void cameraViewer::updateImageSlot(int x, int y, int width, int height){
         qDebug()<<Q_FUNC_INFO<<"Oscann Desk 100 ERROR000: : "<<e.what();
     }
 }
+QImage& cameraViewer::stagingBuffer(){
+    QImage& back = m_staging[m_front ^ 1];
+    const QImage::Format format = m_cameraType == CT.USB_20 ? QImage::Format_RGB888 : QImage::Format_Grayscale8;
+    if(back.width() != m_frameWidth || back.height() != m_frameHeight || back.format() != format)
+        back = QImage(QSize(m_frameWidth, m_frameHeight), format);
+    return back;
+}
 QSGNode *cameraViewer::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *){
     QMutexLocker lock(&m_mutex);
     Q_UNUSED(lock);
-    if(m_region && m_fromMemory){
-        m_displayFreq++;
-        if(m_displayFreq == m_displayConst){ //240FPS
-            if(m_showPupilDetection){
-                m_roiImg = cv::Mat(cv::Size(640, cameraHeight()), m_cameraType == CT.USB_20 ? CV_8UC3 : CV_8UC1, m_region->get_address(), cv::Mat::AUTO_STEP);
-                m_tmpImg = m_roiImg.clone();
-                if(oTracker->measure(m_tmpImg) == 0){
-                    cv::ellipse(m_tmpImg,oTracker->ellipse(),cv::Scalar(0,255,0));
-                    cv::circle(m_tmpImg,oTracker->pupilPoint(),2,cv::Scalar(0,0,255),2);
-                    cv::circle(m_tmpImg,oTracker->glints().first,2,cv::Scalar(255,0,0),2);
-                    cv::circle(m_tmpImg,oTracker->glints().second,2,cv::Scalar(255,0,0),2);
-                }
-
-
-                m_img = QImage((const uchar *) m_tmpImg.data, m_tmpImg.cols, m_tmpImg.rows, m_tmpImg.step, m_cameraType == CT.USB_20 ? QImage::Format_RGB888 : QImage::Format_Grayscale8);
-                m_img.bits();    // enforce deep copy, see documentation
-                m_roiImg.release();
-                m_tmpImg.release();
-            }else{
-                if(!m_drawStimuli){
-                    m_cameraType == CT.USB_20 ? memmove(m_img.bits(), m_region->get_address(), cameraWidth()*cameraHeight()*3) : memmove(m_img.bits(), m_region->get_address(), cameraWidth()*cameraHeight());
-                }else{
-                    m_roiImg = cv::Mat(cv::Size(640, cameraHeight()), m_cameraType == CT.USB_20 ? CV_8UC3 : CV_8UC1, m_region->get_address(), cv::Mat::AUTO_STEP);
-                    m_tmpImg = m_roiImg.clone();
-                    cv::circle(m_tmpImg,m_stimulusPoint,8, m_cameraType == CT.USB_20 ? cv::Scalar(0,255,0) : cv::Scalar(255),-1,8);
-                    m_img = QImage((const uchar *) m_tmpImg.data, m_tmpImg.cols, m_tmpImg.rows, m_tmpImg.step, m_cameraType == CT.USB_20 ? QImage::Format_RGB888 : QImage::Format_Grayscale8);
-                }
-            }
-            m_displayFreq = 0;
-        }else{
-            m_node = static_cast<QSGSimpleTextureNode *>(oldNode);
+    QElapsedTimer elapsed;
+    elapsed.start();
+    m_node = static_cast<QSGSimpleTextureNode *>(oldNode);
+    if((m_ring.isOpen() || m_legacy.isMapped()) && m_fromMemory){
+        //Nothing new: keep the current texture
+        newFrame() ? m_pacer.presented(m_frameTimestamp) : m_pacer.missed();
+        if(m_node && m_uploadedSeq == m_frameSeq){
+            //Same frame as the one on screen: no upload, only the overlays may move
+            updateOverlays();
+            updateStats(elapsed.nsecsElapsed(), false);
             return m_node;
         }
     }
-    m_node = static_cast<QSGSimpleTextureNode *>(oldNode);
     if (!m_node) {
         m_node = new QSGSimpleTextureNode();
+        createOverlays();
     }
-    if(m_texture)
+    bool uploaded = false;
+    if(m_fromMemory && !m_staging[m_front].isNull()){
+        if(m_uploadedSeq != m_frameSeq || m_texture == NULL){
+            uploadTexture();
+            uploaded = true;
+        }
+    }else if(m_uploadedSeq != 0 || m_texture == NULL){
         delete m_texture;
-    if(m_fromMemory){
-        m_texture = window()->createTextureFromImage(m_img, QQuickWindow::TextureCanUseAtlas);
-    }
-    else{
         m_texture = window()->createTextureFromImage(m_logo);
+        m_uploadedSeq = 0;
+        m_stats.allocations++;
     }
     m_node->setTexture(m_texture);
+    if(uploaded)
+        m_node->markDirty(QSGNode::DirtyMaterial);
     m_node->setRect(boundingRect());
+    updateOverlays();
+    updateStats(elapsed.nsecsElapsed(), uploaded);
     return m_node;
 }
+bool cameraViewer::newFrame(){
+    //The frame goes straight from shared memory to the back staging buffer: the only copy
+    QImage& back = stagingBuffer();
+    const int type = m_cameraType == CT.USB_20 ? CV_8UC3 : CV_8UC1;
+    cv::Mat staging(back.height(), back.width(), type, back.bits(), back.bytesPerLine());
+    uint64_t seq;
+    if(m_ring.isOpen()){
+        //Consistent copy of the newest frame
+        frameInfo info;
+        if(!m_ring.latest(staging, info))
+            return false;
+        m_frameTimestamp = info.timestamp;
+        if(staging.data != back.constBits()){
+            //Not the size of the staging buffer: latest() had to allocate. The ring keeps the
+            //largest size, the producer may send smaller (cropped) frames
+            setFrameGeometry(staging.cols, staging.rows);
+            back = QImage(staging.cols, staging.rows, back.format());
+            staging.copyTo(cv::Mat(back.height(), back.width(), type, back.bits(), back.bytesPerLine()));
+        }
+        seq = info.frameId;
+    }else{
+        seq = m_legacySeq;
+        if(seq == m_frameSeq)
+            return false;
+        m_frameTimestamp = 0;
+        if(m_legacy.size() < (std::size_t)staging.total()*staging.elemSize())
+            return false;
+        cv::Mat(cv::Size(m_frameWidth, m_frameHeight), type, m_legacy.address(), cv::Mat::AUTO_STEP).copyTo(staging);
+    }
+    m_front ^= 1;
+    m_frameSeq = seq;
+    return true;
+}
+void cameraViewer::createOverlays(){
+    //Children of the texture node: drawn after (on top of) the camera frame, owned by it
+    m_overlay = new QSGTransformNode();
+    m_ellipseNode = new overlayNode(Qt::green, false);
+    m_pupilNode = new overlayNode(Qt::red, true);
+    m_leftGlintNode = new overlayNode(Qt::blue, true);
+    m_rightGlintNode = new overlayNode(Qt::blue, true);
+    m_stimulusNode = new overlayNode(Qt::green, true);
+    m_overlay->appendChildNode(m_ellipseNode);
+    m_overlay->appendChildNode(m_pupilNode);
+    m_overlay->appendChildNode(m_leftGlintNode);
+    m_overlay->appendChildNode(m_rightGlintNode);
+    m_overlay->appendChildNode(m_stimulusNode);
+    m_node->appendChildNode(m_overlay);
+}
+void cameraViewer::updateOverlays(){
+    const QImage& front = m_staging[m_front];
+    const bool live = m_fromMemory && !front.isNull();
+    if(live){
+        //Overlays are in image pixels
+        QMatrix4x4 matrix;
+        matrix.translate(boundingRect().x(), boundingRect().y());
+        matrix.scale(boundingRect().width()/front.width(), boundingRect().height()/front.height());
+        if(m_overlay->matrix() != matrix)
+            m_overlay->setMatrix(matrix);
+    }
+    trackerResult result;
+    if(live && m_showPupilDetection && m_tracker.latest(result) && result.status == 0){
+        //Last result of the worker, usually from a slightly older frame
+        m_ellipseNode->setEllipse(QPointF(result.ellipseX, result.ellipseY), QSizeF(result.ellipseWidth, result.ellipseHeight), result.ellipseAngle);
+        m_pupilNode->setCircle(QPointF(result.pupilX, result.pupilY), 3);
+        m_leftGlintNode->setCircle(QPointF(result.leftGlintX, result.leftGlintY), 3);
+        m_rightGlintNode->setCircle(QPointF(result.rightGlintX, result.rightGlintY), 3);
+    }else{
+        m_ellipseNode->clear();
+        m_pupilNode->clear();
+        m_leftGlintNode->clear();
+        m_rightGlintNode->clear();
+    }
+    if(live && !m_showPupilDetection && m_drawStimuli){
+        m_stimulusNode->setColor(m_cameraType == CT.USB_20 ? Qt::green : Qt::white);
+        m_stimulusNode->setCircle(QPointF(m_stimulusPoint.x, m_stimulusPoint.y), 8);
+    }else{
+        m_stimulusNode->clear();
+    }
+}
+void cameraViewer::uploadTexture(){
+    const QImage& front = m_staging[m_front];
+    frameTexture* texture = dynamic_cast<frameTexture*>(m_texture);
+    if(frameTexture::supported()){
+        if(texture == NULL){
+            delete m_texture;
+            m_texture = texture = new frameTexture();
+        }
+        unsigned long long allocations = texture->allocations();
+        texture->setImage(front);
+        texture->updateTexture();
+        m_stats.allocations += texture->allocations() - allocations;
+    }else{
+        //Software backend (QT_QUICK_BACKEND=software) or core profile: a texture per new frame,
+        //still none when the sequence did not change
+        delete m_texture;
+        m_texture = window()->createTextureFromImage(front);
+        m_stats.allocations++;
+    }
+    m_uploadedSeq = m_frameSeq;
+}
+void cameraViewer::updateStats(qint64 elapsedNs, bool uploaded){
+    //The same mean/std the figures at the top of this file were taken with
+    m_stats.frames++;
+    uploaded ? m_stats.uploads++ : m_stats.skipped++;
+    m_renderUs.add(elapsedNs/1000.0);
+    m_stats.meanUs = m_renderUs.mean;
+    m_stats.stdUs = m_renderUs.std();
+    if(m_stats.frames % 1000 == 0){
+        pacerStats pacer = m_pacer.stats();
+        qDebug()<<Q_FUNC_INFO<<" mean: "<<m_stats.meanUs<<"us, std: "<<m_stats.stdUs<<"us, uploads: "<<m_stats.uploads<<", skipped: "<<m_stats.skipped<<", allocations: "<<m_stats.allocations;
+        qDebug()<<Q_FUNC_INFO<<" frames displayed: "<<pacer.displayed<<", skipped: "<<pacer.skipped<<", late: "<<pacer.late;
+    }
+}
+viewerStats cameraViewer::renderStats(){
+    QMutexLocker lock(&m_mutex);
+    Q_UNUSED(lock);
+    return m_stats;
+}
 void cameraViewer::loadLogo(){
     m_fromMemory = false;
     m_imgPos = QPoint(0,0);
@@ -4,7 +4,12 @@
 
 #include <QQuickItem>
 #include <QSGSimpleTextureNode>
+#include <QSGTransformNode>
+#include <QMatrix4x4>
 #include <QQuickWindow>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QSocketNotifier>
 
 
 //#include <QQuickPaintedItem>
@@ -33,9 +38,31 @@
 
 #include "qutils.h"
 #include "otracker.h"
+#include "framering.h"
+#include "frametexture.h"
+#include "trackerworker.h"
+#include "overlaynode.h"
+#include "framepacer.h"
+#include "runningstats.h"
+#include "p2pbus.h"
 
 
 using namespace boost::interprocess;
+
+//Frame size until the capturer (or the stream registry) tells the real one
+#define DEFAULT_FRAME_WIDTH     640
+#define DEFAULT_FRAME_HEIGHT    480
+
+//Render thread cost of updatePaintNode, microseconds
+struct viewerStats{
+    unsigned long long frames;          //Calls to updatePaintNode
+    unsigned long long uploads;         //Frames copied to the texture
+    unsigned long long skipped;         //Calls without a new frame: nothing uploaded
+    unsigned long long allocations;     //Textures created (size, format or backend changes)
+    double meanUs;
+    double stdUs;
+};
+
 class cameraViewer  : public QQuickItem{
 //class cameraViewer : public QQuickPaintedItem{
     Q_OBJECT
@@ -84,6 +111,10 @@ class cameraViewer  : public QQuickItem{
     int gainValue(){return m_gainValue;}
 
     bool displayImagesFlag(){return m_displayImagesFlag;}
+    viewerStats renderStats();
+    pacerStats presentationStats(){return m_pacer.stats();}
+    //Frame ready notifications of the ring (zeros while the capturer has no ring)
+    frameNotifyStats notificationStats(){return m_notifier.stats();}
 
 
 //protected:
@@ -94,7 +125,9 @@ protected:
     void geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry);
 
 private:
-    OTracker *oTracker;
+    //Live overlay: the tracker runs in its own thread, the render thread only draws its last result
+    trackerWorker m_tracker;
+    void startTracker();
 
     bool m_drawStimuli;
 
@@ -108,25 +141,59 @@ private:
     bool m_updating;
     bool m_displayImagesFlag;
 
-    cv::Mat m_roiImg;
-    cv::Mat m_tmpImg;
-    unsigned int m_displayFreq;
-    unsigned int m_displayConst;
+    //Preview pacing (replaces the fps -> frames to skip table)
+    framePacer m_pacer;
+    QTimer m_presentTimer;
 
 
     bool m_fromMemory;
     bool m_geometryChanged;
-    QImage m_img;
+    //Double buffered staging image: the frame is written in the back buffer while the front one
+    //may still be waiting to be uploaded. Then they are swapped
+    QImage m_staging[2];
+    int m_frameWidth;
+    int m_frameHeight;
+    void setFrameGeometry(const int width, const int height);
+    int m_front;
+    uint64_t m_legacySeq;               //updateImageSlot calls, sequence of "m_shared"
+    uint64_t m_frameSeq;                //Sequence of the frame in the front buffer
+    uint64_t m_uploadedSeq;             //Sequence of the frame in the texture (0: logo or nothing)
+    int64_t m_frameTimestamp;           //Capture time of the front buffer, 0 if unknown
+    QImage& stagingBuffer();
+    bool newFrame();
+    void uploadTexture();
+    //Overlays (scene graph children of m_node), see overlaynode.h
+    QSGTransformNode *m_overlay;
+    overlayNode *m_ellipseNode;
+    overlayNode *m_pupilNode;
+    overlayNode *m_leftGlintNode;
+    overlayNode *m_rightGlintNode;
+    overlayNode *m_stimulusNode;
+    void createOverlays();
+    void updateOverlays();
     QImage m_logo;
     uchar *m_data;
     aura::CapturerInterface *capturerIface;
     aura::DisplayCTInterface *displayCTIface;
-
-    mapped_region *m_region;
+    QList<QObject*> connectPlugins(const QDBusConnection& connection, const bool peer);
+
+    //Frame ring of the capturer, found through shmRegistry. m_legacy ("m_shared") is kept for capturers without ring
+    frameRingReader m_ring;
+    uint64_t m_ringGeneration;
+    shmMapping m_legacy;
+    //New frames of the ring wake the GUI thread through m_frameNotifier; updateImageDBus is
+    //only used for the capturers without ring and for the end of the stream (width 0)
+    frameRingNotifier m_notifier;
+    QSocketNotifier *m_frameNotifier;
+    void startNotifier(const char* segment);
+    void frameArrived();
     QPoint m_imgPos;
     QMutex m_mutex;
     QSGSimpleTextureNode *m_node;
     QSGTexture *m_texture;
+    viewerStats m_stats;
+    runningStats m_renderUs;
+    void updateStats(qint64 elapsedNs, bool uploaded);
 
     boost::posix_time::ptime m_start;
     boost::posix_time::time_duration m_dur;
@@ -190,7 +257,7 @@ public slots:
     void newControlAddedSlot(QString,int,int,int, int);
     //void updateHeaderSlot(QString value){m_header = value;}
     void changeSettings(QString ctrlName, int value);
-    void setShowPupilDetection(bool value){m_showPupilDetection = value;}
+    void setShowPupilDetection(bool value){m_showPupilDetection = value; value ? startTracker() : m_tracker.stop();}
     void setDisplayImages(bool value){m_displayImagesFlag = value; emit displayImagesFlagChanged();emit displayImagesDbus(value);}
     void setProcessing(bool value){emit processingDbus(value);}
     void stimulus2SaveSlot(const int x, const int y);
@@ -0,0 +1,156 @@
+#include "detectorengine.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <chrono>
+
+//The thread checks if it has to stop at least this often
+#define ENGINE_WAIT_MS      100
+
+detectorEngine::detectorEngine() : m_running(false), m_eyes(1), m_eyeRegion(false), m_width(0), m_height(0),
+    m_frames(0), m_tracked(0), m_dropped(0), m_totalUs(0), m_latencyUs(0){}
+detectorEngine::~detectorEngine(){
+    stop();
+}
+bool detectorEngine::start(int eyes, const std::vector<int>& cores, bool eyeRegion){
+    stop();
+    m_errorMsg.clear();
+    //Same stream the external detector would publish: readers do not know who measures
+    if(!m_gaze.create(DETECTOR_GAZE_RING_NAME)){
+        m_errorMsg = m_gaze.getLastError();
+        return false;
+    }
+    if(!m_gaze.getLastError().empty())
+        m_errorMsg = m_gaze.getLastError();     //Ring created, but not in the registry
+    m_eyes = eyes == BINOCULAR_EYES ? BINOCULAR_EYES : 1;
+    m_cores = cores;
+    m_eyeRegion = eyeRegion && m_eyes == 1;
+    m_stream.close();
+    m_frames = m_tracked = m_dropped = m_totalUs = m_latencyUs = 0;
+    m_running = true;
+    m_thread = std::thread(&detectorEngine::run, this);
+    return true;
+}
+void detectorEngine::configure(int width, int height){
+    m_width = width > 0 ? width : 0;
+    m_height = height > 0 ? height : 0;
+}
+bool detectorEngine::available(){
+    streamDescriptor desc;
+    return shmRegistry::instance().find(CAMERA_STREAM, desc) && desc.kind == SHM_FRAME_RING;
+}
+void detectorEngine::stop(){
+    if(!m_thread.joinable())
+        return;
+    m_running = false;
+    m_thread.join();
+    //Whole frames again for the other readers of "camera"
+    if(m_eyeRegion)
+        m_feedback.clear();
+    m_stream.close();
+    m_gaze.destroy();
+}
+detectorEngineStats detectorEngine::stats() const{
+    detectorEngineStats stats;
+    stats.frames = m_frames.load();
+    stats.tracked = m_tracked.load();
+    stats.dropped = m_dropped.load();
+    stats.meanMs = stats.frames ? m_totalUs.load()/1000.0/stats.frames : 0;
+    stats.latencyMs = stats.frames ? m_latencyUs.load()/1000.0/stats.frames : 0;
+    return stats;
+}
+void detectorEngine::run(){
+    if(!m_cores.empty()){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for(std::size_t i=0;i<m_cores.size();i++)
+            if(m_cores[i] >= 0 && m_cores[i] < CPU_SETSIZE)
+                CPU_SET(m_cores[i], &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    while(m_running){
+        //Ring gone or not yet there (capturer restarting): available() was checked at start
+        if(!m_stream.open()){
+            std::this_thread::sleep_for(std::chrono::milliseconds(ENGINE_WAIT_MS));
+            continue;
+        }
+        frameInfo info;
+        bool eyeRegion;
+        const uint64_t dropped = m_stream.dropped();
+        if(!m_stream.next(m_frame, info, eyeRegion)){
+            m_stream.wait(ENGINE_WAIT_MS);
+            continue;
+        }
+        m_dropped += m_stream.dropped() - dropped;
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        if(m_eyes == BINOCULAR_EYES)
+            measureBinocular(info);
+        else
+            measureMonocular(info, eyeRegion);
+        m_totalUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+        m_frames++;
+        const int64_t latency = frameRingClock() - info.timestamp;
+        if(latency > 0)
+            m_latencyUs += latency;
+    }
+}
+void detectorEngine::measureMonocular(const frameInfo& info, bool eyeRegion){
+    //Slots may hold a region only: the pixel constants follow the sensor frame
+    m_tracker.setSensorHeight(m_stream.sensorHeight() > 0 ? m_stream.sensorHeight() : m_height);
+    const int status = m_tracker.measure(m_frame);
+    if(status == 0)
+        m_tracked++;
+    if(m_eyeRegion){
+        //Region for the next frames; lost: the capturer sends whole frames for the re-detection
+        if(status == 0){
+            cv::Rect roi = m_tracker.userRoi();
+            if(roi.area() == 0)
+                roi = m_tracker.ellipse().boundingRect();
+            m_feedback.publishEyeRegion(roi, m_frame.cols, m_frame.rows, info.frameId);
+        }else{
+            m_feedback.clear();
+        }
+    }
+    uint32_t flags = eyeRegion || info.originX != 0 || info.originY != 0 ? GAZE_EYE_REGION : 0;
+    if(status == 0 && m_tracker.lastPath() == PATH_FAST)
+        flags |= GAZE_FAST_PATH;
+    push(info, status, m_tracker.ellipse(), m_tracker.pupilPoint(), m_tracker.glints(), flags);
+}
+void detectorEngine::measureBinocular(const frameInfo& info){
+    binocularResult result;
+    if(m_binocular.measure(m_frame, info.frameId, info.timestamp, result) > 0)
+        m_tracked++;
+    for(int eye=0;eye<BINOCULAR_EYES;eye++){
+        const eyeMeasure& m = result.eyes[eye];
+        uint32_t flags = eye == BINOCULAR_RIGHT ? GAZE_RIGHT_EYE : 0;
+        if(m.status == 0 && m.path == PATH_FAST)
+            flags |= GAZE_FAST_PATH;
+        push(info, m.status, m.ellipse, m.pupil, m.glints, flags);
+    }
+}
+void detectorEngine::push(const frameInfo& info, int status, const cv::RotatedRect& ellipse, const cv::Point2d& pupil, const std::pair<cv::Point2d,cv::Point2d>& glints, uint32_t flags){
+    gazeSample sample = gazeSample();
+    sample.frameId = info.frameId;
+    sample.timestamp = info.timestamp;
+    sample.error = status;
+    sample.flags = flags;
+    if(status == 0){
+        //Frame ring slots may hold a region only: samples are in sensor pixels
+        sample.pupilX = pupil.x + info.originX;
+        sample.pupilY = pupil.y + info.originY;
+        sample.ellipseX = ellipse.center.x + info.originX;
+        sample.ellipseY = ellipse.center.y + info.originY;
+        sample.ellipseWidth = ellipse.size.width;
+        sample.ellipseHeight = ellipse.size.height;
+        sample.ellipseAngle = ellipse.angle;
+        sample.leftGlintX = glints.first.x + info.originX;
+        sample.leftGlintY = glints.first.y + info.originY;
+        sample.rightGlintX = glints.second.x + info.originX;
+        sample.rightGlintY = glints.second.y + info.originY;
+        sample.flags |= GAZE_TRACKED;
+        if(glints.first != cv::Point2d() && glints.second != cv::Point2d())
+            sample.flags |= GAZE_GLINTS;
+    }
+    m_gaze.push(sample);
+}
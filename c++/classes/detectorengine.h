@@ -0,0 +1,88 @@
+#ifndef DETECTORENGINE_H
+#define DETECTORENGINE_H
+
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+
+//openCV
+#include <opencv2/core/core.hpp>
+
+#include "otracker.h"
+#include "binoculartracker.h"
+#include "framering.h"
+#include "eyeregion.h"
+#include "gazering.h"
+#include "shmregistry.h"
+
+/* Live pupil detection inside the GUI process ([detector] engine=inprocess in plugins.ini).
+ * The same OTracker the external bgPupilDetection runs, on a thread of the GUI: it reads every
+ * frame of the camera and eye rings (eyeStreamReader, woken by the ring futex) and pushes the
+ * results to the gaze ring (gazering.h), where the GUI, the writer and Node read them as they
+ * would read the ones of the external detector. No process to start, no configTrackerDBus, no
+ * second mapping of the frames in another process.
+ * eyeRegion: the engine feeds its search region back to the capturer (eyeregion.h). Then
+ * "camera" alone drops to EYE_CONTEXT_FPS, so only when every full rate reader merges "eye".
+ * Binocular (eyes=2): both eyes of every frame with binocularTracker, one sample per eye; the
+ * feedback holds one region, so there is none.
+ * The external binary is still used for calibration (it writes the d1 file) and offline
+ * processing, live when isolation is preferred, and when the capturer does not publish a frame
+ * ring (available()).*/
+#define DETECTOR_GAZE_RING_NAME     "oscann_gaze_ring_gui"
+
+struct detectorEngineStats{
+    uint64_t frames;                //Frames measured
+    uint64_t tracked;               //Frames with at least one eye
+    uint64_t dropped;               //Overwritten in the ring before the engine got to them
+    double meanMs;                  //measure()
+    double latencyMs;               //Capture -> sample in the gaze ring, mean
+};
+
+class detectorEngine{
+public:
+    detectorEngine();
+    ~detectorEngine();
+    //eyes: 1 or 2. cores: CPUs for the thread (empty: any)
+    bool start(int eyes = 1, const std::vector<int>& cores = std::vector<int>(), bool eyeRegion = false);
+    //Geometry configTrackerDBus gives the external detector. Before start()
+    void configure(int width, int height);
+    //"camera" is a frame ring in the registry: the engine has frames to read
+    static bool available();
+    void stop();
+    bool isRunning() const {return m_running.load();}
+    detectorEngineStats stats() const;
+    std::string getLastError(){return m_errorMsg;}
+private:
+    detectorEngine(const detectorEngine&);
+    detectorEngine& operator=(const detectorEngine&);
+    void run();
+    void measureMonocular(const frameInfo& info, bool eyeRegion);
+    void measureBinocular(const frameInfo& info);
+    void push(const frameInfo& info, int status, const cv::RotatedRect& ellipse, const cv::Point2d& pupil, const std::pair<cv::Point2d,cv::Point2d>& glints, uint32_t flags);
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    int m_eyes;
+    std::vector<int> m_cores;
+    bool m_eyeRegion;
+    int m_width;
+    int m_height;
+
+    //Only used by the engine thread
+    OTracker m_tracker;
+    binocularTracker m_binocular;
+    eyeStreamReader m_stream;
+    eyeRegionWriter m_feedback;
+    gazeRingWriter m_gaze;
+    cv::Mat m_frame;
+
+    std::atomic<uint64_t> m_frames;
+    std::atomic<uint64_t> m_tracked;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint64_t> m_totalUs;
+    std::atomic<uint64_t> m_latencyUs;
+    std::string m_errorMsg;
+};
+
+#endif // DETECTORENGINE_H
@@ -0,0 +1,254 @@
+#include "eyeregion.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+using namespace boost::interprocess;
+
+// ----------------------------------------------------------
+// Tracker side
+// ----------------------------------------------------------
+eyeRegionWriter::eyeRegionWriter() : m_record(NULL){}
+eyeRegionWriter::~eyeRegionWriter(){
+    //The capturer goes back to whole frames
+    if(m_record != NULL)
+        clear();
+}
+bool eyeRegionWriter::open(){
+    try{
+        shared_memory_object shm(open_or_create, EYE_REGION_NAME, read_write);
+        offset_t size = 0;
+        if(!shm.get_size(size) || size < (offset_t)sizeof(eyeRegionRecord))
+            shm.truncate(sizeof(eyeRegionRecord));
+        mapped_region region(shm, read_write);
+        m_region.swap(region);
+    }catch(interprocess_exception& e){
+        m_errorMsg = std::string("ERROR 01: eyeRegionWriter - ") + e.what();
+        return false;
+    }
+    m_record = static_cast<eyeRegionRecord*>(m_region.get_address());
+    if(m_record->magic != EYE_REGION_MAGIC){
+        new (m_record) eyeRegionRecord();
+        std::atomic_thread_fence(std::memory_order_release);
+        m_record->magic = EYE_REGION_MAGIC;
+    }
+    return true;
+}
+bool eyeRegionWriter::publishEyeRegion(const cv::Rect& roi, int frameWidth, int frameHeight, uint64_t frameId){
+    if(m_record == NULL && !open())
+        return false;
+    cv::Rect region;
+    if(roi.area() > 0 && frameWidth > 0 && frameHeight > 0){
+        //Margin for the eye movement until the capturer sees the next region
+        const int mx = cvRound(roi.width*EYE_REGION_MARGIN);
+        const int my = cvRound(roi.height*EYE_REGION_MARGIN);
+        region = cv::Rect(roi.x - mx, roi.y - my, roi.width + 2*mx, roi.height + 2*my);
+        //Aligned rows for the capturer copies
+        const int x0 = region.x & ~(EYE_REGION_ALIGN - 1);
+        const int x1 = (region.br().x + EYE_REGION_ALIGN - 1) & ~(EYE_REGION_ALIGN - 1);
+        region.x = x0;
+        region.width = x1 - x0;
+        region &= cv::Rect(0, 0, frameWidth, frameHeight);
+    }
+    seqlockWriteBegin(m_record->seq);
+    m_record->x = region.x;
+    m_record->y = region.y;
+    m_record->width = region.width;
+    m_record->height = region.height;
+    m_record->frameWidth = frameWidth;
+    m_record->frameHeight = frameHeight;
+    m_record->frameId = frameId;
+    m_record->timestamp = frameRingClock();
+    seqlockWriteEnd(m_record->seq);
+    return true;
+}
+
+// ----------------------------------------------------------
+// Capturer side
+// ----------------------------------------------------------
+eyeRegionReader::eyeRegionReader() : m_record(NULL), m_lastOpen(0){}
+bool eyeRegionReader::region(int frameWidth, int frameHeight, cv::Rect& roi){
+    const int64_t now = frameRingClock();
+    if(m_record == NULL){
+        //The tracker may not be running yet; do not try on every frame
+        if(now - m_lastOpen < EYE_REGION_TIMEOUT_US)
+            return false;
+        m_lastOpen = now;
+        try{
+            shared_memory_object shm(open_only, EYE_REGION_NAME, read_only);
+            mapped_region region(shm, read_only);
+            m_region.swap(region);
+        }catch(interprocess_exception&){
+            return false;
+        }
+        if(m_region.get_size() < sizeof(eyeRegionRecord) || static_cast<const eyeRegionRecord*>(m_region.get_address())->magic != EYE_REGION_MAGIC){
+            mapped_region().swap(m_region);
+            return false;
+        }
+        m_record = static_cast<const eyeRegionRecord*>(m_region.get_address());
+    }
+    eyeRegionRecord copy;
+    uint64_t s;
+    int attempts = 0;
+    do{
+        if(++attempts > 16)
+            return false;
+        s = seqlockReadBegin(m_record->seq);
+        copy.x = m_record->x;
+        copy.y = m_record->y;
+        copy.width = m_record->width;
+        copy.height = m_record->height;
+        copy.frameWidth = m_record->frameWidth;
+        copy.frameHeight = m_record->frameHeight;
+        copy.timestamp = m_record->timestamp;
+    }while(seqlockReadRetry(m_record->seq, s));
+    if(copy.width <= 0 || copy.height <= 0 || now - copy.timestamp > EYE_REGION_TIMEOUT_US)
+        return false;
+    if(copy.frameWidth != frameWidth || copy.frameHeight != frameHeight)
+        return false;           //Region of another resolution
+    roi = cv::Rect(copy.x, copy.y, copy.width, copy.height) & cv::Rect(0, 0, frameWidth, frameHeight);
+    return roi.area() > 0;
+}
+
+// ----------------------------------------------------------
+// Capturer: "camera" and "eye" rings
+// ----------------------------------------------------------
+eyeStreamWriter::eyeStreamWriter() : m_contextPeriodUs(1000000/EYE_CONTEXT_FPS), m_lastFull(0){
+    std::memset(&m_stats, 0, sizeof(m_stats));
+}
+bool eyeStreamWriter::create(unsigned int slots, unsigned int maxWidth, unsigned int maxHeight, unsigned int channels, double fps){
+    if(!m_full.create(FRAME_RING_NAME, slots, maxWidth, maxHeight, channels, CAMERA_STREAM)){
+        m_errorMsg = m_full.getLastError();
+        return false;
+    }
+    if(!m_eye.create(EYE_RING_NAME, slots, maxWidth, maxHeight, channels, EYE_STREAM)){
+        m_errorMsg = m_eye.getLastError();
+        m_full.destroy();
+        return false;
+    }
+    //Slower cameras send everything
+    m_contextPeriodUs = fps > EYE_CONTEXT_FPS ? 1000000/EYE_CONTEXT_FPS : 0;
+    m_lastFull = 0;
+    std::memset(&m_stats, 0, sizeof(m_stats));
+    return true;
+}
+void eyeStreamWriter::destroy(){
+    m_eye.destroy();
+    m_full.destroy();
+}
+uint64_t eyeStreamWriter::publish(const cv::Mat& frame, int64_t timestamp){
+    m_stats.frames++;
+    cv::Rect roi;
+    const bool eye = m_contextPeriodUs > 0 && m_feedback.region(frame.cols, frame.rows, roi);
+    uint64_t id = 0;
+    if(!eye || timestamp - m_lastFull >= m_contextPeriodUs){
+        id = m_full.publish(frame, timestamp);
+        m_lastFull = timestamp;
+        m_stats.fullFrames++;
+        m_stats.bytes += frame.total()*frame.elemSize();
+    }
+    if(eye){
+        //A view: publish() copies the rows with the frame step
+        id = m_eye.publish(frame(roi), timestamp, roi.x, roi.y);
+        m_stats.eyeFrames++;
+        m_stats.bytes += roi.area()*frame.elemSize();
+    }
+    return id;
+}
+
+// ----------------------------------------------------------
+// Full rate consumers: "camera" + "eye"
+// ----------------------------------------------------------
+eyeStreamReader::eyeStreamReader() : m_fullGeneration(0), m_eyeGeneration(0), m_hasFull(false), m_hasEye(false), m_lastEye(false),
+    m_lastTimestamp(0), m_orphans(0){}
+bool eyeStreamReader::openRing(const char* stream, const char* fallback, frameRingReader& ring, uint64_t& generation){
+    //Same lookup as cameraViewer::mapSharedMemory
+    streamDescriptor desc;
+    if(shmRegistry::instance().find(stream, desc) && desc.kind == SHM_FRAME_RING){
+        if(ring.isOpen() && desc.generation == generation)
+            return true;
+        if(!ring.open(desc.segment))
+            return false;
+        generation = desc.generation;
+        return true;
+    }
+    if(fallback == NULL){
+        ring.close();
+        return false;
+    }
+    return ring.isOpen() || ring.open(fallback);
+}
+bool eyeStreamReader::open(){
+    const uint64_t fullGeneration = m_fullGeneration;
+    if(!openRing(CAMERA_STREAM, FRAME_RING_NAME, m_full, m_fullGeneration))
+        return false;
+    if(m_fullGeneration != fullGeneration){
+        //Another capture: nothing read ahead or pasted belongs to it
+        m_base.release();
+        m_hasFull = m_hasEye = false;
+        m_lastTimestamp = 0;
+    }
+    const uint64_t eyeGeneration = m_eyeGeneration;
+    if(!openRing(EYE_STREAM, NULL, m_eye, m_eyeGeneration) || m_eyeGeneration != eyeGeneration)
+        m_hasEye = false;
+    return true;
+}
+void eyeStreamReader::close(){
+    m_full.close();
+    m_eye.close();
+    m_fullGeneration = m_eyeGeneration = 0;
+    m_base.release();
+    m_hasFull = m_hasEye = false;
+    m_lastTimestamp = 0;
+}
+bool eyeStreamReader::next(cv::Mat& frame, frameInfo& info, bool& eyeRegion){
+    for(;;){
+        if(!m_hasFull)
+            m_hasFull = m_full.next(m_nextFull, m_fullInfo);
+        if(!m_hasEye && m_eye.isOpen())
+            m_hasEye = m_eye.next(m_nextEye, m_eyeInfo);
+        if(!m_hasFull && !m_hasEye)
+            return false;
+        if(m_hasFull && (!m_hasEye || m_fullInfo.timestamp <= m_eyeInfo.timestamp)){
+            //Whole frame: it also holds the eye plane of its own capture
+            std::swap(m_base, m_nextFull);
+            m_hasFull = false;
+            if(m_hasEye && m_eyeInfo.timestamp == m_fullInfo.timestamp)
+                m_hasEye = false;
+            if(m_fullInfo.timestamp <= m_lastTimestamp)
+                continue;           //Its eye plane, read first, was already delivered
+            m_lastTimestamp = m_fullInfo.timestamp;
+            m_lastEye = false;
+            frame = m_base;
+            info = m_fullInfo;
+            eyeRegion = false;
+            return true;
+        }
+        m_hasEye = false;
+        if(m_eyeInfo.timestamp <= m_lastTimestamp)
+            continue;
+        const cv::Rect roi(m_eyeInfo.originX, m_eyeInfo.originY, m_eyeInfo.width, m_eyeInfo.height);
+        if(m_base.empty() || m_base.type() != m_nextEye.type() || (roi & cv::Rect(0, 0, m_base.cols, m_base.rows)) != roi){
+            m_orphans++;            //No whole frame yet, or of another size
+            continue;
+        }
+        m_nextEye.copyTo(m_base(roi));
+        m_lastTimestamp = m_eyeInfo.timestamp;
+        m_lastEye = true;
+        frame = m_base;
+        info = m_eyeInfo;
+        info.width = m_base.cols;
+        info.height = m_base.rows;
+        info.originX = 0;
+        info.originY = 0;
+        eyeRegion = true;
+        return true;
+    }
+}
+void eyeStreamReader::wait(int timeoutMs){
+    if(m_lastEye && m_eye.isOpen())
+        m_eye.wait(m_eye.lastId(), std::min(timeoutMs, EYE_MERGE_WAIT_MS));
+    else
+        m_full.wait(m_full.lastId(), timeoutMs);
+}
@@ -0,0 +1,143 @@
+#ifndef EYEREGION_H
+#define EYEREGION_H
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+//openCV
+#include <opencv2/core/core.hpp>
+
+#include <string>
+#include "seqlock.h"
+#include "framering.h"
+
+/* Eye region feedback.
+ * The tracker publishes the region it will search in the next frames (eyeRegionWriter); the
+ * capturer reads it (eyeStreamWriter) and, while it is fresh, publishes only that region at full
+ * rate in the "eye" stream and the whole frame at EYE_CONTEXT_FPS in the "camera" stream, for the
+ * preview and for re-detection. Without region (tracker lost, stopped or stalled) every frame
+ * goes whole to "camera", as before.
+ * Readers of "eye" paste the plane at (originX, originY) of the last full frame; full rate
+ * consumers read both streams with eyeStreamReader. While a region is published, a reader of
+ * "camera" alone gets EYE_CONTEXT_FPS: only the detector engine publishes it, and only with
+ * [detector] eyeRegion=true (bgImageWriter reads "camera" alone). The preview overlay reads the
+ * eye stream when there is one, but does not ask for it.
+ * eyeStreamWriter belongs to the capturer (bgVideoCapturer, built outside this tree);
+ * c++/tests/eyeregion_test.cpp drives it against the readers.*/
+#define EYE_REGION_NAME         "oscann_eye_region"
+#define EYE_REGION_MAGIC        0x31524553  //"SER1"
+#define EYE_RING_NAME           "m_shared_eye_ring"
+#define EYE_REGION_MARGIN       0.5         //Of the region size, added on every side
+#define EYE_REGION_ALIGN        16          //Bytes: x and width of the region
+#define EYE_REGION_TIMEOUT_US   200000      //Older regions are ignored
+#define EYE_CONTEXT_FPS         30
+//eyeStreamReader::wait on the eye ring: the capturer may go back to whole frames at any time
+#define EYE_MERGE_WAIT_MS       5
+
+struct eyeRegionRecord{
+    uint32_t magic;
+    seqCounter seq;
+    int32_t x;                  //Sensor pixels, margin included. width 0: no region
+    int32_t y;
+    int32_t width;
+    int32_t height;
+    int32_t frameWidth;         //Frame the region refers to
+    int32_t frameHeight;
+    uint64_t frameId;           //Frame the tracker measured
+    int64_t timestamp;          //frameRingClock() when published
+};
+
+//Tracker side
+class eyeRegionWriter{
+public:
+    eyeRegionWriter();
+    ~eyeRegionWriter();
+    //roi: region searched by the tracker; the margin is added here. An empty roi clears it
+    bool publishEyeRegion(const cv::Rect& roi, int frameWidth, int frameHeight, uint64_t frameId);
+    void clear(){publishEyeRegion(cv::Rect(), 0, 0, 0);}
+    std::string getLastError(){return m_errorMsg;}
+private:
+    bool open();
+    boost::interprocess::mapped_region m_region;
+    eyeRegionRecord* m_record;
+    std::string m_errorMsg;
+};
+
+//Capturer side
+class eyeRegionReader{
+public:
+    eyeRegionReader();
+    //Current region, clipped to the frame. False if there is none or it is stale
+    bool region(int frameWidth, int frameHeight, cv::Rect& roi);
+private:
+    boost::interprocess::mapped_region m_region;
+    const eyeRegionRecord* m_record;
+    int64_t m_lastOpen;
+};
+
+struct eyeStreamStats{
+    uint64_t frames;            //Frames given to publish()
+    uint64_t eyeFrames;         //Published as eye region
+    uint64_t fullFrames;        //Published whole
+    uint64_t bytes;             //Pixel bytes written to shared memory
+};
+
+/* The capturer loop only calls publish() for every frame.*/
+class eyeStreamWriter{
+public:
+    eyeStreamWriter();
+    bool create(unsigned int slots, unsigned int maxWidth, unsigned int maxHeight, unsigned int channels, double fps);
+    void destroy();
+    uint64_t publish(const cv::Mat& frame, int64_t timestamp);
+    eyeStreamStats stats() const {return m_stats;}
+    std::string getLastError(){return m_errorMsg;}
+private:
+    frameRingWriter m_full;
+    frameRingWriter m_eye;
+    eyeRegionReader m_feedback;
+    int64_t m_contextPeriodUs;
+    int64_t m_lastFull;
+    eyeStreamStats m_stats;
+    std::string m_errorMsg;
+};
+
+/* Consumer side of both streams: every frame, whole.
+ * Frames of "camera" and "eye" are merged in capture order; each eye plane is pasted over the
+ * last whole frame. A whole frame and the eye plane of the same capture are delivered once.*/
+class eyeStreamReader{
+public:
+    eyeStreamReader();
+    //(Re)opens the rings whose producer created new ones. False while there is no camera ring
+    bool open();
+    void close();
+    bool isOpen() const {return m_full.isOpen();}
+    //Oldest frame not read yet. frame shares the buffer of the reader: it is good until the
+    //next call. eyeRegion: only the eye region is newer than the last whole frame
+    bool next(cv::Mat& frame, frameInfo& info, bool& eyeRegion);
+    //Sleeps until the stream of the last frame has a new one, at most timeoutMs
+    void wait(int timeoutMs);
+    //Overwritten before being read, and eye planes without a whole frame under them
+    uint64_t dropped() const {return m_full.dropped() + m_eye.dropped() + m_orphans;}
+    int sensorHeight() const {return m_full.maxHeight();}
+private:
+    eyeStreamReader(const eyeStreamReader&);
+    eyeStreamReader& operator=(const eyeStreamReader&);
+    static bool openRing(const char* stream, const char* fallback, frameRingReader& ring, uint64_t& generation);
+
+    frameRingReader m_full;
+    frameRingReader m_eye;
+    uint64_t m_fullGeneration;
+    uint64_t m_eyeGeneration;
+    cv::Mat m_base;                 //Last whole frame, eye planes pasted on it
+    cv::Mat m_nextFull;             //Read ahead, waiting for the other stream
+    cv::Mat m_nextEye;
+    frameInfo m_fullInfo;
+    frameInfo m_eyeInfo;
+    bool m_hasFull;
+    bool m_hasEye;
+    bool m_lastEye;
+    int64_t m_lastTimestamp;
+    uint64_t m_orphans;
+};
+
+#endif // EYEREGION_H
@@ -0,0 +1,51 @@
+#include "framepacer.h"
+#include "framering.h"
+
+framePacer::framePacer() : m_intervalUs(1000000/PREVIEW_MAX_FPS), m_lastPresentUs(0), m_lastArrivalUs(0), m_pending(false), m_timerArmed(false),
+    m_arrived(0), m_displayed(0), m_late(0){}
+void framePacer::setRate(double captureFps, double maxFps){
+    double fps = maxFps;
+    if(captureFps > 0 && captureFps < fps)
+        fps = captureFps;
+    m_intervalUs = fps > 0 ? (int64_t)(1000000/fps) : 1000000/PREVIEW_MAX_FPS;
+}
+int64_t framePacer::frameArrived(bool visible){
+    const int64_t now = frameRingClock();
+    m_arrived++;
+    m_lastArrivalUs = now;
+    if(!visible){
+        //A repaint requested before hiding may never come
+        m_pending = false;
+        return -1;
+    }
+    if(m_pending || m_timerArmed)
+        return -1;
+    const int64_t wait = m_lastPresentUs + m_intervalUs - now;
+    if(wait > 0){
+        m_timerArmed = true;
+        return wait;
+    }
+    m_pending = true;
+    return 0;
+}
+void framePacer::presented(int64_t captureUs){
+    const int64_t now = frameRingClock();
+    //Without capture time, the notification is the best guess
+    const int64_t age = now - (captureUs > 0 ? captureUs : m_lastArrivalUs.load());
+    if(age > m_intervalUs)
+        m_late++;
+    m_displayed++;
+    m_lastPresentUs = now;
+    m_pending = false;
+}
+void framePacer::missed(){
+    m_pending = false;
+}
+pacerStats framePacer::stats() const{
+    pacerStats stats;
+    stats.arrived = m_arrived.load();
+    stats.displayed = m_displayed.load();
+    stats.late = m_late.load();
+    stats.skipped = stats.arrived > stats.displayed ? stats.arrived - stats.displayed : 0;
+    return stats;
+}
@@ -0,0 +1,51 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <atomic>
+#include <cstdint>
+
+/* Presentation pacing of the preview.
+ * The capturer notifies every frame; the viewer asks for a repaint at most once per preview
+ * interval and the render thread then takes the newest frame, whatever the capture rate.
+ * Nothing is requested while the item is hidden.
+ *  displayed: frames presented
+ *  skipped:   notified frames never presented (newer frame taken, item hidden...)
+ *  late:      presented frames older than one interval (the preview trails the camera)
+ * frameArrived() and due() run in the GUI thread, presented() and missed() in the render thread.*/
+#define PREVIEW_MAX_FPS 25
+
+struct pacerStats{
+    uint64_t arrived;
+    uint64_t displayed;
+    uint64_t skipped;
+    uint64_t late;
+};
+
+class framePacer{
+public:
+    framePacer();
+    //Capture rate and preview limit; the preview runs at the lowest of both
+    void setRate(double captureFps, double maxFps = PREVIEW_MAX_FPS);
+    //A frame was notified. Returns the microseconds until it should be presented
+    //(0: now), or -1 when no repaint has to be requested (hidden or one already pending)
+    int64_t frameArrived(bool visible);
+    //The timer armed for a frameArrived() that was not due yet fired: request the repaint
+    void due(){m_timerArmed = false; m_pending = true;}
+    //captureUs: capture time of the presented frame (frameRingClock), 0 if unknown
+    void presented(int64_t captureUs);
+    //The repaint found no new frame
+    void missed();
+    int64_t intervalUs() const {return m_intervalUs.load();}
+    pacerStats stats() const;
+private:
+    std::atomic<int64_t> m_intervalUs;
+    std::atomic<int64_t> m_lastPresentUs;
+    std::atomic<int64_t> m_lastArrivalUs;
+    std::atomic<bool> m_pending;
+    bool m_timerArmed;
+    std::atomic<uint64_t> m_arrived;
+    std::atomic<uint64_t> m_displayed;
+    std::atomic<uint64_t> m_late;
+};
+
+#endif // FRAMEPACER_H
@@ -0,0 +1,364 @@
+#include "framering.h"
+
+#include <cstring>
+#include <new>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+using namespace boost::interprocess;
+
+static inline uint32_t alignUp(uint32_t value){
+    return (value + FRAME_RING_ALIGN - 1) & ~(uint32_t)(FRAME_RING_ALIGN - 1);
+}
+static inline uint32_t headerBytes(){
+    return alignUp(sizeof(frameRingHeader));
+}
+
+int64_t frameRingClock(){
+    return monotonicUs();
+}
+
+// ----------------------------------------------------------
+// Writer (capturer side)
+// ----------------------------------------------------------
+frameRingWriter::frameRingWriter() : m_header(NULL), m_nextId(1){}
+frameRingWriter::~frameRingWriter(){
+    destroy();
+}
+bool frameRingWriter::create(const char* name, unsigned int slots, unsigned int maxWidth, unsigned int maxHeight, unsigned int channels, const char* stream){
+    destroy();
+    if(slots < 2){
+        m_errorMsg = "ERROR 01: frameRingWriter - At least two slots are needed";
+        return false;
+    }
+    uint32_t maxBytes = maxWidth*maxHeight*channels;
+    uint32_t stride = alignUp(sizeof(frameSlotHeader) + maxBytes);
+    try{
+        shared_memory_object::remove(name);
+        shared_memory_object shm(create_only, name, read_write);
+        shm.truncate(headerBytes() + (offset_t)stride*slots);
+        mapped_region region(shm, read_write);
+        m_region.swap(region);
+    }catch(interprocess_exception& e){
+        m_errorMsg = std::string("ERROR 02: frameRingWriter - ") + e.what();
+        return false;
+    }
+    m_name = name;
+    uchar* base = static_cast<uchar*>(m_region.get_address());
+    std::memset(base, 0, m_region.get_size());
+    m_header = new (base) frameRingHeader();
+    m_header->version = FRAME_RING_VERSION;
+    m_header->slots = slots;
+    m_header->slotStride = stride;
+    m_header->maxBytes = maxBytes;
+    m_header->maxWidth = maxWidth;
+    m_header->maxHeight = maxHeight;
+    m_header->channels = channels;
+    m_header->head.store(0, std::memory_order_relaxed);
+    m_header->wakeup.store(0, std::memory_order_relaxed);
+    m_header->publishedAt.store(0, std::memory_order_relaxed);
+    for(unsigned int i=0;i<slots;i++)
+        new (base + headerBytes() + (size_t)stride*i) frameSlotHeader();
+    m_nextId = 1;
+    //Readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = FRAME_RING_MAGIC;
+    if(stream != NULL){
+        m_stream = stream;
+        if(shmRegistry::instance().publish(stream, name, SHM_FRAME_RING, maxWidth, maxHeight, channels == 3 ? FRAME_RGB888 : FRAME_GRAY8, slots) == 0)
+            m_errorMsg = shmRegistry::instance().getLastError();
+    }
+    return true;
+}
+void frameRingWriter::destroy(){
+    if(m_header == NULL)
+        return;
+    if(!m_stream.empty())
+        shmRegistry::instance().withdraw(m_stream.c_str());
+    m_stream.clear();
+    m_header = NULL;
+    mapped_region().swap(m_region);
+    shared_memory_object::remove(m_name.c_str());
+}
+uint64_t frameRingWriter::publish(const uchar* data, int width, int height, int step, frameFormat format, int64_t timestamp, int originX, int originY){
+    if(m_header == NULL)
+        return 0;
+    const uint32_t rowBytes = width*(format == FRAME_RGB888 ? 3 : 1);
+    if(rowBytes*height > m_header->maxBytes){
+        m_errorMsg = "ERROR 03: frameRingWriter - Frame bigger than the slots";
+        return 0;
+    }
+    const uint64_t id = m_nextId++;
+    uchar* slot = static_cast<uchar*>(m_region.get_address()) + headerBytes() + (size_t)m_header->slotStride*(id % m_header->slots);
+    frameSlotHeader* sh = reinterpret_cast<frameSlotHeader*>(slot);
+    uchar* pixels = slot + sizeof(frameSlotHeader);
+    seqlockWriteBegin(sh->seq);
+    sh->frameId = id;
+    sh->timestamp = timestamp;
+    sh->width = width;
+    sh->height = height;
+    sh->step = rowBytes;
+    sh->format = format;
+    sh->originX = originX;
+    sh->originY = originY;
+    if((uint32_t)step == rowBytes){
+        std::memcpy(pixels, data, (size_t)rowBytes*height);
+    }else{
+        for(int y=0;y<height;y++)
+            std::memcpy(pixels + (size_t)rowBytes*y, data + (size_t)step*y, rowBytes);
+    }
+    seqlockWriteEnd(sh->seq);
+    m_header->head.store(id, std::memory_order_release);
+    m_header->publishedAt.store(frameRingClock(), std::memory_order_relaxed);
+    //Without waiters it does not enter the scheduler: cheaper than the DBus signal it replaces
+    sharedFutexWake(m_header->wakeup);
+    return id;
+}
+uint64_t frameRingWriter::publish(const cv::Mat& frame, int64_t timestamp, int originX, int originY){
+    return publish(frame.data, frame.cols, frame.rows, frame.step, frame.channels() == 3 ? FRAME_RGB888 : FRAME_GRAY8, timestamp, originX, originY);
+}
+
+// ----------------------------------------------------------
+// Readers (viewer, tracker, Node). They never write the segment
+// ----------------------------------------------------------
+frameRingReader::frameRingReader() : m_header(NULL), m_lastId(0), m_dropped(0){}
+bool frameRingReader::open(const char* name, bool copyOnWrite){
+    close();
+    try{
+        shared_memory_object shm(open_only, name, read_only);
+        mapped_region region(shm, copyOnWrite ? copy_on_write : read_only);
+        m_region.swap(region);
+    }catch(interprocess_exception& e){
+        m_errorMsg = std::string("ERROR 01: frameRingReader - ") + e.what();
+        return false;
+    }
+    const frameRingHeader* header = static_cast<const frameRingHeader*>(m_region.get_address());
+    if(m_region.get_size() < headerBytes()
+            || header->magic != FRAME_RING_MAGIC
+            || header->version != FRAME_RING_VERSION
+            || m_region.get_size() < headerBytes() + (size_t)header->slotStride*header->slots){
+        m_errorMsg = "ERROR 02: frameRingReader - Not a frame ring or not ready";
+        mapped_region().swap(m_region);
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    m_header = header;
+    m_lastId = 0;
+    m_dropped = 0;
+    return true;
+}
+void frameRingReader::close(){
+    m_header = NULL;
+    mapped_region().swap(m_region);
+}
+uint64_t frameRingReader::head() const{
+    return m_header ? m_header->head.load(std::memory_order_acquire) : 0;
+}
+bool frameRingReader::wait(uint64_t lastId, int timeoutMs) const{
+    if(m_header == NULL)
+        return false;
+    return sharedFutexWait(m_header->wakeup, timeoutMs, [&](){return head() != lastId;});
+}
+int64_t frameRingReader::publishedAt() const{
+    return m_header ? m_header->publishedAt.load(std::memory_order_relaxed) : 0;
+}
+bool frameRingReader::copySlot(uint64_t id, cv::Mat& dst, frameInfo& info){
+    const uchar* slot = static_cast<const uchar*>(m_region.get_address()) + headerBytes() + (size_t)m_header->slotStride*(id % m_header->slots);
+    const frameSlotHeader* sh = reinterpret_cast<const frameSlotHeader*>(slot);
+    const uchar* pixels = slot + sizeof(frameSlotHeader);
+    for(int attempt=0;attempt<8;attempt++){
+        uint64_t s = seqlockReadBegin(sh->seq);
+        if(s & 1)
+            continue;               //The writer is in this slot right now
+        frameInfo copy;
+        copy.frameId = sh->frameId;
+        copy.timestamp = sh->timestamp;
+        copy.width = sh->width;
+        copy.height = sh->height;
+        copy.format = sh->format;
+        copy.originX = sh->originX;
+        copy.originY = sh->originY;
+        uint32_t step = sh->step;
+        if(copy.frameId != id){
+            if(seqlockReadRetry(sh->seq, s))
+                continue;
+            return false;           //Already overwritten (or not written yet)
+        }
+        const int channels = copy.format == FRAME_RGB888 ? 3 : 1;
+        if((uint64_t)step*copy.height > m_header->maxBytes || (uint32_t)copy.width*channels > step)
+            continue;               //Torn header
+        dst.create(copy.height, copy.width, channels == 3 ? CV_8UC3 : CV_8UC1);
+        for(int y=0;y<copy.height;y++)
+            std::memcpy(dst.ptr(y), pixels + (size_t)step*y, (size_t)copy.width*channels);
+        if(seqlockReadRetry(sh->seq, s))
+            continue;
+        info = copy;
+        return true;
+    }
+    return false;
+}
+const frameSlotHeader* frameRingReader::slotHeader(uint32_t slot) const{
+    return reinterpret_cast<const frameSlotHeader*>(static_cast<const uchar*>(m_region.get_address()) + headerBytes() + (size_t)m_header->slotStride*slot);
+}
+const uchar* frameRingReader::slotPixels(uint32_t slot) const{
+    if(m_header == NULL || slot >= m_header->slots)
+        return NULL;
+    return reinterpret_cast<const uchar*>(slotHeader(slot)) + sizeof(frameSlotHeader);
+}
+bool frameRingReader::viewSlot(uint64_t id, frameView& view) const{
+    const uint32_t slot = id % m_header->slots;
+    const frameSlotHeader* sh = slotHeader(slot);
+    for(int attempt=0;attempt<8;attempt++){
+        uint64_t s = seqlockReadBegin(sh->seq);
+        if(s & 1)
+            continue;
+        frameInfo copy;
+        copy.frameId = sh->frameId;
+        copy.timestamp = sh->timestamp;
+        copy.width = sh->width;
+        copy.height = sh->height;
+        copy.format = sh->format;
+        copy.originX = sh->originX;
+        copy.originY = sh->originY;
+        uint32_t step = sh->step;
+        if(seqlockReadRetry(sh->seq, s))
+            continue;
+        if(copy.frameId != id)
+            return false;
+        const int channels = copy.format == FRAME_RGB888 ? 3 : 1;
+        if((uint64_t)step*copy.height > m_header->maxBytes || (uint32_t)copy.width*channels > step)
+            return false;
+        view.pixels = reinterpret_cast<const uchar*>(sh) + sizeof(frameSlotHeader);
+        view.bytes = (std::size_t)step*copy.height;
+        view.step = step;
+        view.slot = slot;
+        view.seq = s;
+        view.info = copy;
+        return true;
+    }
+    return false;
+}
+bool frameRingReader::isValid(const frameView& view) const{
+    if(m_header == NULL || view.slot >= m_header->slots)
+        return false;
+    //Acquire fence first: the reads of the pixels are done before the counter is read again
+    return !seqlockReadRetry(slotHeader(view.slot)->seq, view.seq);
+}
+template<typename Read>
+bool frameRingReader::readLatest(Read read){
+    if(m_header == NULL)
+        return false;
+    for(int attempt=0;attempt<4;attempt++){
+        uint64_t h = head();
+        if(h == 0 || h == m_lastId)
+            return false;
+        if(read(h)){
+            if(m_lastId != 0)
+                m_dropped += h - m_lastId - 1;
+            m_lastId = h;
+            return true;
+        }
+    }
+    return false;
+}
+template<typename Read>
+bool frameRingReader::readNext(Read read){
+    if(m_header == NULL)
+        return false;
+    for(;;){
+        uint64_t h = head();
+        if(h == 0 || h <= m_lastId)
+            return false;
+        uint64_t want = m_lastId == 0 ? h : m_lastId + 1;
+        //The writer has already reused the slots of the oldest frames
+        if(h - want >= m_header->slots)
+            want = h - m_header->slots + 1;
+        if(m_lastId != 0)
+            m_dropped += want - m_lastId - 1;
+        m_lastId = want;
+        if(read(want))
+            return true;
+        m_dropped++;
+    }
+}
+bool frameRingReader::latest(cv::Mat& dst, frameInfo& info){
+    return readLatest([&](uint64_t id){return copySlot(id, dst, info);});
+}
+bool frameRingReader::next(cv::Mat& dst, frameInfo& info){
+    return readNext([&](uint64_t id){return copySlot(id, dst, info);});
+}
+bool frameRingReader::viewLatest(frameView& view){
+    return readLatest([&](uint64_t id){return viewSlot(id, view);});
+}
+bool frameRingReader::viewNext(frameView& view){
+    return readNext([&](uint64_t id){return viewSlot(id, view);});
+}
+
+// ----------------------------------------------------------
+// Notifier (futex -> eventfd)
+// ----------------------------------------------------------
+frameRingNotifier::frameRingNotifier() : m_running(false){
+    m_eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    std::memset(&m_stats, 0, sizeof(m_stats));
+}
+frameRingNotifier::~frameRingNotifier(){
+    stop();
+    ::close(m_eventFd);
+}
+bool frameRingNotifier::start(const char* name){
+    stop();
+    if(m_eventFd < 0){
+        m_errorMsg = "ERROR 01: frameRingNotifier - No eventfd";
+        return false;
+    }
+    if(!m_ring.open(name)){
+        m_errorMsg = m_ring.getLastError();
+        return false;
+    }
+    m_running = true;
+    m_thread = std::thread(&frameRingNotifier::run, this);
+    return true;
+}
+void frameRingNotifier::stop(){
+    if(!m_thread.joinable())
+        return;
+    m_running = false;
+    m_thread.join();
+    m_ring.close();
+}
+void frameRingNotifier::run(){
+    uint64_t last = m_ring.head();
+    while(m_running){
+        if(!m_ring.wait(last, FRAME_NOTIFY_POLL_MS))
+            continue;
+        const uint64_t head = m_ring.head();
+        uint64_t frames = head - last;
+        last = head;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.frames += frames;
+        }
+        //The counter adds up until the consumer reads it
+        ssize_t r = write(m_eventFd, &frames, sizeof(frames));
+        (void)r;
+    }
+}
+uint64_t frameRingNotifier::acknowledge(){
+    uint64_t frames = 0;
+    if(read(m_eventFd, &frames, sizeof(frames)) != sizeof(frames) || frames == 0)
+        return 0;
+    const int64_t publishedAt = m_ring.publishedAt();
+    const double us = publishedAt > 0 ? (double)(frameRingClock() - publishedAt) : 0;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.notifications++;
+    m_stats.coalesced += frames - 1;
+    m_latency.add(us);
+    m_stats.meanUs = m_latency.mean;
+    m_stats.stdUs = m_latency.std();
+    m_stats.maxUs = m_latency.max;
+    return frames;
+}
+frameNotifyStats frameRingNotifier::stats() const{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
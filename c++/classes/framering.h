@@ -0,0 +1,208 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+//openCV
+#include <opencv2/core/core.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "runningstats.h"
+#include "seqlock.h"
+#include "shmregistry.h"
+
+/* Frame ring in shared memory.
+ * The capturer publishes every frame in the next slot of a ring; the viewer, the tracker and
+ * Node read them without locks (seqlock per slot). A slot keeps its frame until the writer laps
+ * the ring, so a reader that falls behind loses frames, and it knows how many.
+ *
+ *  | frameRingHeader | slot 0: frameSlotHeader + pixels | slot 1 | ... | slot n-1 |
+ *
+ * Frame ids start at 1 and frame id k lives in slot k % slots.
+ * The writer is the capturer (bgVideoCapturer, built outside this tree); until it creates the
+ * ring, the consumers fall back to "m_shared". c++/tests/framering_test.cpp drives both ends.
+ * A slot may hold only a region of the sensor frame (eye stream, eyeregion.h): originX/originY
+ * give its position in the full frame.
+ *
+ * Frame ready notification (version 3): after every frame the writer bumps the futex word
+ * "wakeup" and wakes its waiters (FUTEX_WAKE, shared futex: the waiters are other processes).
+ * Readers sleep on it with wait() instead of a DBus signal per frame; the futex only reads the
+ * word, so the segment stays read only for them. frameRingNotifier turns it into an eventfd for
+ * event loops (QSocketNotifier). DBus is left for the control signals.*/
+#define FRAME_RING_NAME     "m_shared_ring"
+#define FRAME_RING_MAGIC    0x5243534f  //"OSCR"
+#define FRAME_RING_VERSION  3
+#define FRAME_RING_ALIGN    64
+//The notifier thread checks if it has to stop at least this often
+#define FRAME_NOTIFY_POLL_MS    100
+
+enum frameFormat{
+    FRAME_GRAY8 = 0,
+    FRAME_RGB888 = 1
+};
+
+struct frameRingHeader{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t slotStride;            //Bytes from one slot header to the next
+    uint32_t maxBytes;              //Pixel bytes available in every slot
+    uint32_t maxWidth;
+    uint32_t maxHeight;
+    uint32_t channels;
+    std::atomic<uint64_t> head;     //Id of the last published frame (0 while empty)
+    std::atomic<uint32_t> wakeup;   //Futex word, +1 per published frame
+    std::atomic<int64_t> publishedAt;   //frameRingClock() when head was published
+};
+struct frameSlotHeader{
+    seqCounter seq;
+    uint64_t frameId;
+    int64_t timestamp;              //Capture time, microseconds of CLOCK_MONOTONIC
+    uint32_t width;
+    uint32_t height;
+    uint32_t step;
+    uint32_t format;
+    int32_t originX;
+    int32_t originY;
+};
+//Copy of a slot header, as seen by a reader
+struct frameInfo{
+    uint64_t frameId;
+    int64_t timestamp;
+    int width;
+    int height;
+    int format;
+    int originX;
+    int originY;
+};
+
+//Pixels of a slot in place, for consumers that do not want a copy (Node, framering wrapper).
+//The slot may be overwritten at any time: the pixels are good only if isValid() still says so
+//after they have been used
+struct frameView{
+    const uchar* pixels;
+    std::size_t bytes;              //step*height
+    uint32_t step;
+    uint32_t slot;
+    uint64_t seq;                   //Seqlock of the slot when the view was taken
+    frameInfo info;
+};
+
+int64_t frameRingClock();
+
+class frameRingWriter{
+public:
+    frameRingWriter();
+    ~frameRingWriter();
+    //stream: name under which the ring is published in shmRegistry (NULL: not published)
+    bool create(const char* name, unsigned int slots, unsigned int maxWidth, unsigned int maxHeight, unsigned int channels, const char* stream = CAMERA_STREAM);
+    void destroy();
+    //Returns the id given to the frame, 0 if it does not fit in a slot
+    uint64_t publish(const uchar* data, int width, int height, int step, frameFormat format, int64_t timestamp, int originX = 0, int originY = 0);
+    uint64_t publish(const cv::Mat& frame, int64_t timestamp, int originX = 0, int originY = 0);
+    bool isCreated() const {return m_header != NULL;}
+    std::string getLastError(){return m_errorMsg;}
+private:
+    std::string m_name;
+    std::string m_stream;
+    boost::interprocess::mapped_region m_region;
+    frameRingHeader* m_header;
+    uint64_t m_nextId;
+    std::string m_errorMsg;
+};
+
+class frameRingReader{
+public:
+    frameRingReader();
+    //copyOnWrite: private mapping that the process may write (its own copy of the pages it
+    //writes, which stop following the ring). For memory handed to code that cannot be kept
+    //from writing (JS ArrayBuffers); the others map it read only
+    bool open(const char* name = FRAME_RING_NAME, bool copyOnWrite = false);
+    void close();
+    bool isOpen() const {return m_header != NULL;}
+    //Newest frame. False when there is nothing new since the last read
+    bool latest(cv::Mat& dst, frameInfo& info);
+    //Oldest frame not read yet. Frames overwritten before being read are counted as dropped
+    bool next(cv::Mat& dst, frameInfo& info);
+    //As latest() and next(), without copying the pixels
+    bool viewLatest(frameView& view);
+    bool viewNext(frameView& view);
+    //The slot still holds the frame of the view: nothing was overwritten while it was used
+    bool isValid(const frameView& view) const;
+    uint32_t slots() const {return m_header ? m_header->slots : 0;}
+    //Pixel area of a slot (maxBytes), whatever frame it holds now
+    const uchar* slotPixels(uint32_t slot) const;
+    std::size_t slotBytes() const {return m_header ? m_header->maxBytes : 0;}
+    uint64_t head() const;
+    //Sleeps until head() is not lastId, at most timeoutMs. False on timeout
+    bool wait(uint64_t lastId, int timeoutMs) const;
+    //frameRingClock() of the last publish, 0 if none
+    int64_t publishedAt() const;
+    uint64_t lastId() const {return m_lastId;}
+    uint64_t dropped() const {return m_dropped;}
+    int maxWidth() const {return m_header ? m_header->maxWidth : 0;}
+    int maxHeight() const {return m_header ? m_header->maxHeight : 0;}
+    std::string getLastError(){return m_errorMsg;}
+private:
+    bool copySlot(uint64_t id, cv::Mat& dst, frameInfo& info);
+    bool viewSlot(uint64_t id, frameView& view) const;
+    const frameSlotHeader* slotHeader(uint32_t slot) const;
+    template<typename Read>
+    bool readLatest(Read read);
+    template<typename Read>
+    bool readNext(Read read);
+    boost::interprocess::mapped_region m_region;
+    const frameRingHeader* m_header;
+    uint64_t m_lastId;
+    uint64_t m_dropped;
+    std::string m_errorMsg;
+};
+
+//Frames published / wake-ups of the consumer. Latency: publish -> acknowledge(), microseconds
+struct frameNotifyStats{
+    uint64_t frames;                //Frames published while running
+    uint64_t notifications;         //acknowledge() calls that found frames
+    uint64_t coalesced;             //Frames that did not need a wake-up of their own
+    double meanUs;
+    double stdUs;
+    double maxUs;
+};
+
+/* Frame ready notifications of a ring as an eventfd.
+ * A thread of its own sleeps on the futex of the ring and adds the number of new frames to the
+ * eventfd, so the consumer is woken once for all the frames published while it was busy.
+ * The eventfd lives as long as the notifier (also between stop() and start()), so a
+ * QSocketNotifier on fd() is created once.*/
+class frameRingNotifier{
+public:
+    frameRingNotifier();
+    ~frameRingNotifier();
+    //Maps the ring on its own: it does not depend on the consumer reader
+    bool start(const char* name);
+    void stop();
+    bool isRunning() const {return m_thread.joinable();}
+    int fd() const {return m_eventFd;}
+    //When fd() is readable: clears it and returns the frames published since the last call
+    uint64_t acknowledge();
+    frameNotifyStats stats() const;
+    std::string getLastError(){return m_errorMsg;}
+private:
+    frameRingNotifier(const frameRingNotifier&);
+    frameRingNotifier& operator=(const frameRingNotifier&);
+    void run();
+
+    frameRingReader m_ring;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    int m_eventFd;
+    mutable std::mutex m_mutex;
+    frameNotifyStats m_stats;
+    runningStats m_latency;
+    std::string m_errorMsg;
+};
+
+#endif // FRAMERING_H
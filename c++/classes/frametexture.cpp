@@ -0,0 +1,54 @@
+#include "frametexture.h"
+
+#ifndef GL_LUMINANCE
+#define GL_LUMINANCE 0x1909
+#endif
+
+frameTexture::frameTexture() : m_id(0), m_format(QImage::Format_Invalid), m_dirty(false), m_uploads(0), m_allocations(0){}
+frameTexture::~frameTexture(){
+    //Deleted by the viewer from the render thread; without context the texture dies with it
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if(m_id != 0 && context != NULL)
+        context->functions()->glDeleteTextures(1, &m_id);
+}
+bool frameTexture::supported(){
+    //GL_LUMINANCE does not exist in core profiles
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    return context != NULL && (context->isOpenGLES() || context->format().profile() != QSurfaceFormat::CoreProfile);
+}
+void frameTexture::setImage(const QImage& image){
+    m_image = image;
+    m_dirty = true;
+}
+bool frameTexture::updateTexture(){
+    if(!m_dirty || m_image.isNull())
+        return false;
+    QOpenGLFunctions* gl = QOpenGLContext::currentContext()->functions();
+    const GLenum format = m_image.format() == QImage::Format_RGB888 ? GL_RGB : GL_LUMINANCE;
+    //QImage rows are 4-byte aligned; 640 px rows always are, but odd widths are not
+    const int pixelBytes = m_image.format() == QImage::Format_RGB888 ? 3 : 1;
+    const GLint alignment = m_image.bytesPerLine() == m_image.width()*pixelBytes ? 1 : 4;
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    if(m_id == 0)
+        gl->glGenTextures(1, &m_id);
+    gl->glBindTexture(GL_TEXTURE_2D, m_id);
+    if(m_size != m_image.size() || m_format != m_image.format()){
+        m_size = m_image.size();
+        m_format = m_image.format();
+        gl->glTexImage2D(GL_TEXTURE_2D, 0, format, m_size.width(), m_size.height(), 0, format, GL_UNSIGNED_BYTE, m_image.constBits());
+        updateBindOptions(true);
+        m_allocations++;
+    }else{
+        gl->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_size.width(), m_size.height(), format, GL_UNSIGNED_BYTE, m_image.constBits());
+    }
+    gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    m_uploads++;
+    m_dirty = false;
+    //Release the staging buffer, otherwise the viewer would detach (copy) it on the next write
+    m_image = QImage();
+    return true;
+}
+void frameTexture::bind(){
+    QOpenGLContext::currentContext()->functions()->glBindTexture(GL_TEXTURE_2D, m_id);
+    updateBindOptions();
+}
@@ -0,0 +1,41 @@
+#ifndef FRAMETEXTURE_H
+#define FRAMETEXTURE_H
+
+#include <QSGDynamicTexture>
+#include <QImage>
+#include <QSize>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+
+/* Camera texture that lives as long as the viewer.
+ * The GL texture is allocated once per size and format; every new frame is copied into it with
+ * glTexSubImage2D instead of creating (and atlasing) a new texture from a QImage.
+ * Only for the OpenGL scene graph: frameTexture::supported() tells the viewer when it has to
+ * fall back to QQuickWindow::createTextureFromImage (software backend, core profiles).
+ * All the methods but setImage() need the render thread with the context current.*/
+class frameTexture : public QSGDynamicTexture{
+public:
+    frameTexture();
+    ~frameTexture();
+    static bool supported();
+    //Keeps a shallow copy of the image until the next updateTexture() uploads it
+    void setImage(const QImage& image);
+    bool updateTexture();
+    int textureId() const {return m_id;}
+    QSize textureSize() const {return m_size;}
+    bool hasAlphaChannel() const {return false;}
+    bool hasMipmaps() const {return false;}
+    void bind();
+    unsigned long long uploads() const {return m_uploads;}
+    unsigned long long allocations() const {return m_allocations;}
+private:
+    GLuint m_id;
+    QSize m_size;
+    QImage::Format m_format;
+    QImage m_image;
+    bool m_dirty;
+    unsigned long long m_uploads;
+    unsigned long long m_allocations;
+};
+
+#endif // FRAMETEXTURE_H
@@ -0,0 +1,168 @@
+#include "gazering.h"
+
+#include <cstring>
+#include <new>
+
+using namespace boost::interprocess;
+
+//Slots start on a cache line of their own
+#define GAZE_RING_ALIGN 64
+
+static inline std::size_t headerBytes(){
+    return (sizeof(gazeRingHeader) + GAZE_RING_ALIGN - 1) & ~(std::size_t)(GAZE_RING_ALIGN - 1);
+}
+
+// ----------------------------------------------------------
+// Writer (detector side)
+// ----------------------------------------------------------
+gazeRingWriter::gazeRingWriter() : m_header(NULL), m_slots(NULL){}
+gazeRingWriter::~gazeRingWriter(){
+    destroy();
+}
+bool gazeRingWriter::create(const char* name, unsigned int capacity, const char* stream){
+    destroy();
+    if(capacity < 2){
+        m_errorMsg = "ERROR 01: gazeRingWriter - At least two slots are needed";
+        return false;
+    }
+    try{
+        shared_memory_object::remove(name);
+        shared_memory_object shm(create_only, name, read_write);
+        shm.truncate(headerBytes() + sizeof(gazeSlot)*capacity);
+        mapped_region region(shm, read_write);
+        m_region.swap(region);
+    }catch(interprocess_exception& e){
+        m_errorMsg = std::string("ERROR 02: gazeRingWriter - ") + e.what();
+        return false;
+    }
+    m_name = name;
+    unsigned char* base = static_cast<unsigned char*>(m_region.get_address());
+    std::memset(base, 0, m_region.get_size());
+    m_header = new (base) gazeRingHeader();
+    m_header->version = GAZE_RING_VERSION;
+    m_header->capacity = capacity;
+    m_header->slotSize = sizeof(gazeSlot);
+    m_header->head.store(0, std::memory_order_relaxed);
+    m_header->wakeup.store(0, std::memory_order_relaxed);
+    m_slots = reinterpret_cast<gazeSlot*>(base + headerBytes());
+    for(unsigned int i=0;i<capacity;i++)
+        new (m_slots + i) gazeSlot();
+    //Readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = GAZE_RING_MAGIC;
+    if(stream != NULL){
+        m_stream = stream;
+        if(shmRegistry::instance().publish(stream, name, SHM_GAZE_RING, 0, 0, 0, capacity) == 0)
+            m_errorMsg = shmRegistry::instance().getLastError();
+    }
+    return true;
+}
+void gazeRingWriter::destroy(){
+    if(m_header == NULL)
+        return;
+    if(!m_stream.empty())
+        shmRegistry::instance().withdraw(m_stream.c_str());
+    m_stream.clear();
+    m_header = NULL;
+    m_slots = NULL;
+    mapped_region().swap(m_region);
+    shared_memory_object::remove(m_name.c_str());
+}
+uint64_t gazeRingWriter::push(const gazeSample& sample){
+    if(m_header == NULL)
+        return 0;
+    const uint64_t sequence = m_header->head.load(std::memory_order_relaxed) + 1;
+    gazeSlot& slot = m_slots[sequence % m_header->capacity];
+    seqlockWriteBegin(slot.seq);
+    slot.sequence = sequence;
+    std::memcpy(&slot.sample, &sample, sizeof(gazeSample));
+    seqlockWriteEnd(slot.seq);
+    m_header->head.store(sequence, std::memory_order_release);
+    sharedFutexWake(m_header->wakeup);
+    return sequence;
+}
+
+// ----------------------------------------------------------
+// Readers
+// ----------------------------------------------------------
+gazeRingReader::gazeRingReader() : m_header(NULL), m_slots(NULL), m_cursor(0), m_lost(0){}
+bool gazeRingReader::open(const char* name, bool backlog){
+    close();
+    try{
+        shared_memory_object shm(open_only, name, read_only);
+        mapped_region region(shm, read_only);
+        m_region.swap(region);
+    }catch(interprocess_exception& e){
+        m_errorMsg = std::string("ERROR 01: gazeRingReader - ") + e.what();
+        return false;
+    }
+    const gazeRingHeader* header = static_cast<const gazeRingHeader*>(m_region.get_address());
+    if(m_region.get_size() < headerBytes()
+            || header->magic != GAZE_RING_MAGIC
+            || header->version != GAZE_RING_VERSION
+            || header->slotSize != sizeof(gazeSlot)
+            || m_region.get_size() < headerBytes() + sizeof(gazeSlot)*header->capacity){
+        m_errorMsg = "ERROR 02: gazeRingReader - Not a gaze ring or not ready";
+        mapped_region().swap(m_region);
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    m_header = header;
+    m_slots = reinterpret_cast<const gazeSlot*>(static_cast<const unsigned char*>(m_region.get_address()) + headerBytes());
+    const uint64_t h = head();
+    m_cursor = !backlog ? h : (h > m_header->capacity ? h - m_header->capacity : 0);
+    m_lost = 0;
+    return true;
+}
+void gazeRingReader::close(){
+    m_header = NULL;
+    m_slots = NULL;
+    mapped_region().swap(m_region);
+}
+uint64_t gazeRingReader::head() const{
+    return m_header ? m_header->head.load(std::memory_order_acquire) : 0;
+}
+std::size_t gazeRingReader::read(std::vector<gazeSample>& samples, std::size_t max){
+    if(m_header == NULL)
+        return 0;
+    std::size_t count = 0;
+    while(count < max){
+        const uint64_t h = head();
+        if(m_cursor >= h)
+            break;
+        uint64_t want = m_cursor + 1;
+        //The writer has already reused the slots of the oldest samples
+        if(h - want >= m_header->capacity){
+            m_lost += h - m_header->capacity + 1 - want;
+            want = h - m_header->capacity + 1;
+        }
+        const gazeSlot& slot = m_slots[want % m_header->capacity];
+        gazeSample copy;
+        bool copied = false;
+        for(int attempt=0;attempt<8 && !copied;attempt++){
+            uint64_t s = seqlockReadBegin(slot.seq);
+            if(s & 1)
+                continue;               //The writer is in this slot right now
+            const uint64_t sequence = slot.sequence;
+            std::memcpy(&copy, &slot.sample, sizeof(copy));
+            if(seqlockReadRetry(slot.seq, s))
+                continue;
+            if(sequence != want)
+                break;                  //Overwritten by a newer sample
+            copied = true;
+        }
+        m_cursor = want;
+        if(!copied){
+            m_lost++;
+            continue;
+        }
+        samples.push_back(copy);
+        count++;
+    }
+    return count;
+}
+bool gazeRingReader::wait(int timeoutMs) const{
+    if(m_header == NULL)
+        return false;
+    return sharedFutexWait(m_header->wakeup, timeoutMs, [&](){return head() > m_cursor;});
+}
@@ -0,0 +1,124 @@
+#ifndef GAZERING_H
+#define GAZERING_H
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "seqlock.h"
+#include "shmregistry.h"
+
+/* Gaze samples in shared memory.
+ * The detector pushes one fixed size record per measured frame (pupilAtDBus carries neither frame
+ * id nor timestamp, and DBus neither keeps the order nor keeps up with the camera). The GUI, the
+ * writer and Node read them in batches, each one with its own cursor: one writer, any number of
+ * readers, no locks (seqlock per slot). A reader slower than the ring loses the oldest samples,
+ * and it knows how many.
+ *
+ *  | gazeRingHeader | slot 0: seq + sequence + gazeSample | slot 1 | ... | slot n-1 |
+ *
+ * Sequences start at 1 and sequence k lives in slot k % capacity. The writer wakes the readers
+ * sleeping in wait() with a shared futex, as the frame ring does.*/
+#define GAZE_RING_NAME          "oscann_gaze_ring"
+#define GAZE_RING_MAGIC         0x5247534f  //"OSGR"
+#define GAZE_RING_VERSION       1
+#define GAZE_RING_CAPACITY      4096        //About 8 s at 520 fps
+#define GAZE_STREAM             "gaze"
+
+//gazeSample::flags
+#define GAZE_TRACKED            0x01        //Pupil and ellipse are valid
+#define GAZE_GLINTS             0x02        //Both glints found
+#define GAZE_BLINK              0x04
+#define GAZE_EYE_REGION         0x08        //Measured on the eye stream (eyeregion.h)
+#define GAZE_RIGHT_EYE          0x10        //Binocular: right eye; left otherwise
+#define GAZE_FAST_PATH          0x20        //Tracked by the blob moments (PATH_FAST); starburst + RANSAC otherwise
+
+//Fixed layout: the record is shared by processes built apart
+struct gazeSample{
+    uint64_t frameId;               //Frame ring id of the measured frame
+    int64_t timestamp;              //Capture time, microseconds of CLOCK_MONOTONIC (frameRingClock)
+    double pupilX;                  //Sensor pixels
+    double pupilY;
+    float ellipseX;
+    float ellipseY;
+    float ellipseWidth;
+    float ellipseHeight;
+    float ellipseAngle;
+    float reserved;
+    double leftGlintX;
+    double leftGlintY;
+    double rightGlintX;
+    double rightGlintY;
+    int32_t error;                  //OTracker::measure return value, 0: measured
+    uint32_t flags;
+};
+static_assert(sizeof(gazeSample) == 96, "gazeSample is shared between processes: keep its layout");
+
+struct gazeSlot{
+    seqCounter seq;
+    uint64_t sequence;
+    gazeSample sample;
+};
+struct gazeRingHeader{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t slotSize;
+    std::atomic<uint64_t> head;     //Sequence of the last sample (0 while empty)
+    std::atomic<uint32_t> wakeup;   //Futex word, +1 per sample
+};
+
+//Detector side
+class gazeRingWriter{
+public:
+    gazeRingWriter();
+    ~gazeRingWriter();
+    //stream: name under which the ring is published in shmRegistry (NULL: not published)
+    bool create(const char* name = GAZE_RING_NAME, unsigned int capacity = GAZE_RING_CAPACITY, const char* stream = GAZE_STREAM);
+    void destroy();
+    //Returns the sequence given to the sample
+    uint64_t push(const gazeSample& sample);
+    bool isCreated() const {return m_header != NULL;}
+    std::string getLastError(){return m_errorMsg;}
+private:
+    gazeRingWriter(const gazeRingWriter&);
+    gazeRingWriter& operator=(const gazeRingWriter&);
+    std::string m_name;
+    std::string m_stream;
+    boost::interprocess::mapped_region m_region;
+    gazeRingHeader* m_header;
+    gazeSlot* m_slots;
+    std::string m_errorMsg;
+};
+
+//GUI, writer, Node. They never write the segment
+class gazeRingReader{
+public:
+    gazeRingReader();
+    //backlog: the first read() starts at the oldest sample still in the ring; otherwise at the next one
+    bool open(const char* name = GAZE_RING_NAME, bool backlog = false);
+    void close();
+    bool isOpen() const {return m_header != NULL;}
+    //Appends to samples, in order, up to max samples not read yet. Returns how many
+    std::size_t read(std::vector<gazeSample>& samples, std::size_t max);
+    //Sleeps until there are samples not read yet, at most timeoutMs. False on timeout
+    bool wait(int timeoutMs) const;
+    uint64_t head() const;
+    uint64_t cursor() const {return m_cursor;}
+    //Samples overwritten before this reader got to them
+    uint64_t lost() const {return m_lost;}
+    std::string getLastError(){return m_errorMsg;}
+private:
+    gazeRingReader(const gazeRingReader&);
+    gazeRingReader& operator=(const gazeRingReader&);
+    boost::interprocess::mapped_region m_region;
+    const gazeRingHeader* m_header;
+    const gazeSlot* m_slots;
+    uint64_t m_cursor;              //Last sequence read
+    uint64_t m_lost;
+    std::string m_errorMsg;
+};
+
+#endif // GAZERING_H
@@ -0,0 +1,339 @@
+#include "jobscheduler.h"
+
+#include <algorithm>
+
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QEventLoop>
+#include <QFile>
+#include <QProcess>
+#include <QProcessEnvironment>
+#include <QSettings>
+#include <QTimer>
+#include <QDebug>
+
+#include "oscann_interface.h"
+
+#define JOB_START_MS    5000        //dbus-daemon and bgPupilDetection start up
+#define JOB_STOP_MS     3000        //Detector shutdown before it is killed
+#define JOB_POLL_MS     100         //Cancellation check while the job runs
+
+jobScheduler::jobScheduler() : m_concurrency(0), m_nextId(1), m_active(0), m_stopping(false), m_runner(&jobScheduler::runDetector){}
+jobScheduler::~jobScheduler(){
+    stop();
+}
+void jobScheduler::setConcurrency(unsigned int jobs){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_concurrency = jobs;
+}
+void jobScheduler::setRunner(const jobRunner& runner){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_runner = runner;
+}
+void jobScheduler::setProgressCallback(const batchProgress& callback){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_progress = callback;
+}
+void jobScheduler::setJournal(const QString& path){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_journal = path;
+}
+unsigned int jobScheduler::submit(const processingJob& job){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_active == 0 && next() < 0){
+        //New batch: the jobs of the last one are dropped
+        m_jobs.clear();
+        m_cancel.clear();
+    }
+    processingJob queued = job;
+    queued.id = m_nextId++;
+    queued.state = JOB_QUEUED;
+    queued.progress = 0;
+    m_jobs.push_back(queued);
+    m_cancel.emplace_back(false);
+    writeJournal();
+    m_wake.notify_all();
+    return queued.id;
+}
+unsigned int jobScheduler::resume(){
+    QString path;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        path = m_journal;
+    }
+    if(path.isEmpty() || !QFile::exists(path))
+        return 0;
+    QSettings journal(path, QSettings::IniFormat);
+    QVector<processingJob> pending;
+    const int size = journal.beginReadArray("job");
+    for(int i=0;i<size;i++){
+        journal.setArrayIndex(i);
+        const int state = journal.value("state").toInt();
+        //Running when the batch stopped: started again from the beginning
+        if(state != JOB_QUEUED && state != JOB_RUNNING)
+            continue;
+        processingJob job;
+        job.directory = journal.value("directory").toString();
+        job.priority = journal.value("priority").toInt();
+        job.frames = journal.value("frames").toUInt();
+        job.width = journal.value("width").toInt();
+        job.height = journal.value("height").toInt();
+        job.freq = journal.value("freq").toInt();
+        job.fps = journal.value("fps").toUInt();
+        pending.push_back(job);
+    }
+    journal.endArray();
+    for(const processingJob& job : pending)
+        submit(job);
+    return pending.size();
+}
+void jobScheduler::start(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = false;
+    //Workers of a batch that already ended
+    if(m_active == 0){
+        for(std::thread& worker : m_workers)
+            if(worker.joinable())
+                worker.join();
+        m_workers.clear();
+    }
+    unsigned int workers = m_concurrency ? m_concurrency : std::max(1u, std::thread::hardware_concurrency());
+    for(unsigned int i=m_workers.size();i<workers;i++)
+        m_workers.push_back(std::thread(&jobScheduler::work, this));
+}
+bool jobScheduler::cancel(unsigned int id){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(int i=0;i<m_jobs.size();i++){
+        if(m_jobs[i].id != id)
+            continue;
+        if(m_jobs[i].state == JOB_QUEUED){
+            m_jobs[i].state = JOB_CANCELLED;
+            writeJournal();
+            m_wake.notify_all();
+            return true;
+        }
+        if(m_jobs[i].state == JOB_RUNNING){
+            m_cancel[i] = true;     //The worker writes the state when the runner returns
+            return true;
+        }
+        return false;
+    }
+    return false;
+}
+void jobScheduler::stop(){
+    std::vector<std::thread> workers;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        for(std::atomic<bool>& flag : m_cancel)
+            flag = true;
+        workers.swap(m_workers);
+    }
+    m_wake.notify_all();
+    for(std::thread& worker : workers)
+        if(worker.joinable())
+            worker.join();
+}
+bool jobScheduler::isRunning() const{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_active > 0 || (!m_workers.empty() && next() >= 0);
+}
+QVector<processingJob> jobScheduler::jobs() const{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_jobs;
+}
+double jobScheduler::totalProgress() const{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return progressLocked();
+}
+double jobScheduler::progressLocked() const{
+    //Frames weight the jobs; cancelled ones do not count
+    double done = 0, total = 0;
+    for(const processingJob& job : m_jobs){
+        if(job.state == JOB_CANCELLED)
+            continue;
+        const double weight = job.frames ? job.frames : 1;
+        total += weight;
+        done += weight*(job.state == JOB_DONE || job.state == JOB_FAILED ? 100.0 : job.progress);
+    }
+    return total > 0 ? done/total : 0;
+}
+int jobScheduler::next() const{
+    //Lowest priority first (calibrations), then order of arrival. Tests need the d1 file of
+    //the calibration: none of them runs while a calibration is queued or running
+    int best = -1;
+    bool calibrating = false;
+    for(int i=0;i<m_jobs.size();i++){
+        if(m_jobs[i].priority == JOB_PRIORITY_CALIBRATION && (m_jobs[i].state == JOB_QUEUED || m_jobs[i].state == JOB_RUNNING))
+            calibrating = true;
+        if(m_jobs[i].state != JOB_QUEUED)
+            continue;
+        if(best < 0 || m_jobs[i].priority < m_jobs[best].priority)
+            best = i;
+    }
+    if(best >= 0 && calibrating && m_jobs[best].priority == JOB_PRIORITY_TEST)
+        return -1;
+    return best;
+}
+void jobScheduler::work(){
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(!m_stopping){
+        int index = next();
+        if(index < 0){
+            //Nothing to start: wait while other jobs run (a calibration holding the tests back,
+            //or jobs that may still be joined by new ones)
+            if(m_active == 0)
+                break;
+            m_wake.wait(lock);
+            continue;
+        }
+        processingJob job = m_jobs[index];
+        m_jobs[index].state = JOB_RUNNING;
+        m_cancel[index] = false;
+        std::atomic<bool>& cancelled = m_cancel[index];
+        jobRunner runner = m_runner;
+        m_active++;
+        writeJournal();
+        lock.unlock();
+        qDebug()<<Q_FUNC_INFO<<" job "<<job.id<<": "<<job.directory;
+        const unsigned int id = job.id;
+        bool done = runner(job, [this, id](double percent){report(id, percent);}, cancelled);
+        finish(id, done ? JOB_DONE : (cancelled ? JOB_CANCELLED : JOB_FAILED));
+        lock.lock();
+        m_active--;
+        m_wake.notify_all();
+    }
+    if(m_active == 0 && next() < 0 && !m_stopping && !m_journal.isEmpty()){
+        //Batch over: nothing left to resume
+        QFile::remove(m_journal);
+    }
+}
+void jobScheduler::report(unsigned int id, double percent){
+    processingJob job;
+    double total;
+    batchProgress callback;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        int i = 0;
+        while(i < m_jobs.size() && m_jobs[i].id != id)
+            i++;
+        if(i == m_jobs.size())
+            return;
+        m_jobs[i].progress = std::min(100.0, std::max(0.0, percent));
+        job = m_jobs[i];
+        total = progressLocked();
+        callback = m_progress;
+    }
+    if(callback)
+        callback(job, total);
+}
+void jobScheduler::finish(unsigned int id, jobState state){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        //Stopped by stop(), not by the user: queued in the journal for resume()
+        if(state == JOB_CANCELLED && m_stopping)
+            state = JOB_QUEUED;
+        for(processingJob& job : m_jobs){
+            if(job.id == id){
+                job.state = state;
+                if(state == JOB_DONE)
+                    job.progress = 100;
+            }
+        }
+        writeJournal();
+    }
+    report(id, state == JOB_DONE ? 100 : 0);
+}
+void jobScheduler::writeJournal() const{
+    if(m_journal.isEmpty())
+        return;
+    QSettings journal(m_journal, QSettings::IniFormat);
+    journal.clear();
+    journal.beginWriteArray("job", m_jobs.size());
+    for(int i=0;i<m_jobs.size();i++){
+        const processingJob& job = m_jobs.at(i);
+        journal.setArrayIndex(i);
+        journal.setValue("directory", job.directory);
+        journal.setValue("priority", job.priority);
+        journal.setValue("frames", job.frames);
+        journal.setValue("width", job.width);
+        journal.setValue("height", job.height);
+        journal.setValue("freq", job.freq);
+        journal.setValue("fps", job.fps);
+        journal.setValue("state", (int)job.state);
+    }
+    journal.endArray();
+    journal.sync();
+}
+bool jobScheduler::runDetector(const processingJob& job, const jobProgress& progress, const std::atomic<bool>& cancel){
+    //GUI signals are broadcast: detectors sharing the session bus would all process the same
+    //directory. Each job gets its own dbus-daemon, where this thread plays the GUI.
+    QProcess bus;
+    bus.start("dbus-daemon", QStringList() << "--session" << "--nofork" << "--nopidfile" << "--print-address=1");
+    if(!bus.waitForStarted(JOB_START_MS) || !bus.waitForReadyRead(JOB_START_MS)){
+        qDebug()<<Q_FUNC_INFO<<" ERROR 01: jobScheduler - dbus-daemon did not start";
+        bus.kill();
+        bus.waitForFinished();
+        return false;
+    }
+    const QString address = QString::fromLatin1(bus.readLine()).trimmed();
+    const QString name = QString("oscann-job-%1").arg(job.id);
+    bool done = false;
+    {
+        QDBusConnection connection = QDBusConnection::connectToBus(address, name);
+        //The detector only listens to the signals of this name
+        if(connection.isConnected() && connection.registerService("org.oscann.gui")){
+            QEventLoop loop;
+            QProcess detector;
+            aura::DetectorInterface detectorIface("aura.oscann.pupil", "/Detector", connection);
+            //Same exchange as processReady() and killbgPupilDetector()
+            QObject::connect(&detectorIface, &aura::DetectorInterface::ready, [&](){
+                QDBusMessage process = QDBusMessage::createSignal("/gui", "aura.GUIInterface", "processDBus");
+                process << job.directory << job.freq << job.width << job.height << job.frames;
+                connection.send(process);
+            });
+            QObject::connect(&detectorIface, &aura::DetectorInterface::progressDBus, [&](double percent, double totalPercent){
+                Q_UNUSED(totalPercent);
+                progress(percent);
+                if(percent >= 100){
+                    done = true;
+                    loop.quit();
+                }
+            });
+            QObject::connect(&detector, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished), &loop, &QEventLoop::quit);
+            QTimer poll;
+            QObject::connect(&poll, &QTimer::timeout, [&](){
+                if(cancel)
+                    loop.quit();
+            });
+            poll.start(JOB_POLL_MS);
+            QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+            environment.insert("DBUS_SESSION_BUS_ADDRESS", address);
+            detector.setProcessEnvironment(environment);
+            detector.start("./bgPupilDetection", QStringList() << QString::number(job.fps));
+            if(detector.waitForStarted(JOB_START_MS))
+                loop.exec();
+            else
+                qDebug()<<Q_FUNC_INFO<<" ERROR 02: jobScheduler - bgPupilDetection did not start";
+            poll.stop();
+            if(detector.state() != QProcess::NotRunning){
+                QDBusMessage shutdown = QDBusMessage::createSignal("/gui", "aura.GUIInterface", "shutdownDBus");
+                shutdown << 2u;
+                connection.send(shutdown);
+                if(!detector.waitForFinished(JOB_STOP_MS)){
+                    detector.kill();
+                    detector.waitForFinished();
+                }
+            }
+        }else{
+            qDebug()<<Q_FUNC_INFO<<" ERROR 03: jobScheduler - private bus not available: "<<address;
+        }
+    }
+    QDBusConnection::disconnectFromBus(name);
+    bus.terminate();
+    if(!bus.waitForFinished(JOB_STOP_MS)){
+        bus.kill();
+        bus.waitForFinished();
+    }
+    return done && !cancel;
+}
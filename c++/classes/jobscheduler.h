@@ -0,0 +1,95 @@
+#ifndef JOBSCHEDULER_H
+#define JOBSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <QString>
+#include <QVector>
+
+/* Offline processing of the test queue, several tests at a time.
+ * Every job is one test directory. Up to N jobs (default: one per core) run at once, each
+ * on a worker thread; calibrations go before tests, and no test starts while a calibration
+ * is queued or running (processQueue only processes a batch that has one). The default runner starts a bgPupilDetection of its own per job (see
+ * runDetector). Progress is weighted by the frames of every job.
+ * The job list is journaled (QSettings ini) on every state change: a batch interrupted by a
+ * crash or a shutdown is taken up again with resume(), without the jobs already done.*/
+#define JOB_PRIORITY_CALIBRATION    0
+#define JOB_PRIORITY_TEST           1
+
+enum jobState{
+    JOB_QUEUED = 0,
+    JOB_RUNNING = 1,
+    JOB_DONE = 2,
+    JOB_FAILED = 3,
+    JOB_CANCELLED = 4
+};
+struct processingJob{
+    unsigned int id = 0;
+    QString directory;
+    int priority = JOB_PRIORITY_TEST;
+    unsigned int frames = 0;        //From the session index; weight of the job in the progress
+    int width = 0;
+    int height = 0;
+    int freq = -1;                  //processDBus arguments
+    unsigned int fps = 0;
+    jobState state = JOB_QUEUED;
+    double progress = 0;            //0-100
+};
+
+class jobScheduler{
+public:
+    typedef std::function<void(double percent)> jobProgress;
+    //Runs a job to its end: true when done. cancel is raised by cancel()/stop()
+    typedef std::function<bool(const processingJob& job, const jobProgress& progress, const std::atomic<bool>& cancel)> jobRunner;
+    //percent: the job that reported, totalPercent: the batch
+    typedef std::function<void(const processingJob& job, double totalPercent)> batchProgress;
+
+    jobScheduler();
+    ~jobScheduler();
+    //0: std::thread::hardware_concurrency(). Taken at the next start()
+    void setConcurrency(unsigned int jobs);
+    void setRunner(const jobRunner& runner);
+    void setProgressCallback(const batchProgress& callback);
+    void setJournal(const QString& path);
+    unsigned int submit(const processingJob& job);
+    //Jobs of the journal that did not end; they are queued again
+    unsigned int resume();
+    void start();
+    bool cancel(unsigned int id);
+    void stop();                    //Cancels everything but keeps the journal for resume()
+    bool isRunning() const;
+    QVector<processingJob> jobs() const;
+    double totalProgress() const;
+    //bgPupilDetection on a private bus
+    static bool runDetector(const processingJob& job, const jobProgress& progress, const std::atomic<bool>& cancel);
+private:
+    jobScheduler(const jobScheduler&);
+    jobScheduler& operator=(const jobScheduler&);
+    void work();
+    int next() const;
+    void report(unsigned int id, double percent);
+    void finish(unsigned int id, jobState state);
+    void writeJournal() const;
+    double progressLocked() const;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::vector<std::thread> m_workers;
+    QVector<processingJob> m_jobs;
+    std::deque<std::atomic<bool>> m_cancel;     //One per job, same index as m_jobs
+    unsigned int m_concurrency;
+    unsigned int m_nextId;
+    unsigned int m_active;
+    bool m_stopping;
+    jobRunner m_runner;
+    batchProgress m_progress;
+    QString m_journal;
+};
+
+#endif // JOBSCHEDULER_H
@@ -45,8 +45,6 @@ HaarSurroundFeature::HaarSurroundFeature(int r1, int r2) : r_inner(r1), r_outer(
 
 }
 
-cv::Size2f OTracker::m_lastEllipse;
-
 float OTracker::calcBlurriness(const cv::Mat &frame){
     cv::Mat dst;
     cv::Laplacian(frame, dst, CV_64F);
@@ -95,14 +93,23 @@ OTracker::OTracker() :  m_cannyThreshold1(30),
         params.EarlyTerminationPercentage = 95;
         params.EarlyRejection = true;
         params.Seed = -1;
+        params.FastPath = true;
+        params.FastPathCircularity = 0.90;
+        params.FastPathSamples = 24;
+        params.FastPathAgreement = 85;
+        params.AdaptiveThresholds = true;
+        params.HistogramDecay = 0.2;
+        params.AdaptiveRange = 0.08;
+        params.GlintTracking = true;
+        params.GlintTrackRadius = 8;
+        params.GlintTrackTolerance = 2.0;
+        params.ReferenceHeight = 480;
+        params.PixelScale = 0;
     }
-    double theta = 0.0;
-    for(int i=-48,j=0; i<params.StarburstPoints-48;i++, j++){
-        theta = i * 2*PI/params.StarburstPoints;
-        m_ptoDirs[j] = cv::Point2f((float)std::cos(theta), (float)std::sin(theta));
-        m_starburstPtos[j] = false;
-    }
-    m_vdoImg = cv::Mat(cv::Size(640, 480), CV_8UC3);
+    m_path = PATH_NONE;
+    selectCore(1);
+    m_scale = 1.0;
+    m_sensorHeight = 0;
     //v1.0.8
     m_initialErode = m_erode;
 }
@@ -233,7 +240,12 @@ std::string OTracker::getLastError(){
         try{
             m_pupil.x = -1;
             m_pupil.y = -1;
-            m_vdoImg = img.clone();
+            //Colour frames need no clone: cvtColor in greyAndCrop allocates the grey image. Grey ones
+            //do, the eye roi is blurred in place
+            m_vdoImg = img.channels() == 1 ? img.clone() : img;
+            if(m_vdoImg.channels() != m_channels)
+                selectCore(m_vdoImg.channels());
+            m_scale = params.PixelScale > 0 ? params.PixelScale : (m_sensorHeight > 0 ? m_sensorHeight : m_vdoImg.rows)/params.ReferenceHeight;
             result = find();
         }
         catch(cv::Exception& e){
@@ -295,7 +307,8 @@ void ConicSection_<T>::initFromEllipse(cv::Point_<T> axis, cv::Point_<T> centre,
         + (-2*axis.x*axis.y*centre.x*centre.y + axis.y*axis.y*centre.x*centre.x + axis.x*axis.x*centre.y*centre.y) / b2
         - 1;
 }
-static std::mt19937 static_gen;
+//One generator per thread: RANSAC (TBB) and the binocular trackers draw at the same time
+static thread_local std::mt19937 static_gen;
 int OTracker::random(int min, int max){
     std::uniform_int_distribution<> distribution(min, max);
     return distribution(static_gen);
@@ -394,12 +407,13 @@ void OTracker::getROI(const cv::Mat& src, cv::Mat& dst, const cv::Rect& roi, int
         cv::copyMakeBorder(tmp, dst, top, bottom, left, right, borderType);
     }
 }
-void OTracker::greyAndCrop(){
+template<int Channels>
+void OTracker::greyAndCropT(){
     // Pick one channel if necessary, and crop it to get rid of borders
-    if (m_vdoImg.channels() == 3){
+    if (Channels == 3){
         cv::cvtColor(m_vdoImg, m_vdoImg, cv::COLOR_BGR2GRAY);
     }
-    else if (m_vdoImg.channels() == 4){
+    else if (Channels == 4){
         cv::cvtColor(m_vdoImg, m_vdoImg, cv::COLOR_BGRA2GRAY);
     }
     if(m_userRoi == cv::Rect(0,0,0,0)){
@@ -417,8 +431,94 @@ void OTracker::greyAndCrop(){
     m_eyeFocus = m_eye.clone();
 }
 
+// ---------------------------------------------------------------------------
+// Per frame thresholds. The histogram of m_eyeSmall is blended into a running
+// one and clustered in pupil, iris/skin and glint modes. The k-means starts from
+// the previous centres, so it usually converges in one or two iterations.
+// Bins are fractions of the roi, so the roi following the pupil from frame to
+// frame keeps the statistics; they are reset when the pupil is lost (find()).
+// Thresholds stay within AdaptiveRange of the values given to measure().
+// ---------------------------------------------------------------------------
+void OTracker::adaptiveThresholds(){
+    if(!params.AdaptiveThresholds || m_eyeSmall.empty())
+        return;
+    cv::Mat_<float> hist = cv::Mat_<float>::zeros(256, 1);
+    for(int y=0;y<m_eyeSmall.rows;y++){
+        const uchar* row = m_eyeSmall.ptr<uchar>(y);
+        for(int x=0;x<m_eyeSmall.cols;x++)
+            hist(row[x])++;
+    }
+    hist /= (float)m_eyeSmall.total();
+    if(m_hist.empty()){
+        m_hist = hist;
+        m_histCentres[0] = 255*m_baseThresholdImg/2;
+        m_histCentres[1] = 255*(m_baseThresholdImg + m_baseThresholdGlints)/2;
+        m_histCentres[2] = 255*(m_baseThresholdGlints + 1)/2;
+    }else{
+        m_hist = (1 - params.HistogramDecay)*m_hist + params.HistogramDecay*hist;
+    }
+    cv::Mat_<uchar> labels;
+    histKmeans(m_hist, 0, 256, 3, m_histCentres, labels, cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 10, 0.5));
+    m_thresholdImg = constrain<float>((m_histCentres[0] + m_histCentres[1])/2/255,
+                                      m_baseThresholdImg - params.AdaptiveRange,
+                                      m_baseThresholdImg + params.AdaptiveRange);
+    m_thresholdGlints = constrain<float>((m_histCentres[1] + m_histCentres[2])/2/255,
+                                         m_baseThresholdGlints - params.AdaptiveRange,
+                                         std::min(0.98, m_baseThresholdGlints + params.AdaptiveRange));
+}
+// ---------------------------------------------------------------------------
+// Weighted 1D k-means over the bins [bin_min, bin_max) of a histogram.
+// init_centres (K values) is used as the starting point and receives the final
+// centres sorted from dark to bright. labels gets the cluster of every bin.
+// Returns the compactness: sum of weight*distance^2 to the closest centre.
+// ---------------------------------------------------------------------------
+float OTracker::histKmeans(const cv::Mat_<float>& hist, int bin_min, int bin_max, int K, float init_centres[], cv::Mat_<uchar>& labels, cv::TermCriteria termCriteria){
+    labels = cv::Mat_<uchar>::zeros(hist.rows, 1);
+    std::vector<double> sum(K), weight(K);
+    double compactness = 0;
+    std::sort(init_centres, init_centres + K);
+    for(int iter=0;;iter++){
+        std::fill(sum.begin(), sum.end(), 0.0);
+        std::fill(weight.begin(), weight.end(), 0.0);
+        compactness = 0;
+        for(int b=bin_min;b<bin_max;b++){
+            int best = 0;
+            float d, bestD = std::abs(b - init_centres[0]);
+            for(int k=1;k<K;k++){
+                d = std::abs(b - init_centres[k]);
+                if(d < bestD){
+                    bestD = d;
+                    best = k;
+                }
+            }
+            labels(b) = best;
+            const float w = hist(b);
+            sum[best] += w*b;
+            weight[best] += w;
+            compactness += w*bestD*bestD;
+        }
+        double shift = 0;
+        for(int k=0;k<K;k++){
+            if(weight[k] <= 0)
+                continue;           //Empty cluster keeps its centre
+            float c = sum[k]/weight[k];
+            shift = std::max(shift, (double)std::abs(c - init_centres[k]));
+            init_centres[k] = c;
+        }
+        std::sort(init_centres, init_centres + K);
+        if(!(termCriteria.type & (cv::TermCriteria::COUNT | cv::TermCriteria::EPS))
+                || ((termCriteria.type & cv::TermCriteria::COUNT) && iter+1 >= termCriteria.maxCount)
+                || ((termCriteria.type & cv::TermCriteria::EPS) && shift <= termCriteria.epsilon))
+            break;
+    }
+    return compactness;
+}
 
 cv::Rect OTracker::roiFromRectangle(cv::Rect rectangle, int maxWidth, int maxHeight){
+    if(maxWidth <= 0)
+        maxWidth = m_vdoImg.cols;
+    if(maxHeight <= 0)
+        maxHeight = m_vdoImg.rows;
     if(rectangle.x < 0)
         rectangle.x = 0;
     if(rectangle.y < 0)
@@ -430,12 +530,117 @@ cv::Rect OTracker::roiFromRectangle(cv::Rect rectangle, int maxWidth, int maxHei
     return rectangle;
 }
 
+// ---------------------------------------------------------------------------
+// One pass 8-connected labelling. Provisional labels are merged with union-find
+// while the statistics of each label are accumulated. Only two label rows are kept.
+// ---------------------------------------------------------------------------
+void OTracker::labelBlobs(const cv::Mat_<uchar>& binary, std::vector<BlobStats>& blobs){
+    blobs.clear();
+    std::vector<int> parent(1, 0);
+    std::vector<BlobStats> acc(1);
+    std::vector<cv::Point> tl(1), br(1);
+    std::vector<int> prevRow(binary.cols+2, 0), currRow(binary.cols+2, 0);
+    auto root = [&parent](int l){
+        while(parent[l] != l){
+            parent[l] = parent[parent[l]];
+            l = parent[l];
+        }
+        return l;
+    };
+    auto join = [&parent, &root](int a, int b){
+        a = root(a);
+        b = root(b);
+        if(a < b)       parent[b] = a;
+        else if(b < a)  parent[a] = b;
+        return std::min(a, b);
+    };
+    for(int y = 0; y < binary.rows; y++){
+        const uchar* row = binary[y];
+        const uchar* up = y > 0 ? binary[y-1] : NULL;
+        const uchar* down = y < binary.rows-1 ? binary[y+1] : NULL;
+        for(int x = 0; x < binary.cols; x++){
+            currRow[x+1] = 0;
+            if(row[x] == 0)
+                continue;
+            //Neighbours already visited: W, NW, N, NE (the rows are padded by one on each side)
+            int l = 0;
+            const int n[4] = {currRow[x], prevRow[x], prevRow[x+1], prevRow[x+2]};
+            for(int k = 0; k < 4; k++){
+                if(n[k] == 0)
+                    continue;
+                l = l == 0 ? root(n[k]) : join(l, n[k]);
+            }
+            if(l == 0){
+                l = parent.size();
+                parent.push_back(l);
+                acc.push_back(BlobStats());
+                tl.push_back(cv::Point(x, y));
+                br.push_back(cv::Point(x, y));
+            }
+            currRow[x+1] = l;
+            BlobStats& b = acc[l];
+            b.m00 += 1;
+            b.m10 += x;
+            b.m01 += y;
+            b.m20 += (double)x*x;
+            b.m11 += (double)x*y;
+            b.m02 += (double)y*y;
+            int cracks = (x == 0 || row[x-1] == 0)
+                       + (x == binary.cols-1 || row[x+1] == 0)
+                       + (up == NULL || up[x] == 0)
+                       + (down == NULL || down[x] == 0);
+            b.crack += cracks;
+            b.boundary += cracks > 0;
+            tl[l] = cv::Point(std::min(tl[l].x, x), std::min(tl[l].y, y));
+            br[l] = cv::Point(std::max(br[l].x, x), std::max(br[l].y, y));
+        }
+        std::swap(prevRow, currRow);
+    }
+    //Fold every provisional label into its root
+    for(unsigned int l = 1; l < parent.size(); l++){
+        int r = root(l);
+        if(r != (int)l){
+            BlobStats& a = acc[r];
+            const BlobStats& b = acc[l];
+            a.m00 += b.m00; a.m10 += b.m10; a.m01 += b.m01;
+            a.m20 += b.m20; a.m11 += b.m11; a.m02 += b.m02;
+            a.crack += b.crack;
+            a.boundary += b.boundary;
+            tl[r] = cv::Point(std::min(tl[r].x, tl[l].x), std::min(tl[r].y, tl[l].y));
+            br[r] = cv::Point(std::max(br[r].x, br[l].x), std::max(br[r].y, br[l].y));
+        }
+    }
+    for(unsigned int l = 1; l < parent.size(); l++){
+        if(parent[l] != (int)l)
+            continue;
+        acc[l].bbox = cv::Rect(tl[l], br[l] + cv::Point(1,1));
+        blobs.push_back(acc[l]);
+    }
+}
+// ---------------------------------------------------------------------------
+// Ellipse with the same second order moments as the region. For a filled ellipse
+// the variance along an axis is (semi axis)^2/4, so the full axis is 4*sqrt(lambda)
+// ---------------------------------------------------------------------------
+cv::RotatedRect OTracker::fitEllipse(const cv::Moments& m){
+    if(m.m00 <= 0)
+        return cv::RotatedRect(cv::Point2f(UNKNOWN_POSITION), cv::Size2f(0,0), 0);
+    double a = m.mu20/m.m00;
+    double b = m.mu11/m.m00;
+    double c = m.mu02/m.m00;
+    double common = std::sqrt((a-c)*(a-c) + 4*b*b);
+    double l1 = (a + c + common)/2;
+    double l2 = std::max(0.0, (a + c - common)/2);
+    double angle = 0.5*std::atan2(2*b, a-c)*180.0/PI;
+    if(angle < 0)
+        angle += 180.0;
+    return cv::RotatedRect(cv::Point2f(m.m10/m.m00, m.m01/m.m00),
+                           cv::Size2f(4*std::sqrt(l1), 4*std::sqrt(l2)),
+                           angle);
+}
 
 void OTracker::thresholding(){
     cv::Mat_<uchar> mEyeThresh;
     cv::Mat mPreThres;
-    std::vector<std::vector<cv::Point> > contours;
-    std::vector<cv::Vec4i> hierarchy;
     cv::Mat element;
     cv::medianBlur(m_eyeSmall,mPreThres,m_blurImg); //Como nos interesa solo saber aprox donde esta la pupila podemos hacer un filtrado muy agresivo
     //TODOCOMPARE: cv::GaussianBlur(m_eyeSmall,mPreThres,cv::Size(17,17),0.0, 0.0);   //0.0+++++, 1.0---, 2.0----
@@ -457,26 +662,26 @@ void OTracker::thresholding(){
     m_haarRadius=-1;
     //https://riptutorial.com/opencv/example/22518/circular-blob-detection
     //Aqui somos estrictos, si encontramos un blob del tamaño adecuado y muy circular nos saltamos el haar (Que es uno de los puntos lentos del algoritmo)
-    cv::findContours(m_morphImg.clone(),contours,hierarchy,cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
+    std::vector<BlobStats> blobs;
+    labelBlobs(m_morphImg, blobs);
     m_found=false;
-    if(contours.size() > 0){
+    if(blobs.size() > 0){
         float areaMax=900,circMax=1, circularity;
         double scoreCirc, score, scoreArea, area, maxScore=0;
-        for(unsigned int i=0;i<contours.size();i++){
-            area=cv::contourArea(contours[i]);
+        for(unsigned int i=0;i<blobs.size();i++){
+            area=blobs[i].area();
             if(area<1000&&area>150){ //FIXED VALUES
                 scoreArea=area/areaMax; //Normalizar area
                 if(scoreArea>1) scoreArea=1; //Este limite es importante para que un area muy grande no tenga ventaja
                 //v1.0.10:circularity=(4*PI*area)/pow(arcLength(contours[i],true),2);
-                double arclength = arcLength(contours[i],true);
-                circularity=4*CV_PI*area/(arclength*arclength);
+                circularity=blobs[i].circularity();
                 if(circularity>0.80){
                     scoreCirc=circularity/circMax; //Normalizar circularidad
                     if(scoreCirc>1) scoreCirc=1;
                     score=scoreCirc+scoreArea;
                     if (score > maxScore){ //Si tiene una puntacion mayor guardar
                         maxScore=score;
-                        m_bestContour = contours[i];
+                        m_bestBlob = blobs[i];
                         if(m_found==false){
                             m_found=true;
                         }
@@ -616,25 +821,19 @@ int OTracker::pupilRegion(){
         // ---------------------------------------------
         // Find best region in the segmented pupil image
         // ---------------------------------------------
-        std::vector<std::vector<cv::Point> > contours;
-        std::vector<cv::Vec4i> hierarchy;
-        cv::findContours(morphImgHaar.clone(),          //Source, an 8-bit single-channel image
-                         contours,                      //Detected contours.
-                         hierarchy,
-                         cv::RETR_LIST,                 //retrieves only the extreme outer contours. cv::RETR_EXTERNAL
-                         cv::CHAIN_APPROX_NONE          //stores absolutely all the contour points.
-                         );
-        if (contours.size() == 0){
+        std::vector<BlobStats> blobs;
+        labelBlobs(morphImgHaar, blobs);
+        if (blobs.size() == 0){
             m_errorMsg = "ERROR 01: pupilRegion - No contours found";
             return m_errno = -1;
         }
-        m_bestContour = contours[0];
-        if(contours.size()>1){
+        m_bestBlob = blobs[0];
+        if(blobs.size()>1){
             double maxScore=0;
             float areaMax=7000/8,circMax=0.9; //Se usan para normalizar los valores de area y circularidad FIXED VALUES (Eso lo pongo para poder luego buscar por el codigo que está fijo)
-            BOOST_FOREACH(std::vector<cv::Point>& c, contours){
-                double area = cv::contourArea(c);
-                float circularity=(4*PI*area)/(arcLength(c,true)*arcLength(c,true));
+            BOOST_FOREACH(const BlobStats& b, blobs){
+                double area = b.area();
+                float circularity=b.circularity();
                 double scoreArea=area/areaMax; //Normalizar area
                 if(scoreArea>1){
                     scoreArea=1; //Este limite es importante para que un area muy grande no tenga ventaja
@@ -647,19 +846,19 @@ int OTracker::pupilRegion(){
                 if (score > maxScore) //Si tiene una puntacion mayor guardar
                 {
                     maxScore=score;
-                    m_bestContour = c;
+                    m_bestBlob = b;
                 }
             }
         }
         incX=roiHaarPupil.x;
         incY=roiHaarPupil.y;
-        if(m_bestContour.size()<5){
+        if(m_bestBlob.boundary<5){
             m_errorMsg = "ERROR 02: pupilRegion - There are contours but they are not appropiate";
             return m_errno = -2;
         }
     }
-    m_elPupilThresh = cv::fitEllipse(cv::Mat(m_bestContour));
-    bbPupilThresh = cv::boundingRect(m_bestContour);       //boundingRect: Calculates the up-right bounding rectangle of a point set.
+    m_elPupilThresh = fitEllipse(m_bestBlob.moments());
+    bbPupilThresh = m_bestBlob.bbox;
     // Shift best region into eye coords (instead of pupil region coords), and get ROI
     bbPupilThresh.x += incX;
     bbPupilThresh.y += incY;
@@ -832,6 +1031,10 @@ int OTracker::glintsDetection(){
     m_glintsCentroides.clear();
     m_glintsContours.clear();
     m_possibleGlints.clear();
+    if(trackGlints()){
+        m_stats.glintTracked++;
+        return 0;
+    }
     /*        Eye         m_bestcontour   m_elPupilThres    bbPupilTresh
      *  --------------   --------------   --------------   --------------   --------------
      *       ,-""-.
@@ -848,23 +1051,25 @@ int OTracker::glintsDetection(){
         //60 ->   60/100   0.6, 60/10: 6 , 132-60:  72/100: 0.72, 132-30:102/100:1.02
         //1.5 to 2.15  H12O/epilepsia/4608696/CC9-05122017-103256
         //v1.0.9: From 2.15 to 4.0 for Santander -> DFT -> CC9-04182018-125852
-        if(m_elPupilThresh.size.width < 132.0 && m_elPupilThresh.size.width > 25.0)
+        //Constants tuned at 480 lines: lengths scale with px(), the 6750 and 2500 terms (px*px/px) with px()^2
+        const double maxSize = px(132.0), minSize = px(25.0);
+        if(m_elPupilThresh.size.width < maxSize && m_elPupilThresh.size.width > minSize)
             //NORMAL: 2.15
             //v1.0.9: w =m_elPupilThresh.size.width*(((132-m_elPupilThresh.size.width)/100)+2.15);
             //Santander -> DFT -> 01046 -> CC9-03232018-130106 : from 4750 to 6750
-            w =m_elPupilThresh.size.width + (6750*(1/m_elPupilThresh.size.width));
+            w =m_elPupilThresh.size.width + (px(px(6750))*(1/m_elPupilThresh.size.width));
         else
-            w = 132;
+            w = maxSize;
 
-        if(m_elPupilThresh.size.height < 132.0 && m_elPupilThresh.size.width > 25.0)
+        if(m_elPupilThresh.size.height < maxSize && m_elPupilThresh.size.width > minSize)
             //NORMAL: 1.15
             //¿1.15 to 1.0?  H12O -> epilepsia -> 4608696 -> CC9-05122017-103256
             //v1.0.9: From 1.15 to 1.5 for Santander -> DFT -> CC9-04182018-125852
             //v1.0.9: h = m_elPupilThresh.size.height*(((132-m_elPupilThresh.size.height)/100)+1.15);
-            h = m_elPupilThresh.size.height+(2500*(1/m_elPupilThresh.size.height));
+            h = m_elPupilThresh.size.height+(px(px(2500))*(1/m_elPupilThresh.size.height));
         else
-            h = 132;
-        m_roiGlintsLarge = cv::Rect(roiFromRectangle(cv::Rect(m_elPupilThresh.center.x - (w/2),m_elPupilThresh.center.y - 32.0,w,h)));
+            h = maxSize;
+        m_roiGlintsLarge = cv::Rect(roiFromRectangle(cv::Rect(m_elPupilThresh.center.x - (w/2),m_elPupilThresh.center.y - px(32.0),w,h)));
         if(m_userRoi != cv::Rect(0,0,0,0))
             getROI(m_vdoImg, m_PupilLarge, roiFromRectangle(cv::Rect(m_roiGlintsLarge.x+m_userRoi.x,m_roiGlintsLarge.y+m_userRoi.y,m_roiGlintsLarge.width,m_roiGlintsLarge.height),m_vdoImg.cols, m_vdoImg.rows) , cv::BORDER_REPLICATE);
         else
@@ -1020,12 +1225,7 @@ int OTracker::glintsDetection(){
         m_errorMsg = "ERROR 03: Glints not deteced";
         return m_errno = -3;
     }
-    cv::Mat mPupil;
     cv::Rect r;
-    if(m_userRoi == cv::Rect(0,0,0,0))
-        getROI(m_eye, mPupil, m_roiPadded, cv::BORDER_REPLICATE);
-    else
-        mPupil = m_eye.clone();
     m_glintPaired.clear();
     for(unsigned int i=0;i<m_possibleGlints.size();i++){
         m_glintPaired.push_back(false);
@@ -1042,6 +1242,94 @@ int OTracker::glintsDetection(){
             //SMALL:m_glintsRect.push_back(cv::Rect(r.x-1+(m_lastGlintsTL.x-m_userRoi.x),r.y-1+(m_lastGlintsTL.y-m_userRoi.y),r.width+2,r.height+2) );
         }
     }
+    element.release();
+    return 0;
+}
+// ------------------------------------------------------------------------------
+// Glints move a few pixels between frames. Each one is looked for in a small window
+// around its last position (threshold and intensity weighted centroid), and the
+// pair is accepted if the vector between them barely changes. Otherwise
+// glintsDetection goes on with the segmentation search.
+// ------------------------------------------------------------------------------
+bool OTracker::trackGlints(){
+    if(!params.GlintTracking || (m_lastGlintsTL == cv::Point(0,0) && m_lastGlintsBR == cv::Point(0,0)))
+        return false;
+    const int r = params.GlintTrackRadius;
+    const int thr = 255*m_thresholdGlints;
+    const cv::Point2f last[2] = {cv::Point2f(m_leftGlint), cv::Point2f(m_rightGlint)};
+    cv::Point2f found[2];
+    cv::Rect box[2];
+    double contrast = 1.0;
+    bool diverged = false;
+    for(int g=0;g<2 && !diverged;g++){
+        cv::Rect win = cv::Rect(cvRound(last[g].x)-r, cvRound(last[g].y)-r, 2*r+1, 2*r+1) & cv::Rect(0, 0, m_vdoImg.cols, m_vdoImg.rows);
+        if(win.width < 2*r+1 || win.height < 2*r+1){
+            diverged = true;
+            break;
+        }
+        double sw = 0, sx = 0, sy = 0;
+        int n = 0, peak = 0;
+        cv::Point tl(win.br()), br(win.tl());
+        for(int y=win.y;y<win.y+win.height && !diverged;y++){
+            const uchar* row = m_vdoImg.ptr<uchar>(y);
+            for(int x=win.x;x<win.x+win.width;x++){
+                int v = row[x];
+                if(v <= thr)
+                    continue;
+                //Bright pixels on the border: the glint left the window or it is a bigger reflection
+                if(x == win.x || y == win.y || x == win.x+win.width-1 || y == win.y+win.height-1){
+                    diverged = true;
+                    break;
+                }
+                sw += v - thr;
+                sx += (v - thr)*x;
+                sy += (v - thr)*y;
+                n++;
+                peak = std::max(peak, v);
+                tl = cv::Point(std::min(tl.x, x), std::min(tl.y, y));
+                br = cv::Point(std::max(br.x, x), std::max(br.y, y));
+            }
+        }
+        //Same area limit as getValidContours
+        if(diverged || n == 0 || n >= 300){
+            diverged = true;
+            break;
+        }
+        found[g] = cv::Point2f(sx/sw, sy/sw);
+        box[g] = cv::Rect(tl, br + cv::Point(1,1));
+        contrast = std::min(contrast, (peak - thr)/(double)(255 - thr));
+    }
+    double change = 0;
+    if(!diverged){
+        cv::Point2f sep = found[1] - found[0];
+        change = cv::norm(sep - (last[1] - last[0]));
+        diverged = sep.x <= 0 || std::abs(sep.y) >= m_glintsDistance || change > params.GlintTrackTolerance;
+    }
+    if(diverged){
+        m_stats.glintConfidence = 0;
+        m_stats.glintFallback++;
+        return false;
+    }
+    m_stats.glintConfidence = contrast*(1 - change/params.GlintTrackTolerance);
+    //Same coordinates that the segmentation search leaves in tracking mode:
+    //centroids relative to m_lastGlintsTL and rects relative to mPupil
+    m_roiGlintsLarge = cv::Rect(-1,-1,-1,-1);
+    m_glintPaired.assign(2, false);
+    for(int g=0;g<2;g++){
+        m_glintsCentroides.push_back(found[g] - cv::Point2f(m_lastGlintsTL));
+        m_glintsRect.push_back(cv::Rect(box[g].x-m_glintPadding-m_userRoi.x,box[g].y-m_glintPadding-m_userRoi.y,box[g].width+m_glintPadding*2,box[g].height+m_glintPadding*2));
+    }
+    return true;
+}
+// ----------------------------------------------------------
+// Blurred pupil region, gradients and edges used by starburst
+// ----------------------------------------------------------
+void OTracker::pupilEdges(){
+    cv::Mat mPupil;
+    if(m_userRoi == cv::Rect(0,0,0,0))
+        getROI(m_eye, mPupil, m_roiPadded, cv::BORDER_REPLICATE);
+    else
+        mPupil = m_eye.clone();
     //              AURA94
     //              TSVH-05142018-093555    TSVH-12142017-162513
     //MedianBlur -> 793 and 154             1312.2 and 182.86
@@ -1076,178 +1364,256 @@ int OTracker::glintsDetection(){
     }
 #endif
     m_bbPupil = boundingBox(mPupil);
-    element.release();
-    return 0;
 }
 
-int OTracker::starburst(){
-    std::vector<double> distances;
-    std::vector<cv::Point2f> centres;
-    std::vector<cv::Point2f> points_48;
-    std::vector<cv::Point2f> points_16;
-
-    if (params.StarburstPoints > 0){
-        //CRITICAL: <cv::Point3f> edgePointsConcurrent;
-        std::array<cv::Point3f, 64> edgePointsConcurrent;
-        //????? ¿What is the rationale of m_roiPupil?
-        if(m_userRoi == cv::Rect(0,0,0,0))
-            centres.push_back(m_elPupilThresh.center - cv::Point2f(m_roiPupil.tl().x, m_roiPupil.tl().y));
-        else
-            centres.push_back(m_elPupilThresh.center);
-        m_edgePoints.clear();
-        BOOST_FOREACH(const cv::Point2f& centre, centres) {
-            tbb::parallel_for(size_t(0), size_t(m_ptoDirs.size()),[&] (size_t index){
-                int t = 1;
-                //cv::Point p = centre + (t * pDir);
-                cv::Point p = centre + (t * m_ptoDirs[index]);
-                float dx, dy, cdirx, cdiry;
-                double dirCheck;
-                double distance;
-                uchar val;
-                bool insideSomeGlint = false;
-                m_starburstPtos[index] = false;
-                while(p.inside(m_bbPupil)){
-                    if(index==20)
-                        points_48.push_back(p);
-                    if(index==45)
-                        points_16.push_back(p);
-                    for(unsigned int isg=0;isg<m_glintsRect.size();isg++){
-                        insideSomeGlint = false;
-                        if(p.inside(m_glintsRect[isg])){
-                            insideSomeGlint = true;
-                            break;
-                        }
-                    }
-                    if(!insideSomeGlint){
-                        val = m_PupilEdges(p);
-                        if (val > 0){
-                            dx = m_PupilSobelX(p);
-                            dy = m_PupilSobelY(p);
-                            cdirx = p.x - (m_elPupilThresh.center.x - m_roiPupil.x);
-                            cdiry = p.y - (m_elPupilThresh.center.y - m_roiPupil.y);
-                            // Check edge direction
-                            dirCheck = dx*cdirx + dy*cdiry;
-                            if (dirCheck > 0 ){
-                                // We've hit an edge
-                                p.x +=0.5f;
-                                p.y += 0.5f;
-                                distance = sqrt(pow(centre.x-p.x,2)+pow(centre.y-p.y,2));
-                                //CRITICAL:edgePointsConcurrent.push_back(cv::Point3f(p.x, p.y, distance));
-                                edgePointsConcurrent[index] = cv::Point3f(p.x, p.y, distance);
-                                m_starburstPtos[index] = true;
-                                break;
-                            }
-                        }
-                    }
-                    ++t;
-                    p = centre + (t * m_ptoDirs[index]);
-                }
-            });
+// ------------------------------------------------------------------------------
+// Fast path for calm fixation: when the threshold blob is clearly a pupil its
+// moment ellipse is already close to the border. Each sample is moved along the
+// normal to the strongest dark-to-bright step within 4 px, and the ellipse is
+// refitted on them. Starburst and RANSAC are skipped only when enough samples
+// agree with the image gradient; otherwise the frame takes the full path.
+// ------------------------------------------------------------------------------
+bool OTracker::fastPath(cv::RotatedRect& elPupil, std::size_t& support){
+    if(!params.FastPath || !m_found || m_bestBlob.circularity() < params.FastPathCircularity)
+        return false;
+    const int searchRadius = 4;
+    const int minStep = 6;              //Grey levels between pupil and iris
+    cv::RotatedRect el = m_elPupilThresh;
+    if(el.size.width <= 0 || el.size.height <= 0)
+        return false;
+    const float cs = std::cos(PI/180.0*el.angle), sn = std::sin(PI/180.0*el.angle);
+    const float a = el.size.width/2, b = el.size.height/2;
+    std::vector<cv::Point2f> border;
+    border.reserve(params.FastPathSamples);
+    for(int k=0;k<params.FastPathSamples;k++){
+        double theta = k*2*PI/params.FastPathSamples;
+        float ex = a*std::cos(theta), ey = b*std::sin(theta);
+        cv::Point2f p(el.center.x + ex*cs - ey*sn, el.center.y + ex*sn + ey*cs);
+        //Outward normal of the ellipse at p
+        cv::Point2f n(ex/(a*a), ey/(b*b));
+        n = cv::Point2f(n.x*cs - n.y*sn, n.x*sn + n.y*cs);
+        n *= 1.0f/std::sqrt(n.x*n.x + n.y*n.y);
+        int bestStep = minStep;
+        cv::Point2f best(-1,-1);
+        for(int t=-searchRadius;t<=searchRadius;t++){
+            int x = cvRound(p.x + t*n.x), y = cvRound(p.y + t*n.y);
+            int xo = cvRound(p.x + (t+1)*n.x), yo = cvRound(p.y + (t+1)*n.y);
+            int xi = cvRound(p.x + (t-1)*n.x), yi = cvRound(p.y + (t-1)*n.y);
+            if(std::min(std::min(xi,xo),x) < 0 || std::max(std::max(xi,xo),x) >= m_eye.cols
+                    || std::min(std::min(yi,yo),y) < 0 || std::max(std::max(yi,yo),y) >= m_eye.rows)
+                continue;
+            int step = (int)m_eye(yo,xo) - (int)m_eye(yi,xi);
+            if(step > bestStep){
+                bestStep = step;
+                best = cv::Point2f(x, y);
+            }
         }
-        /*libDetection 1.0: Starbust points are sorted around the ellipse that they form.
-                          Before this sort was based on x and y. However, the points do not follow the ellipse way
-                               BEFORE             NOW
+        if(best != cv::Point2f(-1,-1))
+            border.push_back(best);
+    }
+    if(border.size() < 5 || (int)border.size()*100 < params.FastPathAgreement*params.FastPathSamples){
+        m_stats.fastRejected++;
+        return false;
+    }
+    el = cv::fitEllipse(border);
+    if (el.size.height > el.size.width){
+        el.angle = std::fmod(el.angle + 90, 180);
+        std::swap(el.size.height, el.size.width);
+    }
+    //Same limits that RANSAC applies to its candidates
+    cv::Size2f s = el.size;
+    if(cv::norm(el.center - m_elPupilThresh.center) > searchRadius
+            || s.width > px(params.Radius_Max)*2
+            || (s.height < px(params.Radius_Min)*2 && s.width < px(params.Radius_Min)*2)
+            || sqrt(1-(pow(s.height,2)/pow(s.width,2))) > 0.75
+            || (m_lastEllipse != cv::Size2f(-1,-1)
+                && (std::abs(s.width - m_lastEllipse.width) > 1.0 || std::abs(s.height - m_lastEllipse.height) > 1.0))){
+        m_stats.fastRejected++;
+        return false;
+    }
+    //storeResult expects the convention of ellipseFitting
+    if(m_userRoi != cv::Rect(0,0,0,0))
+        el.center += cv::Point2f(m_roiPupil.tl());
+    elPupil = el;
+    support = border.size();
+    return true;
+}
 
-                                *  *              *  *
-                             *        *        *        *
-                            *          *      *          *
-                            *          *      *          *
-                             *        *        *        *
-                                *  *              *  *
-                                5  7              5  6
-                             3        9        4        7
-                            1          *      3          8
-                            0          *      2          9
-                             2        8        1        *
-                                4  6              0  *
-        */
-        //TODODroopyEyelid IDEA : Nota de 7. Es mejor la IDEA003
-        /*double lowerDistance;
-        for(int i=0,j=32; i<m_starburstPtos.size();i++,j--){
-            if(j<0)
-                j=63;
-            if(i > 20 && i < 45){
-                ////IDEA001(BEGIN)
-                //std::cout<<" j: "<<i<<std::endl;
-                //if(m_starburstPtos[j]){
-                //    std::cout<<" for frame "<<i<<" we are taking frame  "<<j<<" point: "<<edgePointsConcurrent[j]<<" centres[0]: "<<centres[0]<<std::endl;
-                //    m_edgePoints.push_back(cv::Point2f(edgePointsConcurrent[j].x,
-                //                                       centres[0].y - (edgePointsConcurrent[j].y-centres[0].y)));
-                //    distances.push_back(edgePointsConcurrent[j].z);
-                //}IDEA001(END)
-                 //IDEA002(BEGIN)
-                 if(m_starburstPtos[j]){
-                     std::cout<<" edgePointsConcurrent[j].x: "<<edgePointsConcurrent[j].x<<std::endl;
-                     std::cout<<" lowerDistance: "<<lowerDistance<<std::endl;
-                    std::cout<<" centres[0]: "<<centres[0]<<std::endl;
-                    std::cout<<" new: "<<centres[0].y - sqrt(pow(lowerDistance,2) - pow(edgePointsConcurrent[j].x-centres[0].x,2))<<std::endl;
-                    m_edgePoints.push_back(cv::Point2f(edgePointsConcurrent[j].x,
-                                                       centres[0].y - sqrt(pow(lowerDistance,2) - pow(edgePointsConcurrent[j].x-centres[0].x,2))));
-                    distances.push_back(edgePointsConcurrent[j].z);
-                }//IDEA002(BEGIN)
-            }else{
-                if(m_starburstPtos[i]){
-                    m_edgePoints.push_back(cv::Point2f(edgePointsConcurrent[i].x, edgePointsConcurrent[i].y));
-                    distances.push_back(edgePointsConcurrent[i].z);
-                    lowerDistance = edgePointsConcurrent[i].z;
+template<int Rays>
+int OTracker::starburstT(){
+    std::vector<double> distances;
+    std::array<cv::Point3f, Rays> edgePointsConcurrent;
+    std::array<bool, Rays> found;
+    cv::Point2f centre;
+    //????? ¿What is the rationale of m_roiPupil?
+    if(m_userRoi == cv::Rect(0,0,0,0))
+        centre = m_elPupilThresh.center - cv::Point2f(m_roiPupil.tl().x, m_roiPupil.tl().y);
+    else
+        centre = m_elPupilThresh.center;
+    //Edges must be oriented away from this point
+    const cv::Point2f origin = m_elPupilThresh.center - cv::Point2f(m_roiPupil.x, m_roiPupil.y);
+    m_edgePoints.clear();
+#if OSCANN == 0
+    m_debugRays[0].clear();
+    m_debugRays[1].clear();
+#endif
+    tbb::parallel_for(size_t(0), size_t(Rays),[&] (size_t index){
+        const cv::Point2f dir(starburstRays<Rays>::dirs.x[index], starburstRays<Rays>::dirs.y[index]);
+        int t = 1;
+        cv::Point p = centre + (t * dir);
+        float dx, dy, cdirx, cdiry;
+        double dirCheck;
+        double distance;
+        bool insideSomeGlint = false;
+        found[index] = false;
+        while(p.inside(m_bbPupil)){
+#if OSCANN == 0
+            //Each ray is run by one task only, so every vector has a single writer
+            if(index==20)
+                m_debugRays[0].push_back(p);
+            if(index==45)
+                m_debugRays[1].push_back(p);
+#endif
+            for(unsigned int isg=0;isg<m_glintsRect.size();isg++){
+                insideSomeGlint = false;
+                if(p.inside(m_glintsRect[isg])){
+                    insideSomeGlint = true;
+                    break;
                 }
             }
-        }*/
-        /*//TODODroopyEyelid IDEA003(Begin)
-        int lower=22,upper=42;
-        double lowerDistance=0.0, upperDistance=0.0;
-        bool upperDefined = false;
-        for(int i=0; i<m_starburstPtos.size();i++){
-            if(i < lower || i > upper){
-                if(m_starburstPtos[i]){
-                    m_edgePoints.push_back(cv::Point2f(edgePointsConcurrent[i].x, edgePointsConcurrent[i].y));
-                    distances.push_back(edgePointsConcurrent[i].z);
-                    if(i<lower)
-                        lowerDistance = edgePointsConcurrent[i].z;
-                    if(i>upper && !upperDefined){
-                        upperDistance = edgePointsConcurrent[i].z;
-                        upperDefined = true;
-                    }
+            if(!insideSomeGlint && m_PupilEdges(p) > 0){
+                dx = m_PupilSobelX(p);
+                dy = m_PupilSobelY(p);
+                cdirx = p.x - origin.x;
+                cdiry = p.y - origin.y;
+                // Check edge direction
+                dirCheck = dx*cdirx + dy*cdiry;
+                if (dirCheck > 0 ){
+                    // We've hit an edge
+                    p.x +=0.5f;
+                    p.y += 0.5f;
+                    distance = sqrt(pow(centre.x-p.x,2)+pow(centre.y-p.y,2));
+                    edgePointsConcurrent[index] = cv::Point3f(p.x, p.y, distance);
+                    found[index] = true;
+                    break;
                 }
             }
+            ++t;
+            p = centre + (t * dir);
         }
-        double distance = (lowerDistance+upperDistance)/2;
-        for(int j=lower+32, i=0; i<(upper-lower);j++, i++){
-            if(j>63)
-                j = 0;
-            if(m_starburstPtos[j]){
+    });
+    /*libDetection 1.0: Starbust points are sorted around the ellipse that they form.
+                      Before this sort was based on x and y. However, the points do not follow the ellipse way
+                           BEFORE             NOW
+
+                            *  *              *  *
+                         *        *        *        *
+                        *          *      *          *
+                        *          *      *          *
+                         *        *        *        *
+                            *  *              *  *
+                            5  7              5  6
+                         3        9        4        7
+                        1          *      3          8
+                        0          *      2          9
+                         2        8        1        *
+                            4  6              0  *
+    */
+    //TODODroopyEyelid IDEA : Nota de 7. Es mejor la IDEA003
+    /*double lowerDistance;
+    for(int i=0,j=32; i<m_starburstPtos.size();i++,j--){
+        if(j<0)
+            j=63;
+        if(i > 20 && i < 45){
+            ////IDEA001(BEGIN)
+            //std::cout<<" j: "<<i<<std::endl;
+            //if(m_starburstPtos[j]){
+            //    std::cout<<" for frame "<<i<<" we are taking frame  "<<j<<" point: "<<edgePointsConcurrent[j]<<" centres[0]: "<<centres[0]<<std::endl;
+            //    m_edgePoints.push_back(cv::Point2f(edgePointsConcurrent[j].x,
+            //                                       centres[0].y - (edgePointsConcurrent[j].y-centres[0].y)));
+            //    distances.push_back(edgePointsConcurrent[j].z);
+            //}IDEA001(END)
+             //IDEA002(BEGIN)
+             if(m_starburstPtos[j]){
+                 std::cout<<" edgePointsConcurrent[j].x: "<<edgePointsConcurrent[j].x<<std::endl;
+                 std::cout<<" lowerDistance: "<<lowerDistance<<std::endl;
+                std::cout<<" centres[0]: "<<centres[0]<<std::endl;
+                std::cout<<" new: "<<centres[0].y - sqrt(pow(lowerDistance,2) - pow(edgePointsConcurrent[j].x-centres[0].x,2))<<std::endl;
                 m_edgePoints.push_back(cv::Point2f(edgePointsConcurrent[j].x,
-                                                   centres[0].y - sqrt(pow(distance,2) - pow(edgePointsConcurrent[j].x-centres[0].x,2))));
+                                                   centres[0].y - sqrt(pow(lowerDistance,2) - pow(edgePointsConcurrent[j].x-centres[0].x,2))));
                 distances.push_back(edgePointsConcurrent[j].z);
+            }//IDEA002(BEGIN)
+        }else{
+            if(m_starburstPtos[i]){
+                m_edgePoints.push_back(cv::Point2f(edgePointsConcurrent[i].x, edgePointsConcurrent[i].y));
+                distances.push_back(edgePointsConcurrent[i].z);
+                lowerDistance = edgePointsConcurrent[i].z;
             }
-
-        }//TODODroopyEyelid IDEA003(End)*/
-
-        for(unsigned int i=0;i<m_starburstPtos.size();i++){
+        }
+    }*/
+    /*//TODODroopyEyelid IDEA003(Begin)
+    int lower=22,upper=42;
+    double lowerDistance=0.0, upperDistance=0.0;
+    bool upperDefined = false;
+    for(int i=0; i<m_starburstPtos.size();i++){
+        if(i < lower || i > upper){
             if(m_starburstPtos[i]){
                 m_edgePoints.push_back(cv::Point2f(edgePointsConcurrent[i].x, edgePointsConcurrent[i].y));
                 distances.push_back(edgePointsConcurrent[i].z);
+                if(i<lower)
+                    lowerDistance = edgePointsConcurrent[i].z;
+                if(i>upper && !upperDefined){
+                    upperDistance = edgePointsConcurrent[i].z;
+                    upperDefined = true;
+                }
             }
         }
-        if (m_edgePoints.size() < (unsigned int) params.StarburstPoints/2){
-            std::ostringstream oss;
-            oss << "ERROR 04: starburst - Only "<< m_edgePoints.size()<< " points were found. However, "<<params.StarburstPoints/2<<" are nedded";
-            m_errorMsg = oss.str();
-            return m_errno = -4;
+    }
+    double distance = (lowerDistance+upperDistance)/2;
+    for(int j=lower+32, i=0; i<(upper-lower);j++, i++){
+        if(j>63)
+            j = 0;
+        if(m_starburstPtos[j]){
+            m_edgePoints.push_back(cv::Point2f(edgePointsConcurrent[j].x,
+                                               centres[0].y - sqrt(pow(distance,2) - pow(edgePointsConcurrent[j].x-centres[0].x,2))));
+            distances.push_back(edgePointsConcurrent[j].z);
+        }
+
+    }//TODODroopyEyelid IDEA003(End)*/
+
+    for(int i=0;i<Rays;i++){
+        if(found[i]){
+            m_edgePoints.push_back(cv::Point2f(edgePointsConcurrent[i].x, edgePointsConcurrent[i].y));
+            distances.push_back(edgePointsConcurrent[i].z);
         }
     }
-    else{
-        //BEGIN(Non-zero value finder)
-        for(int y = 0; y < m_PupilEdges.rows; y++){
-            uchar* val = m_PupilEdges[y];
-            for(int x = 0; x < m_PupilEdges.cols; x++, val++){
-                if(*val == 0)
-                    continue;
-                m_edgePoints.push_back(cv::Point2f(x + 0.5f, y + 0.5f));
-            }
+    if (m_edgePoints.size() < (unsigned int) Rays/2){
+        std::ostringstream oss;
+        oss << "ERROR 04: starburst - Only "<< m_edgePoints.size()<< " points were found. However, "<<Rays/2<<" are nedded";
+        m_errorMsg = oss.str();
+        return m_errno = -4;
+    }
+    removeStarburstOutliers(distances, centre);
+    return 0;
+}
+// Without rays every edge pixel is a candidate
+template<>
+int OTracker::starburstT<0>(){
+    m_edgePoints.clear();
+    //BEGIN(Non-zero value finder)
+    for(int y = 0; y < m_PupilEdges.rows; y++){
+        uchar* val = m_PupilEdges[y];
+        for(int x = 0; x < m_PupilEdges.cols; x++, val++){
+            if(*val == 0)
+                continue;
+            m_edgePoints.push_back(cv::Point2f(x + 0.5f, y + 0.5f));
         }
-        //END(Non-zero value finder)
     }
+    //END(Non-zero value finder)
+    return 0;
+}
+
+void OTracker::removeStarburstOutliers(std::vector<double>& distances, const cv::Point2f& centre){
     /*libDetection 1.0: Remove outlier starburst points
                       Before this sort was based on x and y. However, the points do not follow the ellipse way
                            BEFORE                NOW
@@ -1302,11 +1668,11 @@ int OTracker::starburst(){
         for(unsigned int i=0;i<m_edgePoints.size();i++){
             cv::circle(all,m_edgePoints[i],1,cv::Scalar(255,0,255));
         }
-        for(unsigned int i=0;i<points_48.size();i++){
-            cv::circle(all,points_48[i],1,cv::Scalar(255,0,0));
+        for(unsigned int i=0;i<m_debugRays[0].size();i++){
+            cv::circle(all,m_debugRays[0][i],1,cv::Scalar(255,0,0));
         }
-        for(unsigned int i=0;i<points_16.size();i++){
-            cv::circle(all,points_16[i],1,cv::Scalar(128,0,0));
+        for(unsigned int i=0;i<m_debugRays[1].size();i++){
+            cv::circle(all,m_debugRays[1][i],1,cv::Scalar(128,0,0));
         }
         cv::imshow("All",all);
         cv::moveWindow("All", 1300, 200);
@@ -1340,8 +1706,7 @@ int OTracker::starburst(){
         }
     }
 #if OSCANN == 0  //v1.0.6: New
-    for(unsigned int i=0;i<centres.size();i++){                                 //TODODEBUGBLOCK001
-        cv::circle(mStar,centres[i],5,cv::Scalar(0,255,0));}
+    cv::circle(mStar,centre,5,cv::Scalar(0,255,0));                             //TODODEBUGBLOCK001
     for(unsigned int i=0;i<m_edgePoints.size();i++){
         if(i == 0)          cv::circle(mStar,m_edgePoints[i],5,cv::Scalar(255,255,255));
         else if(i == 10)    cv::circle(mStar,m_edgePoints[i],1,cv::Scalar(0,64,0));
@@ -1351,12 +1716,225 @@ int OTracker::starburst(){
     cv::imshow("Valid",mStar);
     cv::moveWindow("Valid", 1300, 500);
     mStar.release();                                                            //TODODEBUGBLOCK001
+#else
+    (void)centre;
 #endif
-    return 0;
 }
 
-int OTracker::ellipseFitting(){
-    m_centroidesGlintsPos.clear();
+// ------------------------------------------------------------------------------
+// RANSAC ellipse fitting. The flags of params (EarlyRejection, ImageAwareSupport
+// and Seed >= 0) are template arguments, so every compiled configuration keeps
+// only its own branches inside the loop.
+// ------------------------------------------------------------------------------
+struct EllipseRansac_out {
+    std::vector<cv::Point2f> bestInliers;
+    cv::RotatedRect bestEllipse;
+    double bestEllipseGoodness;
+    int earlyRejections;
+    bool earlyTermination;
+    unsigned int attempts;
+    EllipseRansac_out() : bestEllipseGoodness(-std::numeric_limits<double>::infinity()), earlyRejections(0), earlyTermination(false), attempts(0) {}
+};
+template<bool EarlyRejection, bool ImageAware, bool Seeded>
+struct OTracker::EllipseRansac {
+    const parameters& params;
+    const std::vector<cv::Point2f>& edgePoints;
+    unsigned int n;
+    const cv::Rect& bb;
+    const cv::Mat_<float>& mDX;
+    const cv::Mat_<float>& mDY;
+    int earlyRejections;
+    bool earlyTermination;
+    unsigned int attempts;
+    const cv::Size2f lastEllipse;
+    EllipseRansac_out out;
+    EllipseRansac(
+                const parameters& params,
+                const std::vector<cv::Point2f>& edgePoints,
+                int n,
+                const cv::Rect& bb,
+                const cv::Mat_<float>& mDX,
+                const cv::Mat_<float>& mDY,
+                const cv::Size2f& lastEllipse) : params(params), edgePoints(edgePoints), n(n), bb(bb), mDX(mDX), mDY(mDY), earlyRejections(0), earlyTermination(false), attempts(0), lastEllipse(lastEllipse){}
+    EllipseRansac(EllipseRansac& other, tbb::split) : params(other.params), edgePoints(other.edgePoints), n(other.n), bb(other.bb), mDX(other.mDX), mDY(other.mDY), earlyRejections(other.earlyRejections), earlyTermination(other.earlyTermination), attempts(other.attempts), lastEllipse(other.lastEllipse){}
+    void operator()(const tbb::blocked_range<size_t>& r){
+        if (out.earlyTermination){
+            return;
+        }
+        cv::RotatedRect ellipseInlierFit;
+        cv::Point2f grad;
+        float dx;
+        float dy;
+        float dotProd;
+        bool gradientCorrect;
+        std::vector<cv::Point2f> sample;
+        std::vector<cv::Point2f> inliers;
+        double ellipseGoodness;
+        double edgeStrength;
+        cv::RotatedRect ellipseSampleFit;
+        cv::Size_<double> s;
+        double eccentricity;
+        double eccMax;
+        float errOf1px;
+        float errorScale;
+        float widthErr;
+        float heightErr;
+        for( size_t i=r.begin(); i!=r.end(); ++i ){
+            //?????
+            if(i>256){
+                out.attempts = 256;
+                return;
+            }
+            // Ransac Iteration
+            if (Seeded)
+                sample = randomSubset(edgePoints, n, static_cast<unsigned int>(i + params.Seed));
+            else
+                sample = randomSubset(edgePoints, n);   //ALWAYS THIS
+            ellipseSampleFit = cv::fitEllipse(sample);
+            // Normalise ellipse to have width as the major axis.
+            if (ellipseSampleFit.size.height > ellipseSampleFit.size.width){
+                ellipseSampleFit.angle = std::fmod(ellipseSampleFit.angle + 90, 180);
+                std::swap(ellipseSampleFit.size.height, ellipseSampleFit.size.width);
+            }
+            s = ellipseSampleFit.size;
+            if(lastEllipse != cv::Size2f(-1,-1)){
+                if(s.width > lastEllipse.width)
+                    widthErr = s.width - lastEllipse.width;
+                else
+                    widthErr = lastEllipse.width-s.width;
+                if(s.height > lastEllipse.height)
+                    heightErr = s.height - lastEllipse.height;
+                else
+                    heightErr = lastEllipse.height-s.height;
+            }else{
+                widthErr = 0.0;
+                heightErr = 0.0;
+            }
+            attempts++;
+            eccentricity=sqrt(1-(pow(s.height,2)/pow(s.width,2)));
+            //ORIGINAL: eccMax=0.65; //FIXED VALUE (0=Circulo, 1=Linea)
+            //NOTE: Changed to 0.7 for AURA83/CC9-02192018-095103 -> first calibration point <-
+            //              to 0.75 for 1060/CC9-05102018-134023  -> first calibration point <-
+            eccMax=0.75; //FIXED VALUE (0=Circulo, 1=Linea)
+            // Discard useless ellipses early
+            if (!ellipseSampleFit.center.inside(bb)
+                    || s.height > params.Radius_Max*2
+                    || s.width > params.Radius_Max*2
+                    || (s.height < params.Radius_Min*2 && s.width < params.Radius_Min*2)
+                    || s.height > 4*s.width
+                    || s.width > 4*s.height
+                    || eccentricity > eccMax
+                    || widthErr > 1.0
+                    || heightErr > 1.0
+                    ) {
+                // Bad ellipse
+                continue;
+            }
+            // Use conic section's algebraic distance as an error measure
+            ConicSection conicSampleFit(ellipseSampleFit);
+            // Check if sample's gradients are correctly oriented
+            if (EarlyRejection){
+                gradientCorrect = true;
+                BOOST_FOREACH(const cv::Point2f& p, sample){
+                    grad = conicSampleFit.algebraicGradientDir(p);
+                    dx = mDX(cv::Point(p.x, p.y));
+                    dy = mDY(cv::Point(p.x, p.y));
+                    dotProd = dx*grad.x + dy*grad.y;
+                    gradientCorrect &= dotProd > 0;
+                }
+                if (!gradientCorrect){
+                    continue;
+                }
+            }
+            // Assume that the sample is the only inliers
+            ellipseInlierFit = ellipseSampleFit;
+            ConicSection conicInlierFit = conicSampleFit;
+            // Iteratively find inliers, and re-fit the ellipse
+            for (int i = 0; i < params.InlierIterations; ++i){
+                // Get error scale for 1px out on the minor axis
+                cv::Point2f minorAxis(-std::sin(PI/180.0*ellipseInlierFit.angle), std::cos(PI/180.0*ellipseInlierFit.angle));
+                cv::Point2f minorAxisPlus1px = ellipseInlierFit.center + (ellipseInlierFit.size.height/2 + 1)*minorAxis;
+                errOf1px = conicInlierFit.distance(minorAxisPlus1px);
+                errorScale = 1.0f/errOf1px;
+                // Find inliers
+                inliers.reserve(edgePoints.size());
+                const float MAX_ERR = 2;
+                BOOST_FOREACH(const cv::Point2f& p, edgePoints){
+                    float err = errorScale*conicInlierFit.distance(p);
+                    if (err*err < MAX_ERR*MAX_ERR)
+                        inliers.push_back(p);
+                }
+                if (inliers.size() < n) {
+                    inliers.clear();
+                    continue;
+                }
+                // Refit ellipse to inliers
+                ellipseInlierFit = cv::fitEllipse(inliers);
+                conicInlierFit = ConicSection(ellipseInlierFit);
+                // Normalise ellipse to have width as the major axis.
+                if (ellipseInlierFit.size.height > ellipseInlierFit.size.width){
+                    ellipseInlierFit.angle = std::fmod(ellipseInlierFit.angle + 90, 180);
+                    std::swap(ellipseInlierFit.size.height, ellipseInlierFit.size.width);
+                }
+            }
+            if (inliers.empty())
+                continue;
+            // Discard useless ellipses again
+            s = ellipseInlierFit.size;
+            eccentricity=sqrt(1-(pow(s.height,2)/pow(s.width,2)));
+            if (!ellipseInlierFit.center.inside(bb)
+                    || s.height > params.Radius_Max*2
+                    || s.width > params.Radius_Max*2
+                    || (s.height < params.Radius_Min*2 && s.width < params.Radius_Min*2)
+                    || s.height > 4*s.width
+                    || s.width > 4*s.height
+                    || eccentricity > eccMax
+                    ){
+                // Bad ellipse!
+                continue;
+            }
+            // Calculate ellipse goodness
+            ellipseGoodness = 0;
+            if (ImageAware){
+                BOOST_FOREACH(cv::Point2f& p, inliers){
+                    grad = conicInlierFit.algebraicGradientDir(p);
+                    dx = mDX(p);
+                    dy = mDY(p);
+                    edgeStrength = dx*grad.x + dy*grad.y;
+                    ellipseGoodness += edgeStrength;
+                }
+            }
+            else{
+                ellipseGoodness = inliers.size();
+            }
+            if (ellipseGoodness > out.bestEllipseGoodness){
+                std::swap(out.bestEllipseGoodness, ellipseGoodness);
+                std::swap(out.bestInliers, inliers);
+                std::swap(out.bestEllipse, ellipseInlierFit);
+                // Early termination, if 90% of points match
+                if (params.EarlyTerminationPercentage > 0   //Erik: Always true
+                        && out.bestInliers.size() > params.EarlyTerminationPercentage*edgePoints.size()/100){
+                    earlyTermination = true;
+                    out.attempts = attempts;
+                    break;
+                }
+            }
+
+        }
+    }
+    void join(EllipseRansac& other){
+        if (other.out.bestEllipseGoodness > out.bestEllipseGoodness){
+            std::swap(out.bestEllipseGoodness, other.out.bestEllipseGoodness);
+            std::swap(out.bestInliers, other.out.bestInliers);
+            std::swap(out.bestEllipse, other.out.bestEllipse);
+        }
+        earlyTermination |= other.earlyTermination;
+        out.earlyTermination = earlyTermination;
+        out.attempts += other.attempts;
+    }
+};
+template<bool EarlyRejection, bool ImageAware, bool Seeded>
+int OTracker::ellipseFittingT(){
     cv::RotatedRect elPupil;                    //ERIK: para que crear nuevas variables?????. Se puede trabajar con out???
     std::vector<cv::Point2f> inliers;
     const double p = 0.99;//999;                // Desired probability that only inliers are selected
@@ -1368,211 +1946,11 @@ int OTracker::ellipseFitting(){
         double wToN = std::pow(w,n);
         int k = static_cast<int>(std::log(1-p)/std::log(1 - wToN)  + 2*std::sqrt(1 - wToN)/wToN);
         // Use TBB for RANSAC
-        struct EllipseRansac_out {
-            std::vector<cv::Point2f> bestInliers;
-            cv::RotatedRect bestEllipse;
-            double bestEllipseGoodness;
-            int earlyRejections;
-            bool earlyTermination;
-            unsigned int attempts;
-            EllipseRansac_out() : bestEllipseGoodness(-std::numeric_limits<double>::infinity()), earlyRejections(0), earlyTermination(false), attempts(0) {}
-        };
-        struct EllipseRansac {
-            const parameters& params;
-            const std::vector<cv::Point2f>& edgePoints;
-            unsigned int n;
-            const cv::Rect& bb;
-            const cv::Mat_<float>& mDX;
-            const cv::Mat_<float>& mDY;
-            int earlyRejections;
-            bool earlyTermination;
-            unsigned int attempts;
-            EllipseRansac_out out;
-            EllipseRansac(
-                        const parameters& params,
-                        const std::vector<cv::Point2f>& edgePoints,
-                        int n,
-                        const cv::Rect& bb,
-                        const cv::Mat_<float>& mDX,
-                        const cv::Mat_<float>& mDY) : params(params), edgePoints(edgePoints), n(n), bb(bb), mDX(mDX), mDY(mDY), earlyRejections(0), earlyTermination(false), attempts(0){}
-            EllipseRansac(EllipseRansac& other, tbb::split) : params(other.params), edgePoints(other.edgePoints), n(other.n), bb(other.bb), mDX(other.mDX), mDY(other.mDY), earlyRejections(other.earlyRejections), earlyTermination(other.earlyTermination), attempts(other.attempts){}
-            void operator()(const tbb::blocked_range<size_t>& r){
-                if (out.earlyTermination){
-                    return;
-                }
-                cv::RotatedRect ellipseInlierFit;
-                cv::Point2f grad;
-                float dx;
-                float dy;
-                float dotProd;
-                bool gradientCorrect;
-                std::vector<cv::Point2f> sample;
-                std::vector<cv::Point2f> inliers;
-                double ellipseGoodness;
-                double edgeStrength;
-                cv::RotatedRect ellipseSampleFit;
-                cv::Size_<double> s;
-                double eccentricity;
-                double eccMax;
-                float errOf1px;
-                float errorScale;
-                float widthErr;
-                float heightErr;
-                for( size_t i=r.begin(); i!=r.end(); ++i ){
-                    //?????
-                    if(i>256){
-                        out.attempts = 256;
-                        return;
-                    }
-                    // Ransac Iteration
-                    if (params.Seed >= 0)
-                        sample = randomSubset(edgePoints, n, static_cast<unsigned int>(i + params.Seed));
-                    else
-                        sample = randomSubset(edgePoints, n);   //ALWAYS THIS
-                    ellipseSampleFit = cv::fitEllipse(sample);
-                    // Normalise ellipse to have width as the major axis.
-                    if (ellipseSampleFit.size.height > ellipseSampleFit.size.width){
-                        ellipseSampleFit.angle = std::fmod(ellipseSampleFit.angle + 90, 180);
-                        std::swap(ellipseSampleFit.size.height, ellipseSampleFit.size.width);
-                    }
-                    s = ellipseSampleFit.size;
-                    if(m_lastEllipse != cv::Size2f(-1,-1)){
-                        if(s.width > m_lastEllipse.width)
-                            widthErr = s.width - m_lastEllipse.width;
-                        else
-                            widthErr = m_lastEllipse.width-s.width;
-                        if(s.height > m_lastEllipse.height)
-                            heightErr = s.height - m_lastEllipse.height;
-                        else
-                            heightErr = m_lastEllipse.height-s.height;
-                    }else{
-                        widthErr = 0.0;
-                        heightErr = 0.0;
-                    }
-                    attempts++;
-                    eccentricity=sqrt(1-(pow(s.height,2)/pow(s.width,2)));
-                    //ORIGINAL: eccMax=0.65; //FIXED VALUE (0=Circulo, 1=Linea)
-                    //NOTE: Changed to 0.7 for AURA83/CC9-02192018-095103 -> first calibration point <-
-                    //              to 0.75 for 1060/CC9-05102018-134023  -> first calibration point <-
-                    eccMax=0.75; //FIXED VALUE (0=Circulo, 1=Linea)
-                    // Discard useless ellipses early
-                    if (!ellipseSampleFit.center.inside(bb)
-                            || s.height > params.Radius_Max*2
-                            || s.width > params.Radius_Max*2
-                            || (s.height < params.Radius_Min*2 && s.width < params.Radius_Min*2)
-                            || s.height > 4*s.width
-                            || s.width > 4*s.height
-                            || eccentricity > eccMax
-                            || widthErr > 1.0
-                            || heightErr > 1.0
-                            ) {
-                        // Bad ellipse
-                        continue;
-                    }
-                    // Use conic section's algebraic distance as an error measure
-                    ConicSection conicSampleFit(ellipseSampleFit);
-                    // Check if sample's gradients are correctly oriented
-                    if (params.EarlyRejection){
-                        gradientCorrect = true;
-                        BOOST_FOREACH(const cv::Point2f& p, sample){
-                            grad = conicSampleFit.algebraicGradientDir(p);
-                            dx = mDX(cv::Point(p.x, p.y));
-                            dy = mDY(cv::Point(p.x, p.y));
-                            dotProd = dx*grad.x + dy*grad.y;
-                            gradientCorrect &= dotProd > 0;
-                        }
-                        if (!gradientCorrect){
-                            continue;
-                        }
-                    }
-                    // Assume that the sample is the only inliers
-                    ellipseInlierFit = ellipseSampleFit;
-                    ConicSection conicInlierFit = conicSampleFit;
-                    // Iteratively find inliers, and re-fit the ellipse
-                    for (int i = 0; i < params.InlierIterations; ++i){
-                        // Get error scale for 1px out on the minor axis
-                        cv::Point2f minorAxis(-std::sin(PI/180.0*ellipseInlierFit.angle), std::cos(PI/180.0*ellipseInlierFit.angle));
-                        cv::Point2f minorAxisPlus1px = ellipseInlierFit.center + (ellipseInlierFit.size.height/2 + 1)*minorAxis;
-                        errOf1px = conicInlierFit.distance(minorAxisPlus1px);
-                        errorScale = 1.0f/errOf1px;
-                        // Find inliers
-                        inliers.reserve(edgePoints.size());
-                        const float MAX_ERR = 2;
-                        BOOST_FOREACH(const cv::Point2f& p, edgePoints){
-                            float err = errorScale*conicInlierFit.distance(p);
-                            if (err*err < MAX_ERR*MAX_ERR)
-                                inliers.push_back(p);
-                        }
-                        if (inliers.size() < n) {
-                            inliers.clear();
-                            continue;
-                        }
-                        // Refit ellipse to inliers
-                        ellipseInlierFit = cv::fitEllipse(inliers);
-                        conicInlierFit = ConicSection(ellipseInlierFit);
-                        // Normalise ellipse to have width as the major axis.
-                        if (ellipseInlierFit.size.height > ellipseInlierFit.size.width){
-                            ellipseInlierFit.angle = std::fmod(ellipseInlierFit.angle + 90, 180);
-                            std::swap(ellipseInlierFit.size.height, ellipseInlierFit.size.width);
-                        }
-                    }
-                    if (inliers.empty())
-                        continue;
-                    // Discard useless ellipses again
-                    s = ellipseInlierFit.size;
-                    eccentricity=sqrt(1-(pow(s.height,2)/pow(s.width,2)));
-                    if (!ellipseInlierFit.center.inside(bb)
-                            || s.height > params.Radius_Max*2
-                            || s.width > params.Radius_Max*2
-                            || (s.height < params.Radius_Min*2 && s.width < params.Radius_Min*2)
-                            || s.height > 4*s.width
-                            || s.width > 4*s.height
-                            || eccentricity > eccMax
-                            ){
-                        // Bad ellipse!
-                        continue;
-                    }
-                    // Calculate ellipse goodness
-                    ellipseGoodness = 0;
-                    if (params.ImageAwareSupport){
-                        BOOST_FOREACH(cv::Point2f& p, inliers){
-                            grad = conicInlierFit.algebraicGradientDir(p);
-                            dx = mDX(p);
-                            dy = mDY(p);
-                            edgeStrength = dx*grad.x + dy*grad.y;
-                            ellipseGoodness += edgeStrength;
-                        }
-                    }
-                    else{
-                        ellipseGoodness = inliers.size();
-                    }
-                    if (ellipseGoodness > out.bestEllipseGoodness){
-                        std::swap(out.bestEllipseGoodness, ellipseGoodness);
-                        std::swap(out.bestInliers, inliers);
-                        std::swap(out.bestEllipse, ellipseInlierFit);
-                        // Early termination, if 90% of points match
-                        if (params.EarlyTerminationPercentage > 0   //Erik: Always true
-                                && out.bestInliers.size() > params.EarlyTerminationPercentage*edgePoints.size()/100){
-                            earlyTermination = true;
-                            out.attempts = attempts;
-                            break;
-                        }
-                    }
-
-                }
-            }
-            void join(EllipseRansac& other){
-                if (other.out.bestEllipseGoodness > out.bestEllipseGoodness){
-                    std::swap(out.bestEllipseGoodness, other.out.bestEllipseGoodness);
-                    std::swap(out.bestInliers, other.out.bestInliers);
-                    std::swap(out.bestEllipse, other.out.bestEllipse);
-                }
-                earlyTermination |= other.earlyTermination;
-                out.earlyTermination = earlyTermination;
-                out.attempts += other.attempts;
-            }
-        };
-        EllipseRansac ransac(params, m_edgePoints, n, m_bbPupil, m_PupilSobelX, m_PupilSobelY);
+        //Radius limits in pixels of this frame
+        parameters scaled = params;
+        scaled.Radius_Min = std::max(1, cvRound(px(params.Radius_Min)));
+        scaled.Radius_Max = cvRound(px(params.Radius_Max));
+        EllipseRansac<EarlyRejection, ImageAware, Seeded> ransac(scaled, m_edgePoints, n, m_bbPupil, m_PupilSobelX, m_PupilSobelY, m_lastEllipse);
         try{
             tbb::parallel_reduce(tbb::blocked_range<size_t>(0,k,k/8), ransac);
         }
@@ -1584,29 +1962,33 @@ int OTracker::ellipseFitting(){
         inliers = ransac.out.bestInliers;
         m_earlyTermination = ransac.out.earlyTermination;
         m_fittingAttempts += ransac.out.attempts;
-        cv::RotatedRect ellipseBestFit = ransac.out.bestEllipse;
-        ConicSection conicBestFit(ellipseBestFit);
-        cv::Point2f grad;
-        BOOST_FOREACH(const cv::Point2f& p, m_edgePoints){
-            grad = conicBestFit.algebraicGradientDir(p);
-        }
-        elPupil = ellipseBestFit;
+        elPupil = ransac.out.bestEllipse;
         elPupil.center.x += m_roiPupil.x;
         elPupil.center.y += m_roiPupil.y;
     }
+    return storeResult(elPupil, inliers.size());
+}
+// ------------------------------------------------------------------------------
+// Pair the glints and move the pupil ellipse and glints into image coordinates.
+// elPupil is given as ellipseFitting leaves it: m_eye coordinates, shifted by
+// m_roiPupil.tl() when a user roi is defined. support is the number of points
+// backing the ellipse (0 means that no ellipse was found)
+// ------------------------------------------------------------------------------
+int OTracker::storeResult(cv::RotatedRect elPupil, std::size_t support){
+    m_centroidesGlintsPos.clear();
     int glint1=-1, glint2=-1;
-    if(m_glintsContours.size() == 2){
+    if(m_glintsCentroides.size() == 2){
         /*NOTE: Even when we know that they are only two. We must be sure that they are glints*/
         //v1.0.8: if((m_glintsCentroides[0].y > (m_glintsCentroides[1].y - 10.0)) && (m_glintsCentroides[0].y < (m_glintsCentroides[1].y + 10.0)) ){
         if((m_glintsCentroides[0].y > (m_glintsCentroides[1].y - m_glintsDistance)) && (m_glintsCentroides[0].y < (m_glintsCentroides[1].y + m_glintsDistance)) ){
             glint1 = 0;
             glint2 = 1;
         }
-    }else if(m_glintsContours.size() > 2){
-        for(unsigned int i = 0; i< m_glintsContours.size(); i++ ){
+    }else if(m_glintsCentroides.size() > 2){
+        for(unsigned int i = 0; i< m_glintsCentroides.size(); i++ ){
             if(m_glintPaired[i])
                 continue;
-            for(unsigned int j = 0; j< m_glintsContours.size(); j++ ){
+            for(unsigned int j = 0; j< m_glintsCentroides.size(); j++ ){
                 if(m_glintPaired[i])
                     continue;
                 //                          A-0.5                                             A+0.5
@@ -1633,18 +2015,18 @@ int OTracker::ellipseFitting(){
             }
         }
     }
-    if (inliers.size() == 0 || (glint1 == -1)){
+    if (support == 0 || (glint1 == -1)){
         std::ostringstream oss;
         if(glint1 == -1){
             //v1.0.8
             m_erode = m_initialErode;
             //v1.0.8
             m_lastErode = -1;
-            oss << "ERROR 05 ellipseFitting: Only "<< inliers.size()<< " inliers and "<<m_glintsCentroides.size()<<" glints centroides were found"<<". However, glints are very far apart. glint1.y: "<<m_glintsCentroides[0].y<<", glint2.y "<<m_glintsCentroides[1].y;
+            oss << "ERROR 05 ellipseFitting: Only "<< support<< " inliers and "<<m_glintsCentroides.size()<<" glints centroides were found"<<". However, glints are very far apart. glint1.y: "<<m_glintsCentroides[0].y<<", glint2.y "<<m_glintsCentroides[1].y;
             m_errorMsg = oss.str();
             return m_errno = -5;
         }else{
-            oss << "ERROR 06 ellipseFitting: Only "<< inliers.size()<< " inliers and "<<m_glintsCentroides.size()<<" glints centroides were found";
+            oss << "ERROR 06 ellipseFitting: Only "<< support<< " inliers and "<<m_glintsCentroides.size()<<" glints centroides were found";
             m_errorMsg = oss.str();
             return m_errno = -6;
         }
@@ -1684,6 +2066,46 @@ int OTracker::ellipseFitting(){
     }
     return 0;
 }
+// ------------------------------------------------------------------------------
+// Production configurations of the tracker core. The stages are chosen once from
+// params and the input format, instead of branching on them for every frame.
+// ------------------------------------------------------------------------------
+void OTracker::selectCore(int channels){
+    static const stageFn fittings[2][2][2] = {
+        {{&OTracker::ellipseFittingT<false,false,false>, &OTracker::ellipseFittingT<false,false,true>},
+         {&OTracker::ellipseFittingT<false,true,false>,  &OTracker::ellipseFittingT<false,true,true>}},
+        {{&OTracker::ellipseFittingT<true,false,false>,  &OTracker::ellipseFittingT<true,false,true>},
+         {&OTracker::ellipseFittingT<true,true,false>,   &OTracker::ellipseFittingT<true,true,true>}}
+    };
+    m_ellipseFitting = fittings[params.EarlyRejection][params.ImageAwareSupport][params.Seed >= 0];
+    switch(params.StarburstPoints){
+    case 0:     m_starburst = &OTracker::starburstT<0>;  break;
+    case 16:    m_starburst = &OTracker::starburstT<16>; break;
+    case 32:    m_starburst = &OTracker::starburstT<32>; break;
+    case 64:    m_starburst = &OTracker::starburstT<64>; break;
+    default:
+        //Not compiled: setStarburstPoints() does not let it in. The default configuration
+        m_errorMsg = "ERROR 07: selectCore - " + std::to_string(params.StarburstPoints) + " starburst rays are not compiled, 64 are used";
+        params.StarburstPoints = 64;
+        m_starburst = &OTracker::starburstT<64>;
+        break;
+    }
+    switch(channels){
+    case 3:     m_greyAndCrop = &OTracker::greyAndCropT<3>; break;
+    case 4:     m_greyAndCrop = &OTracker::greyAndCropT<4>; break;
+    default:    m_greyAndCrop = &OTracker::greyAndCropT<1>; break;
+    }
+    m_channels = channels;
+}
+bool OTracker::setStarburstPoints(const int rays){
+    if(rays != 0 && rays != 16 && rays != 32 && rays != 64){
+        m_errorMsg = "ERROR 07: setStarburstPoints - " + std::to_string(rays) + " rays are not compiled (0, 16, 32 or 64)";
+        return false;
+    }
+    params.StarburstPoints = rays;
+    selectCore(m_channels);
+    return true;
+}
 void OTracker::config(){
     m_errorMsg = "";
     m_debug =   false;
@@ -1717,6 +2139,18 @@ void OTracker::clearBlinks(){
     m_blinks.clear();
     resetBlinkVars();
 }
+void OTracker::resetTracking(){
+    m_userRoi = cv::Rect(0,0,0,0);
+    m_searchAgainRoi = cv::Rect(0,0,0,0);
+    m_ellipse = cv::RotatedRect();
+    m_lastEllipse = cv::Size2f(-1,-1);
+    m_lastGlintsTL = cv::Point(0,0);
+    m_lastGlintsBR = cv::Point(0,0);
+    m_bestBlob = BlobStats();
+    m_eye.release();
+    m_eyeFocus.release();
+    m_hist.release();
+}
 void OTracker::checkFails(){
     if(m_fails == m_lastFails && m_fails != 0){
         m_equal++;
@@ -1748,15 +2182,28 @@ int OTracker::find(){
     config();                                                                           //~1 microseconds
     if(m_userRoi != cv::Rect(0,0,0,0))
         roiBck = m_userRoi;
+    m_baseThresholdImg = m_thresholdImg;
+    m_baseThresholdGlints = m_thresholdGlints;
     do{
         result = 0;
         m_errno = 0;
         greyAndCrop();                                                                  //~200 microseconds
+        adaptiveThresholds();
+        m_path = PATH_NONE;
         if(pupilRegion() >= 0){                                                         //~247 microseconds, 52 std
             if(glintsDetection()>=0){
-                if(starburst() >= 0){                                                   //1 -> 55:25, 2 -> 60:37, 3 -> 79:68
-                    if(ellipseFitting() < 0){result = -4;}                              //1 -> 1705:14240-218888:228, 2 -> 2132:12828-476774:200    3 -> 996:15469-911429:199
-                 }else{result = -3;}
+                cv::RotatedRect elFast;
+                std::size_t support;
+                if(fastPath(elFast, support)){
+                    if(storeResult(elFast, support) < 0){result = -4;}
+                    else{m_path = PATH_FAST;}
+                }else{
+                    pupilEdges();
+                    if(starburst() >= 0){                                               //1 -> 55:25, 2 -> 60:37, 3 -> 79:68
+                        if(ellipseFitting() < 0){result = -4;}                          //1 -> 1705:14240-218888:228, 2 -> 2132:12828-476774:200    3 -> 996:15469-911429:199
+                        else{m_path = PATH_FULL;}
+                    }else{result = -3;}
+                }
             }else{result = -2;}
         }else{result = -1;}
         if(result < 0){
@@ -1778,10 +2225,12 @@ int OTracker::find(){
                 }
                 m_lastGlintsTL      =   cv::Point(0,0);
                 m_lastGlintsBR      =   cv::Point(0,0);
-                m_bestContour.clear();
+                m_bestBlob = BlobStats();
                 m_lastEllipse = cv::Size2f(-1,-1);
                 m_eye.release();
                 m_eyeFocus.release();
+                //Search again: the next roi does not share statistics with the lost one
+                m_hist.release();
 #if OSCANN == 0  //v1.0.6: New
             }
             //v1.0.8 : PABLO2
@@ -1793,6 +2242,11 @@ int OTracker::find(){
         if(times == 2 )
             break;
     }while(result < 0);
+    m_stats.frames++;
+    if(m_path == PATH_FAST)
+        m_stats.fastPath++;
+    else if(m_path == PATH_FULL)
+        m_stats.fullPath++;
     if(result < 0){
         if(result > -4){    //v1.0.4: Statement added
             m_fails++;
@@ -1840,8 +2294,8 @@ int OTracker::find(){
         else
             m_roiGlintsLarge = roiFromRectangle(cv::Rect(m_roiGlintsLarge.x+m_searchAgainRoi.x,m_roiGlintsLarge.y+m_searchAgainRoi.y,m_roiGlintsLarge.width,m_roiGlintsLarge.height));
     }
-    unsigned int paddingW = 20;
-    unsigned int paddingH = 20;
+    unsigned int paddingW = cvRound(px(20));
+    unsigned int paddingH = cvRound(px(20));
 #if OSCANN == 0  //v1.0.6: New
     	m_withMouse = false;
 #endif
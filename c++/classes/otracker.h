@@ -24,13 +24,29 @@ struct parameters{
     int Radius_Min;
     int Radius_Max;
     double CannyBlur;
-    int StarburstPoints;
+    int StarburstPoints;            //0, 16, 32 or 64: rays of the compiled starburst configurations
     int PercentageInliers;
     int InlierIterations;
     bool ImageAwareSupport;
     int EarlyTerminationPercentage;
     bool EarlyRejection;
     int Seed;
+    //Moment fast path: the ellipse of a very circular threshold blob is used without starburst and RANSAC
+    bool FastPath;
+    double FastPathCircularity;     //Minimum circularity of the blob
+    int FastPathSamples;            //Points checked along the ellipse border
+    int FastPathAgreement;          //Percentage of them that must sit on a dark-to-bright edge
+    //Adaptive thresholds: pupil, iris/skin and glint modes of the roi histogram
+    bool AdaptiveThresholds;
+    double HistogramDecay;          //Weight of the new frame in the running histogram
+    double AdaptiveRange;           //Maximum change from the thresholds given to measure()
+    //Glint tracking between frames before the segmentation search
+    bool GlintTracking;
+    int GlintTrackRadius;           //Half size of the search window around the last glint
+    double GlintTrackTolerance;     //Maximum change (px) of the vector between the two glints
+    //Pixel constants (radius limits, glint roi, paddings) were tuned with 480 line frames
+    double ReferenceHeight;
+    double PixelScale;              //Eye pixels per reference pixel. 0: frame height / ReferenceHeight
     bool defaultValues = true;
 };
 struct EdgePoint{
@@ -42,6 +58,84 @@ struct EdgePoint{
         return point == other.point;
     }
 };
+/* Statistics of one 8-connected blob of a binary image.
+ * They are accumulated by OTracker::labelBlobs in a single raster pass, so no contour point list is built.
+ * area() and perimeter() estimate the polygon through the border pixel centres, which is what
+ * cv::contourArea and cv::arcLength measure on a CHAIN_APPROX_NONE contour.*/
+struct BlobStats{
+    double m00 = 0, m10 = 0, m01 = 0, m20 = 0, m11 = 0, m02 = 0;   //Raw moments of the pixel centres
+    int boundary = 0;       //Pixels with at least one 4-neighbour in the background
+    int crack = 0;          //Pixel sides shared with the background
+    cv::Rect bbox;
+    //Pick's theorem: A = N - B/2 - 1
+    double area() const {return std::max(0.0, m00 - boundary/2.0 - 1.0);}
+    //A digital border of c cracks encloses a centre polygon of about (c-4)*PI/4
+    double perimeter() const {return std::max(0, crack-4)*CV_PI/4.0;}
+    double circularity() const {
+        double p = perimeter();
+        return p > 0 ? 4*CV_PI*area()/(p*p) : 0.0;
+    }
+    cv::Moments moments() const {return cv::Moments(m00, m10, m01, m20, m11, m02, 0, 0, 0, 0);}
+};
+//How the pupil ellipse of the last frame was obtained
+enum detectionPath{
+    PATH_NONE = 0,      //Not found
+    PATH_FULL = 1,      //starburst + RANSAC
+    PATH_FAST = 2       //Blob moments validated against the image gradient
+};
+struct trackerStats{
+    unsigned long frames = 0;
+    unsigned long fastPath = 0;
+    unsigned long fullPath = 0;
+    unsigned long fastRejected = 0;     //Candidates for the fast path that fell back to the full one
+    unsigned long glintTracked = 0;     //Frames whose glints came from the tracker
+    unsigned long glintFallback = 0;    //Tracker divergences solved by the segmentation search
+    double glintConfidence = 0;         //Last tracker confidence [0,1]
+};
+/* Starburst ray directions generated at compile time. Ray j points at (j-48)*2*PI/Rays,
+ * which is the order the runtime table used, so the edge points keep their sequence.*/
+namespace rays{
+    constexpr double wrap(double x){
+        while(x > CV_PI)    x -= 2*CV_PI;
+        while(x < -CV_PI)   x += 2*CV_PI;
+        return x;
+    }
+    constexpr double csin(double x){
+        x = wrap(x);
+        double term = x, sum = x;
+        for(int k=1;k<12;k++){
+            term *= -x*x/((2*k)*(2*k+1));
+            sum += term;
+        }
+        return sum;
+    }
+    constexpr double ccos(double x){
+        x = wrap(x);
+        double term = 1, sum = 1;
+        for(int k=1;k<12;k++){
+            term *= -x*x/((2*k-1)*(2*k));
+            sum += term;
+        }
+        return sum;
+    }
+}
+template<int Rays> struct rayTable{
+    float x[Rays];
+    float y[Rays];
+};
+template<int Rays> constexpr rayTable<Rays> makeRayTable(){
+    rayTable<Rays> t{};
+    for(int j=0;j<Rays;j++){
+        double theta = (j-48)*2*CV_PI/Rays;
+        t.x[j] = (float)rays::ccos(theta);
+        t.y[j] = (float)rays::csin(theta);
+    }
+    return t;
+}
+template<int Rays> struct starburstRays{
+    static constexpr rayTable<Rays> dirs = makeRayTable<Rays>();
+};
+template<int Rays> constexpr rayTable<Rays> starburstRays<Rays>::dirs;
 template<class T> T constrain(T input, T min, T max){
     //Limita la variable input a valores entre min y max
     T aux=std::max(min,input);
@@ -75,8 +169,16 @@ private:
     //v4.0.11:
     bool m_isCalibration;
 
-    std::array<cv::Point2f, 64> m_ptoDirs;
-    std::array<bool, 64> m_starburstPtos;
+    //Tracker core: one of the compiled configurations, chosen by selectCore()
+    typedef int (OTracker::*stageFn)();
+    typedef void (OTracker::*cropFn)();
+    stageFn m_starburst;
+    stageFn m_ellipseFitting;
+    cropFn m_greyAndCrop;
+    int m_channels;
+#if OSCANN == 0
+    std::vector<cv::Point2f> m_debugRays[2];
+#endif
 
     int m_fails;
     int m_lastFails;
@@ -91,7 +193,7 @@ private:
     cv::Point2d m_rightGlint;
 
     cv::RotatedRect m_ellipse;
-    static cv::Size2f m_lastEllipse;
+    cv::Size2f m_lastEllipse;          //Per instance: binocular mode runs two trackers at once
 
 
     bool m_earlyTermination;
@@ -150,6 +252,11 @@ private:
 
     float m_thresholdImg;
     float m_thresholdGlints;
+    //Adaptive thresholds
+    float m_baseThresholdImg;
+    float m_baseThresholdGlints;
+    cv::Mat_<float> m_hist;             //Running histogram (fractions of the roi); empty: reset
+    float m_histCentres[3];
 
 
     cv::Point2f m_lastRightGlint;
@@ -201,7 +308,10 @@ private:
     cv::Mat m_morphImg;
 
     //pupilRegion or maybe pupilROI
-    std::vector<cv::Point> m_bestContour;
+    BlobStats m_bestBlob;
+
+    detectionPath m_path;
+    trackerStats m_stats;
 
     //debug
     bool m_debug;
@@ -217,18 +327,40 @@ private:
     int measure();
     // -----
     void config();
-    void greyAndCrop();
+    void selectCore(int channels);
+    template<int Channels>
+    void greyAndCropT();
+    void greyAndCrop(){(this->*m_greyAndCrop)();}
+    void adaptiveThresholds();
     void thresholding();
+    void labelBlobs(const cv::Mat_<uchar>& binary, std::vector<BlobStats>& blobs);
     int pupilRegion();
     //int bestRegion(const cv::Mat img, const cv::Rect roiHaar);
     //void setRoi();
     int glintsDetection();
+    bool trackGlints();
+    void pupilEdges();
+    bool fastPath(cv::RotatedRect& elPupil, std::size_t& support);
     //v1.0.9: std::vector<std::vector<cv::Point> > getValidContours(std::vector<std::vector<cv::Point> > contours);
     std::vector<std::vector<cv::Point> > getValidContours(std::vector<std::vector<cv::Point> > contours, bool restrictX=true);
     //void pupilRoiWithoutGlints();
-    int starburst();
-    int ellipseFitting();
-    cv::Rect roiFromRectangle(const cv::Rect rectangle, const int maxWidth=640, const int maxHeight=480);
+    template<int Rays>
+    int starburstT();
+    int starburst(){return (this->*m_starburst)();}
+    void removeStarburstOutliers(std::vector<double>& distances, const cv::Point2f& centre);
+    template<bool EarlyRejection, bool ImageAware, bool Seeded>
+    struct EllipseRansac;
+    template<bool EarlyRejection, bool ImageAware, bool Seeded>
+    int ellipseFittingT();
+    int ellipseFitting(){return (this->*m_ellipseFitting)();}
+    int storeResult(cv::RotatedRect elPupil, std::size_t support);
+    //0: size of the current frame
+    cv::Rect roiFromRectangle(const cv::Rect rectangle, const int maxWidth=0, const int maxHeight=0);
+    //Pixel constant tuned at ReferenceHeight, in pixels of the eye. The density of the eye does
+    //not change when the frame is cropped: the scale comes from the sensor frame (setSensorHeight)
+    double px(double value) const {return value*m_scale;}
+    double m_scale;
+    int m_sensorHeight;
     // -----
 
 
@@ -284,12 +416,26 @@ public:
     float calcBlurriness(const cv::Mat &frame);
     cv::Point2d pupilPoint(){return m_pupil;}
     cv::RotatedRect ellipse(){return m_ellipse;}
+    //Region searched in the next frame (0,0,0,0: whole frame)
+    cv::Rect userRoi(){return m_userRoi;}
     //1.0.8: std::pair<cv::Point2f,cv::Point2f> glints(){return std::pair<cv::Point2f,cv::Point2f>(m_leftGlint, m_rightGlint);}
     std::pair<cv::Point2d,cv::Point2d> glints(){return std::pair<cv::Point2d,cv::Point2d>(m_leftGlint, m_rightGlint);}
     std::vector<std::pair<int, int>> getBlinks();
     void clearBlinks();
+    //Forgets the regions, ellipse, glints and histogram of the previous frames: the next
+    //image is not cut at the same place (eye region moved)
+    void resetTracking();
     //v4.0.11:
     void isCalibration(const bool value);
+    void setFastPath(const bool value){params.FastPath = value;}
+    //0, 16, 32 or 64. Other counts are rejected (getLastError) and the core is kept
+    bool setStarburstPoints(const int rays);
+    //Height of the whole frame the images given to measure() are cut from (eye regions,
+    //binocular halves). 0: their own height
+    void setSensorHeight(const int rows){m_sensorHeight = rows > 0 ? rows : 0;}
+    detectionPath lastPath(){return m_path;}
+    const trackerStats& stats(){return m_stats;}
+    std::pair<float,float> thresholds(){return std::pair<float,float>(m_thresholdImg, m_thresholdGlints);}
 };
 
 #endif // OTRACKER_H
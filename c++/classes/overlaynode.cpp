@@ -0,0 +1,44 @@
+#include "overlaynode.h"
+
+#include <cmath>
+
+overlayNode::overlayNode(const QColor& color, bool filled) :
+    m_geometry(QSGGeometry::defaultAttributes_Point2D(), 0), m_filled(filled), m_visible(false){
+    //Filled: triangle fan around the centre. Outline: closed line strip
+    m_geometry.setDrawingMode(filled ? GL_TRIANGLE_FAN : GL_LINE_STRIP);
+    m_geometry.setLineWidth(1);
+    m_material.setColor(color);
+    setGeometry(&m_geometry);
+    setMaterial(&m_material);
+}
+void overlayNode::setEllipse(const QPointF& centre, const QSizeF& axes, float angle){
+    const int first = m_filled ? 1 : 0;
+    if(m_geometry.vertexCount() != OVERLAY_SEGMENTS + 1 + first)
+        m_geometry.allocate(OVERLAY_SEGMENTS + 1 + first);
+    QSGGeometry::Point2D* v = m_geometry.vertexDataAsPoint2D();
+    if(m_filled)
+        v[0].set(centre.x(), centre.y());
+    const double theta = angle*M_PI/180.0;
+    const double c = cos(theta), s = sin(theta);
+    const double a = axes.width()/2, b = axes.height()/2;
+    for(int i=0;i<=OVERLAY_SEGMENTS;i++){
+        const double t = 2*M_PI*(i % OVERLAY_SEGMENTS)/OVERLAY_SEGMENTS;
+        const double x = a*cos(t), y = b*sin(t);
+        v[first + i].set(centre.x() + x*c - y*s, centre.y() + x*s + y*c);
+    }
+    m_visible = true;
+    markDirty(QSGNode::DirtyGeometry);
+}
+void overlayNode::setColor(const QColor& color){
+    if(m_material.color() == color)
+        return;
+    m_material.setColor(color);
+    markDirty(QSGNode::DirtyMaterial);
+}
+void overlayNode::clear(){
+    if(!m_visible)
+        return;
+    m_geometry.allocate(0);
+    m_visible = false;
+    markDirty(QSGNode::DirtyGeometry);
+}
@@ -0,0 +1,31 @@
+#ifndef OVERLAYNODE_H
+#define OVERLAYNODE_H
+
+#include <QSGGeometryNode>
+#include <QSGFlatColorMaterial>
+#include <QColor>
+#include <QPointF>
+#include <QSizeF>
+
+/* Flat colour primitive drawn by the scene graph on top of the camera texture (ellipse, glints,
+ * stimulus), so the frame itself is never copied to draw them.
+ * Coordinates are in image pixels; the parent QSGTransformNode scales them to the item.*/
+#define OVERLAY_SEGMENTS    48
+
+class overlayNode : public QSGGeometryNode{
+public:
+    overlayNode(const QColor& color, bool filled);
+    //Same convention as cv::RotatedRect: full axes and angle in degrees
+    void setEllipse(const QPointF& centre, const QSizeF& axes, float angle);
+    void setCircle(const QPointF& centre, float radius){setEllipse(centre, QSizeF(2*radius, 2*radius), 0);}
+    void setColor(const QColor& color);
+    void clear();
+    bool isVisible() const {return m_visible;}
+private:
+    QSGGeometry m_geometry;
+    QSGFlatColorMaterial m_material;
+    bool m_filled;
+    bool m_visible;
+};
+
+#endif // OVERLAYNODE_H
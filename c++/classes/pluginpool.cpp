@@ -0,0 +1,145 @@
+#include "pluginpool.h"
+
+#include <QTimer>
+#include <QDebug>
+
+#include <algorithm>
+
+pluginPool::pluginPool(QObject* context) : m_context(context), m_shutdown(false){}
+void pluginPool::setStandby(const QString& name, const std::vector<std::vector<std::string>>& instances, const pluginPolicy& policy, unsigned int fps, bool readyOnStart){
+    standby& plugin = m_plugins[name];
+    plugin.instances = instances;
+    plugin.policy = policy;
+    plugin.fps = fps;
+    plugin.readyOnStart = readyOnStart;
+}
+bool pluginPool::launch(const QString& name, standby& plugin){
+    bool started = true;
+    for(std::size_t i=0;i<plugin.instances.size();i++){
+        std::vector<std::string> args = plugin.instances[i];
+        args.push_back(std::to_string(plugin.fps));
+        started = processSupervisor::instance().start(name.toStdString(), args, plugin.policy) && started;
+    }
+    if(!started)
+        qDebug()<<Q_FUNC_INFO<<processSupervisor::instance().getLastError().c_str();
+    return started;
+}
+bool pluginPool::alive(const QString& name) const{
+    //Also the ones that are still stopping: a new one could not register its DBus name yet
+    std::vector<pluginStats> stats = processSupervisor::instance().stats();
+    for(std::size_t i=0;i<stats.size();i++)
+        if(stats[i].name == name.toStdString() && stats[i].pid != 0)
+            return true;
+    return false;
+}
+void pluginPool::warm(const QString& name){
+    QMap<QString, standby>::iterator it = m_plugins.find(name);
+    //Rate unknown yet: a plugin of a guessed rate would be killed by the first session
+    if(m_shutdown || it == m_plugins.end() || it->state != STANDBY_NONE || it->fps == 0)
+        return;
+    if(alive(name)){
+        refill(name);
+        return;
+    }
+    if(launch(name, *it))
+        it->state = it->readyOnStart ? STANDBY_READY : STANDBY_STARTING;
+}
+void pluginPool::warmAll(){
+    for(QMap<QString, standby>::iterator it=m_plugins.begin();it!=m_plugins.end();++it)
+        warm(it.key());
+}
+void pluginPool::setRate(unsigned int fps){
+    if(fps == 0)
+        return;
+    for(QMap<QString, standby>::iterator it=m_plugins.begin();it!=m_plugins.end();++it){
+        if(it->fps == fps)
+            continue;
+        it->fps = fps;
+        if(it->state == STANDBY_READY || it->state == STANDBY_STARTING){
+            stopStandby(it.key());
+            refill(it.key());
+        }else if(it->state == STANDBY_NONE){
+            warm(it.key());
+        }
+        //Busy: the next refill takes the new rate
+    }
+}
+bool pluginPool::readied(const QString& name){
+    QMap<QString, standby>::iterator it = m_plugins.find(name);
+    if(it == m_plugins.end() || it->state != STANDBY_STARTING)
+        return false;
+    it->state = STANDBY_READY;
+    return true;
+}
+standbyState pluginPool::acquire(const QString& name, unsigned int fps){
+    QMap<QString, standby>::iterator it = m_plugins.find(name);
+    if(it == m_plugins.end())
+        return STANDBY_NONE;
+    it->requested.start();
+    it->waiting = !it->readyOnStart;
+    it->fromStandby = false;
+    if(it->state == STANDBY_READY || it->state == STANDBY_STARTING){
+        if(it->fps == fps && alive(name)){
+            standbyState state = it->state;
+            it->state = STANDBY_BUSY;
+            it->fromStandby = true;
+            return state;
+        }
+        //Another rate, or it died: the session starts its own
+        stopStandby(name);
+    }
+    return STANDBY_NONE;
+}
+void pluginPool::launched(const QString& name, unsigned int fps){
+    QMap<QString, standby>::iterator it = m_plugins.find(name);
+    if(it == m_plugins.end())
+        return;
+    it->fps = fps;
+    it->state = STANDBY_BUSY;
+}
+void pluginPool::ready(const QString& name){
+    QMap<QString, standby>::iterator it = m_plugins.find(name);
+    if(it == m_plugins.end() || !it->waiting)
+        return;
+    it->waiting = false;
+    standbyLatency& latency = it->latency;
+    latency.lastMs = it->requested.nsecsElapsed()/1e6;
+    latency.sessions++;
+    if(it->fromStandby)
+        latency.standby++;
+    latency.meanMs += (latency.lastMs - latency.meanMs)/latency.sessions;
+    latency.maxMs = std::max(latency.maxMs, latency.lastMs);
+    qDebug()<<Q_FUNC_INFO<<name<<(it->fromStandby ? "standby" : "cold")<<"start to ready:"<<latency.lastMs<<"ms";
+}
+void pluginPool::release(const QString& name){
+    QMap<QString, standby>::iterator it = m_plugins.find(name);
+    if(it == m_plugins.end() || it->state != STANDBY_BUSY)
+        return;
+    it->state = STANDBY_NONE;
+    refill(name);
+}
+void pluginPool::refill(const QString& name){
+    //Wait for the old process to go (it quits by DBus, the supervisor kills it otherwise)
+    QTimer::singleShot(STANDBY_REFILL_MS, m_context, [this, name](){
+        if(m_shutdown)
+            return;
+        if(alive(name))
+            refill(name);
+        else
+            warm(name);
+    });
+}
+void pluginPool::stopStandby(const QString& name){
+    QMap<QString, standby>::iterator it = m_plugins.find(name);
+    if(it == m_plugins.end())
+        return;
+    //Idle: no session to finish, no grace period
+    processSupervisor::instance().stop(name.toStdString(), 0);
+    it->state = STANDBY_NONE;
+}
+void pluginPool::shutdown(){
+    m_shutdown = true;
+    for(QMap<QString, standby>::iterator it=m_plugins.begin();it!=m_plugins.end();++it)
+        if(it->state == STANDBY_READY || it->state == STANDBY_STARTING)
+            stopStandby(it.key());
+}
@@ -0,0 +1,91 @@
+#ifndef PLUGINPOOL_H
+#define PLUGINPOOL_H
+
+#include <QObject>
+#include <QString>
+#include <QMap>
+#include <QElapsedTimer>
+#include <vector>
+#include <string>
+
+#include "processsupervisor.h"
+
+/* Plugins launched before they are needed.
+ * Starting bgPupilDetection or bgImageWriter when the user presses start costs the process
+ * start, the DBus registration and the shared memory mapping. The pool keeps one set of each
+ * standby plugin running between sessions: a session takes the idle one (acquire) and, when
+ * the session shuts it down (release), a new one is launched in the background once the old
+ * process is gone.
+ * The plugins take the frame rate as argument, so a standby plugin only serves sessions of
+ * its rate. Nothing is launched until a rate is known: the one of the capturer (setRate, from
+ * its statusChangedDBus) or of the first session; the rate of the last session is used for the
+ * next refill.
+ * The time from a session asking for a plugin to its readiness signal is kept per plugin
+ * (latency()), so standby and cold starts can be compared.
+ * GUI thread only. The processes themselves are run by processSupervisor.*/
+#define STANDBY_REFILL_MS   200
+
+struct standbyLatency{
+    unsigned int sessions = 0;      //Readiness signals measured
+    unsigned int standby = 0;       //Of them, served by a standby plugin
+    double lastMs = 0;
+    double meanMs = 0;
+    double maxMs = 0;
+};
+
+enum standbyState{
+    STANDBY_NONE = 0,       //Not launched (or refill pending)
+    STANDBY_STARTING = 1,   //Launched, readiness signal not received yet
+    STANDBY_READY = 2,      //Idle
+    STANDBY_BUSY = 3        //Serving a session
+};
+
+class pluginPool{
+public:
+    //Refills are timers of context (GUI thread); they die with it
+    explicit pluginPool(QObject* context);
+    //instances: arguments before the rate of each process (bgImageWriter: "0" and "1").
+    //readyOnStart: the plugin sends no readiness signal (writers). fps 0: not launched until
+    //setRate() or the first session gives one
+    void setStandby(const QString& name, const std::vector<std::vector<std::string>>& instances, const pluginPolicy& policy, unsigned int fps, bool readyOnStart);
+    void warm(const QString& name);
+    void warmAll();
+    //Rate of the camera: idle standby plugins of another rate are launched again with this one
+    void setRate(unsigned int fps);
+    //Readiness signal of the plugin. True when it comes from a standby plugin nobody asked for yet
+    bool readied(const QString& name);
+    //STANDBY_READY or STANDBY_STARTING: the session has it (wait for the signal when starting).
+    //STANDBY_NONE: not pooled or of another rate, the caller starts one; call launched() then
+    standbyState acquire(const QString& name, unsigned int fps);
+    void launched(const QString& name, unsigned int fps);
+    //Readiness signal of the plugin a session asked for (not a standby one: see readied())
+    void ready(const QString& name);
+    standbyLatency latency(const QString& name) const {return m_plugins.value(name).latency;}
+    //The session shut the plugin down: refill
+    void release(const QString& name);
+    //No more refills; standby plugins are stopped
+    void shutdown();
+    bool pooled(const QString& name) const {return m_plugins.contains(name);}
+private:
+    struct standby{
+        std::vector<std::vector<std::string>> instances;
+        pluginPolicy policy;
+        unsigned int fps = 0;
+        bool readyOnStart = false;
+        standbyState state = STANDBY_NONE;
+        QElapsedTimer requested;        //Since acquire(), while waiting for ready()
+        bool waiting = false;
+        bool fromStandby = false;
+        standbyLatency latency;
+    };
+    bool launch(const QString& name, standby& plugin);
+    void stopStandby(const QString& name);
+    void refill(const QString& name);
+    bool alive(const QString& name) const;
+
+    QObject* m_context;
+    QMap<QString, standby> m_plugins;
+    bool m_shutdown;
+};
+
+#endif // PLUGINPOOL_H
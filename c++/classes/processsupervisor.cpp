@@ -0,0 +1,308 @@
+#include "processsupervisor.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+extern char** environ;
+
+processSupervisor& processSupervisor::instance(){
+    static processSupervisor supervisor;
+    return supervisor;
+}
+processSupervisor::processSupervisor() : m_running(true){
+    m_thread = std::thread(&processSupervisor::monitor, this);
+}
+processSupervisor::~processSupervisor(){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+}
+std::vector<int> processSupervisor::parseCores(const std::string& cores){
+    std::vector<int> list;
+    std::stringstream ss(cores);
+    std::string item;
+    while(std::getline(ss, item, ',')){
+        int first, last;
+        if(std::sscanf(item.c_str(), "%d-%d", &first, &last) == 2){
+            for(int c=first;c<=last;c++)
+                list.push_back(c);
+        }else if(std::sscanf(item.c_str(), "%d", &first) == 1){
+            list.push_back(first);
+        }
+    }
+    return list;
+}
+std::string processSupervisor::key(const std::string& name, const std::vector<std::string>& args){
+    std::string k = name;
+    for(std::size_t i=0;i<args.size();i++)
+        k += " " + args[i];
+    return k;
+}
+pid_t processSupervisor::spawn(const std::string& name, const std::vector<std::string>& args, const pluginPolicy& policy){
+    const std::string path = "./" + name;
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(path.c_str()));
+    for(std::size_t i=0;i<args.size();i++)
+        argv.push_back(const_cast<char*>(args[i].c_str()));
+    argv.push_back(NULL);
+
+    pid_t pid = 0;
+    int error = 0;
+    //Affinity and nice belong to the calling thread and are inherited by the child: a short
+    //lived thread takes them, so neither the GUI nor the monitor change theirs
+    std::thread spawner([&](){
+        if(!policy.cores.empty()){
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for(std::size_t i=0;i<policy.cores.size();i++)
+                if(policy.cores[i] >= 0 && policy.cores[i] < CPU_SETSIZE)
+                    CPU_SET(policy.cores[i], &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+        if(policy.nice != 0)
+            setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), policy.nice);
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        //Signals blocked by Qt or node threads must not reach the plugin
+        sigset_t mask;
+        sigemptyset(&mask);
+        posix_spawnattr_setsigmask(&attr, &mask);
+        short flags = POSIX_SPAWN_SETSIGMASK;
+        if(policy.fifoPriority > 0){
+            sched_param param;
+            param.sched_priority = policy.fifoPriority;
+            posix_spawnattr_setschedpolicy(&attr, SCHED_FIFO);
+            posix_spawnattr_setschedparam(&attr, &param);
+            flags |= POSIX_SPAWN_SETSCHEDULER;
+        }
+        posix_spawnattr_setflags(&attr, flags);
+        error = posix_spawn(&pid, path.c_str(), NULL, &attr, argv.data(), environ);
+        if(error == EPERM && policy.fifoPriority > 0){
+            //Without CAP_SYS_NICE: normal policy rather than no plugin
+            posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+            error = posix_spawn(&pid, path.c_str(), NULL, &attr, argv.data(), environ);
+        }
+        posix_spawnattr_destroy(&attr);
+        //posix_spawn has no attribute for resource limits, and setrlimit here would limit the
+        //GUI too: the limit is set on the child. A plugin that cannot be limited is not left running
+        if(error == 0 && policy.memoryLimit > 0){
+            rlimit limit;
+            limit.rlim_cur = limit.rlim_max = policy.memoryLimit;
+            if(prlimit(pid, RLIMIT_AS, &limit, NULL) != 0){
+                error = errno;
+                kill(pid, SIGKILL);
+                waitpid(pid, NULL, 0);
+                pid = 0;
+            }
+        }
+    });
+    spawner.join();
+    if(error != 0){
+        m_errorMsg = "ERROR 01: processSupervisor - " + path + ": " + strerror(error);
+        return 0;
+    }
+    return pid;
+}
+bool processSupervisor::start(const std::string& name, const std::vector<std::string>& args, const pluginPolicy& policy){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const std::string k = key(name, args);
+    std::map<std::string, plugin>::iterator it = m_plugins.find(k);
+    if(it != m_plugins.end() && it->second.stats.pid != 0 && !it->second.stopping)
+        return true;                //Already running
+    if(it != m_plugins.end() && it->second.stats.pid != 0){
+        m_errorMsg = "ERROR 02: processSupervisor - " + k + " is still stopping";
+        return false;
+    }
+    plugin p;
+    p.stats.name = name;
+    p.stats.args = args;
+    p.policy = policy;
+    p.stats.pid = spawn(name, args, policy);
+    p.started = p.sampled = clock::now();
+    p.probe = p.started + std::chrono::milliseconds(SUPERVISOR_PROBE_MS);
+    if(p.stats.pid == 0 && policy.restart)
+        p.deadline = p.started + std::chrono::milliseconds(p.backoffMs);
+    m_plugins[k] = p;
+    m_wake.notify_all();
+    return p.stats.pid != 0;
+}
+void processSupervisor::stop(const std::string& name, int graceMs){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const clock::time_point deadline = clock::now() + std::chrono::milliseconds(graceMs);
+    for(std::map<std::string, plugin>::iterator it=m_plugins.begin();it!=m_plugins.end();++it){
+        if(it->second.stats.name != name || it->second.stopping)
+            continue;
+        it->second.stopping = true;
+        it->second.deadline = deadline;
+    }
+    m_wake.notify_all();
+}
+void processSupervisor::stopAll(){
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(std::map<std::string, plugin>::const_iterator it=m_plugins.begin();it!=m_plugins.end();++it)
+            names.push_back(it->second.stats.name);
+    }
+    for(std::size_t i=0;i<names.size();i++)
+        stop(names[i]);
+}
+bool processSupervisor::isRunning(const std::string& name) const{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(std::map<std::string, plugin>::const_iterator it=m_plugins.begin();it!=m_plugins.end();++it)
+        if(it->second.stats.name == name && it->second.stats.pid != 0 && !it->second.stopping)
+            return true;
+    return false;
+}
+std::vector<pluginStats> processSupervisor::stats() const{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<pluginStats> list;
+    for(std::map<std::string, plugin>::const_iterator it=m_plugins.begin();it!=m_plugins.end();++it)
+        list.push_back(it->second.stats);
+    return list;
+}
+std::string processSupervisor::getLastError() const{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_errorMsg;
+}
+long long processSupervisor::cpuTicks(pid_t pid){
+    //utime and stime: fields 14 and 15, after the command name (which may hold spaces)
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if(!std::getline(stat, line))
+        return -1;
+    std::size_t close = line.rfind(')');
+    if(close == std::string::npos)
+        return -1;
+    std::istringstream fields(line.substr(close + 2));
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+    for(int i=3;i<=15 && fields>>field;i++){
+        if(i == 14) utime = std::stoull(field);
+        if(i == 15) stime = std::stoull(field);
+    }
+    return (long long)(utime + stime);
+}
+void processSupervisor::sample(plugin& p, clock::time_point now){
+    const long long ticks = cpuTicks(p.stats.pid);
+    if(ticks < 0)
+        return;
+    const double seconds = std::chrono::duration<double>(now - p.sampled).count();
+    if(p.cpuTicks != 0 && seconds > 0)
+        p.stats.cpu = 100.0*(ticks - p.cpuTicks)/sysconf(_SC_CLK_TCK)/seconds;
+    p.cpuTicks = ticks;
+    p.sampled = now;
+    std::ifstream statm("/proc/" + std::to_string(p.stats.pid) + "/statm");
+    std::size_t size, resident;
+    if(statm>>size>>resident)
+        p.stats.rss = resident*(std::size_t)sysconf(_SC_PAGESIZE);
+}
+void processSupervisor::reap(plugin& p, clock::time_point now){
+    if(p.stats.pid == 0)
+        return;
+    int status = 0;
+    pid_t r = waitpid(p.stats.pid, &status, WNOHANG);
+    if(r == 0){
+        sample(p, now);
+        if(p.stopping && now >= p.deadline){
+            //Did not quit by DBus: SIGTERM, and SIGKILL one grace period later
+            kill(p.stats.pid, p.terminated ? SIGKILL : SIGTERM);
+            p.terminated = true;
+            p.deadline = now + std::chrono::milliseconds(SUPERVISOR_GRACE_MS);
+        }
+        return;
+    }
+    //Exited (or reaped by someone else: r < 0)
+    p.stats.pid = 0;
+    p.stats.cpu = 0;
+    p.stats.rss = 0;
+    p.cpuTicks = 0;
+    p.stats.lastStatus = r > 0 ? status : 0;
+    const bool crashed = r > 0 && (WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) != 0));
+    if(p.stopping || !p.policy.restart || !crashed)
+        return;
+    if(now - p.started >= std::chrono::milliseconds(SUPERVISOR_STABLE_MS))
+        p.backoffMs = SUPERVISOR_BACKOFF_MIN_MS;
+    p.deadline = now + std::chrono::milliseconds(p.backoffMs);
+    p.backoffMs = std::min(2*p.backoffMs, SUPERVISOR_BACKOFF_MAX_MS);
+}
+void processSupervisor::monitor(){
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(m_running){
+        const clock::time_point now = clock::now();
+        std::map<std::string, plugin>::iterator it = m_plugins.begin();
+        while(it != m_plugins.end()){
+            plugin& p = it->second;
+            const bool wasRunning = p.stats.pid != 0;
+            reap(p, now);
+            if(p.stats.pid == 0 && p.stopping){
+                it = m_plugins.erase(it);
+                continue;
+            }
+            //Waiting for its restart
+            if(p.stats.pid == 0 && !wasRunning && p.policy.restart && p.deadline != clock::time_point() && now >= p.deadline){
+                p.stats.pid = spawn(p.stats.name, p.stats.args, p.policy);
+                p.stats.restarts++;
+                p.started = p.sampled = now;
+                p.probe = now + std::chrono::milliseconds(SUPERVISOR_PROBE_MS);
+                p.misses = 0;
+                p.deadline = p.stats.pid != 0 ? clock::time_point() : now + std::chrono::milliseconds(p.backoffMs);
+            }
+            ++it;
+        }
+        probe(lock, now);
+        m_wake.wait_for(lock, std::chrono::milliseconds(SUPERVISOR_PERIOD_MS));
+    }
+}
+void processSupervisor::probe(std::unique_lock<std::mutex>& lock, clock::time_point now){
+    struct due{
+        std::string key;
+        pid_t pid;
+        std::function<bool()> alive;
+        bool answered;
+    };
+    std::vector<due> probes;
+    for(std::map<std::string, plugin>::iterator it=m_plugins.begin();it!=m_plugins.end();++it){
+        plugin& p = it->second;
+        if(!p.policy.alive || p.stats.pid == 0 || p.stopping || now < p.probe)
+            continue;
+        p.probe = now + std::chrono::milliseconds(SUPERVISOR_PROBE_MS);
+        probes.push_back({it->first, p.stats.pid, p.policy.alive, false});
+    }
+    if(probes.empty())
+        return;
+    //A probe may block (DBus timeout): start() and stop() must not wait for it
+    lock.unlock();
+    for(std::size_t i=0;i<probes.size();i++)
+        probes[i].answered = probes[i].alive();
+    lock.lock();
+    for(std::size_t i=0;i<probes.size();i++){
+        std::map<std::string, plugin>::iterator it = m_plugins.find(probes[i].key);
+        //Exited, restarted or stopped meanwhile: the answer is not about this instance
+        if(it == m_plugins.end() || it->second.stats.pid != probes[i].pid || it->second.stopping)
+            continue;
+        plugin& p = it->second;
+        p.misses = probes[i].answered ? 0 : p.misses + 1;
+        if(p.misses < SUPERVISOR_PROBE_MISSES)
+            continue;
+        //Hung: reap() sees a SIGKILL and restarts it as a crash
+        kill(p.stats.pid, SIGKILL);
+        p.stats.hangs++;
+        p.misses = 0;
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef PROCESSSUPERVISOR_H
+#define PROCESSSUPERVISOR_H
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Plugins (bgVideoCapturer, bgImageWriter, bgPupilDetection) as child processes of the GUI.
+ * They are started with posix_spawn, without the shell and the fork of the whole process that
+ * system("./plugin &") meant, and every instance is watched by one monitor thread:
+ * - an instance that dies (signal or exit code != 0) is started again, waiting 250 ms, 500 ms...
+ *   up to 30 s between attempts; the wait is reset once it stays up for a minute.
+ * - with a liveness probe (pluginPolicy::alive, e.g. a DBus ping), an instance that is still
+ *   there but fails 3 probes in a row is killed, and restarted as a crashed one. Without it,
+ *   only the exit of the process is seen.
+ * - stop() leaves the plugin a grace period (it is asked to quit by DBus first), then SIGTERM
+ *   and SIGKILL.
+ * - CPU (% of one core) and RSS are sampled from /proc.
+ * The policy is applied at spawn time: CPU affinity and nice through the spawning thread, which
+ * the child inherits, SCHED_FIFO through posix_spawnattr. Resource limits belong to the whole
+ * process, not to the thread: RLIMIT_AS is set on the child with prlimit right after
+ * posix_spawn. The plugin may start before it is set; what it maps afterwards is limited.*/
+#define SUPERVISOR_PERIOD_MS        250
+#define SUPERVISOR_BACKOFF_MIN_MS   250
+#define SUPERVISOR_BACKOFF_MAX_MS   30000
+#define SUPERVISOR_STABLE_MS        60000
+#define SUPERVISOR_GRACE_MS         3000
+#define SUPERVISOR_PROBE_MS         2000        //Between liveness probes; also the startup grace
+#define SUPERVISOR_PROBE_MISSES     3
+
+struct pluginPolicy{
+    std::vector<int> cores;         //Empty: any core
+    int nice = 0;
+    int fifoPriority = 0;           //> 0: SCHED_FIFO with this priority (needs CAP_SYS_NICE)
+    std::size_t memoryLimit = 0;    //Bytes of address space, 0: no limit
+    bool restart = true;
+    //Called from the monitor thread, without the supervisor's lock. Empty: no probe
+    std::function<bool()> alive;
+};
+struct pluginStats{
+    std::string name;
+    std::vector<std::string> args;
+    pid_t pid = 0;                  //0: not running (waiting for a restart or stopped)
+    unsigned int restarts = 0;
+    unsigned int hangs = 0;         //Killed after failing the liveness probe
+    double cpu = 0;                 //% of one core in the last period
+    std::size_t rss = 0;            //Bytes
+    int lastStatus = 0;             //waitpid status of the last exit
+};
+
+class processSupervisor{
+public:
+    static processSupervisor& instance();
+    //"1", "0-3", "2,3" (the cores argument of serviceSlot)
+    static std::vector<int> parseCores(const std::string& cores);
+    //A second instance of the same name needs other arguments (bgImageWriter 0 / 1)
+    bool start(const std::string& name, const std::vector<std::string>& args, const pluginPolicy& policy);
+    //Every instance of name; returns at once, the monitor kills what is left after graceMs
+    void stop(const std::string& name, int graceMs = SUPERVISOR_GRACE_MS);
+    void stopAll();
+    bool isRunning(const std::string& name) const;
+    std::vector<pluginStats> stats() const;
+    std::string getLastError() const;
+    //User + system CPU time of a process in clock ticks (/proc/<pid>/stat), -1 if it is not there
+    static long long cpuTicks(pid_t pid);
+private:
+    typedef std::chrono::steady_clock clock;
+    struct plugin{
+        pluginStats stats;
+        pluginPolicy policy;
+        bool stopping = false;
+        clock::time_point deadline;     //Of the restart or of the grace period
+        clock::time_point started;
+        int backoffMs = SUPERVISOR_BACKOFF_MIN_MS;
+        bool terminated = false;        //SIGTERM already sent
+        unsigned long long cpuTicks = 0;
+        clock::time_point sampled;
+        clock::time_point probe;        //Next liveness probe
+        int misses = 0;
+    };
+    processSupervisor();
+    ~processSupervisor();
+    processSupervisor(const processSupervisor&);
+    processSupervisor& operator=(const processSupervisor&);
+    static std::string key(const std::string& name, const std::vector<std::string>& args);
+    pid_t spawn(const std::string& name, const std::vector<std::string>& args, const pluginPolicy& policy);
+    void monitor();
+    void reap(plugin& p, clock::time_point now);
+    void sample(plugin& p, clock::time_point now);
+    void probe(std::unique_lock<std::mutex>& lock, clock::time_point now);
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::map<std::string, plugin> m_plugins;
+    std::thread m_thread;
+    bool m_running;
+    std::string m_errorMsg;
+};
+
+#endif // PROCESSSUPERVISOR_H
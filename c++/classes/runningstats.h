@@ -0,0 +1,25 @@
+#ifndef RUNNINGSTATS_H
+#define RUNNINGSTATS_H
+
+#include <cmath>
+#include <cstdint>
+
+/* Mean, sample standard deviation and maximum of a series, one value at a time (Welford): no
+ * values kept, no loss of precision on long runs. Latencies, jitter and render times.*/
+struct runningStats{
+    uint64_t count = 0;
+    double mean = 0;
+    double m2 = 0;
+    double max = 0;             //0 until a value is added
+    void add(double value){
+        count++;
+        const double delta = value - mean;
+        mean += delta/count;
+        m2 += delta*(value - mean);
+        if(count == 1 || value > max)
+            max = value;
+    }
+    double std() const {return count > 1 ? std::sqrt(m2/(count - 1)) : 0;}
+};
+
+#endif // RUNNINGSTATS_H
@@ -0,0 +1,80 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/* Sequence lock for records shared between processes.
+ * One writer, any number of readers and no locks: the writer makes the counter odd while it
+ * writes and even when it is done. A reader copies the record and keeps the copy only if the
+ * counter was even and did not change meanwhile. Readers never write, so they can map the
+ * segment read only.
+ *
+ *  Writer                                  Reader
+ *  seqlockWriteBegin(seq);                 do{
+ *  ... write record ...                        s = seqlockReadBegin(seq);
+ *  seqlockWriteEnd(seq);                       ... copy record ...
+ *                                          }while(seqlockReadRetry(seq, s));
+ *
+ * Rings built on it (framering.h, gazering.h) also share how readers sleep: a 32 bit word in the
+ * segment that the writer bumps, and a shared futex on it (not FUTEX_PRIVATE_FLAG: writer and
+ * readers are different processes). Their timestamps are monotonicUs().
+ */
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Shared memory counters must be lock free");
+
+typedef std::atomic<uint64_t> seqCounter;
+
+inline void seqlockWriteBegin(seqCounter& seq){
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+inline void seqlockWriteEnd(seqCounter& seq){
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+//Odd values mean that a write is in progress
+inline uint64_t seqlockReadBegin(const seqCounter& seq){
+    return seq.load(std::memory_order_acquire);
+}
+inline bool seqlockReadRetry(const seqCounter& seq, uint64_t begin){
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return (begin & 1) || seq.load(std::memory_order_relaxed) != begin;
+}
+
+static_assert(sizeof(std::atomic<uint32_t>) == 4 && ATOMIC_INT_LOCK_FREE == 2, "The futex word must be a plain 32 bit integer");
+
+//Microseconds of CLOCK_MONOTONIC, the same in every process
+inline int64_t monotonicUs(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+//Writer: after the record is published
+inline void sharedFutexWake(std::atomic<uint32_t>& word){
+    word.fetch_add(1, std::memory_order_release);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+//Reader: until ready() or timeoutMs. The word is loaded before ready() is checked, so a wake
+//between the two makes FUTEX_WAIT return at once
+template<typename Ready>
+bool sharedFutexWait(const std::atomic<uint32_t>& word, int timeoutMs, Ready ready){
+    const int64_t deadline = monotonicUs() + (int64_t)timeoutMs*1000;
+    for(;;){
+        const uint32_t value = word.load(std::memory_order_acquire);
+        if(ready())
+            return true;
+        const int64_t left = deadline - monotonicUs();
+        if(left <= 0)
+            return false;
+        struct timespec timeout;
+        timeout.tv_sec = left/1000000;
+        timeout.tv_nsec = (left%1000000)*1000;
+        syscall(SYS_futex, reinterpret_cast<const uint32_t*>(&word), FUTEX_WAIT, value, &timeout, NULL, 0);
+    }
+}
+
+#endif // SEQLOCK_H
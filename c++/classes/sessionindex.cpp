@@ -0,0 +1,165 @@
+#include "sessionindex.h"
+
+#include <QDir>
+#include <QFile>
+#include <QSettings>
+#include <QDateTime>
+#include <QDebug>
+
+#include <tbb/parallel_for.h>
+
+//openCV
+#include <opencv2/videoio.hpp>
+
+unsigned int sessionEntry::frames() const{
+    const QString test = directory.split("/").last();
+    unsigned int total = 0;
+    for(const aviIndex& avi : avis){
+        if(avi.name == test + "_0.avi" || avi.name == test + "_1.avi")
+            total += avi.frames;
+    }
+    return total;
+}
+
+sessionIndex& sessionIndex::instance(){
+    static sessionIndex index;
+    return index;
+}
+QFileInfoList sessionIndex::videos(const QString& directory){
+    return QDir(directory + "/raw").entryInfoList(QStringList("*.avi"), QDir::Files, QDir::Name);
+}
+bool sessionIndex::current(const sessionEntry& entry){
+    //A stat per video: the files were not added, removed or rewritten since they were probed
+    const QFileInfoList files = videos(entry.directory);
+    if(files.size() != entry.avis.size())
+        return false;
+    for(int i=0;i<files.size();i++){
+        const aviIndex& avi = entry.avis.at(i);
+        if(files.at(i).fileName() != avi.name || files.at(i).size() != avi.bytes || files.at(i).lastModified().toMSecsSinceEpoch() != avi.modified)
+            return false;
+    }
+    return true;
+}
+bool sessionIndex::load(const QString& directory, sessionEntry& entry){
+    const QString path = directory + "/" + SESSION_INDEX_FILE;
+    if(!QFile::exists(path))
+        return false;
+    QSettings sidecar(path, QSettings::IniFormat);
+    if(sidecar.value("index/version", 0).toInt() != SESSION_INDEX_VERSION)
+        return false;
+    entry.directory = directory;
+    entry.avis.clear();
+    const int size = sidecar.beginReadArray("avi");
+    for(int i=0;i<size;i++){
+        sidecar.setArrayIndex(i);
+        aviIndex avi;
+        avi.name = sidecar.value("name").toString();
+        avi.bytes = sidecar.value("bytes").toLongLong();
+        avi.modified = sidecar.value("modified").toLongLong();
+        avi.frames = sidecar.value("frames").toInt();
+        avi.width = sidecar.value("width").toInt();
+        avi.height = sidecar.value("height").toInt();
+        avi.fps = sidecar.value("fps").toDouble();
+        avi.duration = sidecar.value("duration").toDouble();
+        avi.readable = sidecar.value("readable").toBool();
+        entry.avis.push_back(avi);
+    }
+    sidecar.endArray();
+    return current(entry);
+}
+bool sessionIndex::save(const sessionEntry& entry){
+    //Deleted test: no sidecar (QSettings would create the directory again)
+    if(!QDir(entry.directory).exists())
+        return false;
+    QSettings sidecar(entry.directory + "/" + SESSION_INDEX_FILE, QSettings::IniFormat);
+    sidecar.clear();
+    sidecar.setValue("index/version", SESSION_INDEX_VERSION);
+    sidecar.beginWriteArray("avi", entry.avis.size());
+    for(int i=0;i<entry.avis.size();i++){
+        const aviIndex& avi = entry.avis.at(i);
+        sidecar.setArrayIndex(i);
+        sidecar.setValue("name", avi.name);
+        sidecar.setValue("bytes", avi.bytes);
+        sidecar.setValue("modified", avi.modified);
+        sidecar.setValue("frames", avi.frames);
+        sidecar.setValue("width", avi.width);
+        sidecar.setValue("height", avi.height);
+        sidecar.setValue("fps", avi.fps);
+        sidecar.setValue("duration", avi.duration);
+        sidecar.setValue("readable", avi.readable);
+    }
+    sidecar.endArray();
+    sidecar.sync();
+    return sidecar.status() == QSettings::NoError;
+}
+void sessionIndex::probe(const QFileInfo& file, aviIndex& avi){
+    avi.name = file.fileName();
+    avi.bytes = file.size();
+    avi.modified = file.lastModified().toMSecsSinceEpoch();
+    cv::VideoCapture vc(file.absoluteFilePath().toLatin1().data());
+    avi.readable = vc.isOpened();
+    if(!avi.readable)
+        return;
+    avi.frames = (int)vc.get(cv::CAP_PROP_FRAME_COUNT);
+    avi.width = (int)vc.get(cv::CAP_PROP_FRAME_WIDTH);
+    avi.height = (int)vc.get(cv::CAP_PROP_FRAME_HEIGHT);
+    avi.fps = vc.get(cv::CAP_PROP_FPS);
+    avi.duration = avi.fps > 0 ? avi.frames/avi.fps : 0;
+}
+sessionEntry sessionIndex::build(const QString& directory){
+    sessionEntry entry;
+    entry.directory = directory;
+    const QFileInfoList files = videos(directory);
+    entry.avis.resize(files.size());
+    for(int i=0;i<files.size();i++)
+        probe(files.at(i), entry.avis[i]);
+    return entry;
+}
+QSharedPointer<QMutex> sessionIndex::directoryLock(const QString& directory){
+    QMutexLocker locker(&m_mutex);
+    QSharedPointer<QMutex>& lock = m_locks[directory];
+    if(lock.isNull())
+        lock = QSharedPointer<QMutex>(new QMutex());
+    return lock;
+}
+bool sessionIndex::write(const QString& directory){
+    QSharedPointer<QMutex> lock = directoryLock(directory);
+    QMutexLocker directoryLocker(lock.data());
+    sessionEntry entry = build(directory);
+    bool saved = save(entry);
+    if(!saved)
+        qDebug()<<Q_FUNC_INFO<<" sidecar not written: "<<directory;
+    QMutexLocker locker(&m_mutex);
+    m_cache.insert(directory, entry);
+    return saved;
+}
+sessionEntry sessionIndex::lookup(const QString& directory){
+    return lookup(QStringList(directory)).first();
+}
+QVector<sessionEntry> sessionIndex::lookup(const QStringList& directories){
+    QVector<sessionEntry> entries(directories.size());
+    {
+        QMutexLocker locker(&m_mutex);
+        for(int i=0;i<directories.size();i++)
+            entries[i] = m_cache.value(directories.at(i));
+    }
+    //Cached entries only cost the stats; the rest read the sidecar or probe the videos
+    tbb::parallel_for(0, directories.size(), [&](int i){
+        if(!entries[i].directory.isEmpty() && current(entries[i]))
+            return;
+        //A write() of the same directory may be running: the sidecar it saves is read here
+        QSharedPointer<QMutex> lock = directoryLock(directories.at(i));
+        QMutexLocker directoryLocker(lock.data());
+        if(!load(directories.at(i), entries[i])){
+            entries[i] = build(directories.at(i));
+            save(entries[i]);
+        }
+        QMutexLocker locker(&m_mutex);
+        m_cache.insert(directories.at(i), entries[i]);
+    });
+    return entries;
+}
+void sessionIndex::invalidate(const QString& directory){
+    QMutexLocker locker(&m_mutex);
+    m_cache.remove(directory);
+}
@@ -0,0 +1,67 @@
+#ifndef SESSIONINDEX_H
+#define SESSIONINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QMutex>
+#include <QFileInfo>
+#include <QSharedPointer>
+
+#define SESSION_INDEX_FILE      "index.ini"
+#define SESSION_INDEX_VERSION   1
+
+/* Index of the videos of a test directory.
+ * Counting frames with cv::VideoCapture opens every AVI of the processing queue; the index keeps
+ * what processQueue() and processReady() need (frame count, geometry, fps, duration, whether it
+ * opens) in a sidecar next to camera.ini, written when the test has been recorded.
+ * A sidecar (or cached entry) is trusted while the size and modification time of every AVI
+ * still match; otherwise the videos of that directory are probed again. Missing directories
+ * are probed in parallel.
+ * Probing and writing a directory hold its own lock: the writer at the end of a recording and a
+ * lookup from processQueue() never save the same sidecar at once.*/
+struct aviIndex{
+    QString name;                   //File name in raw/
+    qint64 bytes = 0;
+    qint64 modified = 0;            //ms since epoch
+    int frames = 0;
+    int width = 0;
+    int height = 0;
+    double fps = 0;
+    double duration = 0;            //s
+    bool readable = false;          //cv::VideoCapture opens it
+};
+struct sessionEntry{
+    QString directory;
+    QVector<aviIndex> avis;
+    //Frames of <test>_0.avi and <test>_1.avi, the ones bgPupilDetection processes
+    unsigned int frames() const;
+};
+
+class sessionIndex{
+public:
+    static sessionIndex& instance();
+    //Probes the videos and writes the sidecar
+    bool write(const QString& directory);
+    sessionEntry lookup(const QString& directory);
+    QVector<sessionEntry> lookup(const QStringList& directories);
+    void invalidate(const QString& directory);
+private:
+    sessionIndex(){}
+    sessionIndex(const sessionIndex&);
+    sessionIndex& operator=(const sessionIndex&);
+    static QFileInfoList videos(const QString& directory);
+    static bool current(const sessionEntry& entry);
+    static bool load(const QString& directory, sessionEntry& entry);
+    static bool save(const sessionEntry& entry);
+    static sessionEntry build(const QString& directory);
+    static void probe(const QFileInfo& file, aviIndex& avi);
+    QSharedPointer<QMutex> directoryLock(const QString& directory);
+
+    QMutex m_mutex;                 //m_cache and m_locks
+    QHash<QString, sessionEntry> m_cache;
+    QHash<QString, QSharedPointer<QMutex> > m_locks;
+};
+
+#endif // SESSIONINDEX_H
@@ -0,0 +1,199 @@
+#include "shmregistry.h"
+
+#include <cerrno>
+#include <cstring>
+#include <signal.h>
+#include <unistd.h>
+
+using namespace boost::interprocess;
+
+static void copyName(char* dst, const char* src, std::size_t size){
+    std::strncpy(dst, src, size - 1);
+    dst[size - 1] = '\0';
+}
+
+shmRegistry& shmRegistry::instance(){
+    static shmRegistry registry;
+    return registry;
+}
+shmRegistry::shmRegistry() : m_header(NULL){
+    open();
+}
+bool shmRegistry::open(){
+    try{
+        //ftruncate fills with zeros: every entry starts free
+        shared_memory_object shm(open_or_create, SHM_REGISTRY_NAME, read_write);
+        offset_t size = 0;
+        if(!shm.get_size(size) || size < (offset_t)sizeof(shmRegistryHeader))
+            shm.truncate(sizeof(shmRegistryHeader));
+        mapped_region region(shm, read_write);
+        m_region.swap(region);
+    }catch(interprocess_exception& e){
+        m_errorMsg = std::string("ERROR 01: shmRegistry - ") + e.what();
+        return false;
+    }
+    shmRegistryHeader* header = static_cast<shmRegistryHeader*>(m_region.get_address());
+    uint32_t expected = 0;
+    header->magic.compare_exchange_strong(expected, SHM_REGISTRY_MAGIC);
+    if(header->magic.load() != SHM_REGISTRY_MAGIC){
+        m_errorMsg = "ERROR 02: shmRegistry - Unknown registry layout";
+        mapped_region().swap(m_region);
+        return false;
+    }
+    m_header = header;
+    return true;
+}
+bool shmRegistry::alive(int32_t pid){
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+bool shmRegistry::read(const shmRegistryEntry& entry, streamDescriptor& desc) const{
+    for(int attempt=0;attempt<16;attempt++){
+        if(entry.owner.load(std::memory_order_acquire) == 0)
+            return false;
+        uint64_t s = seqlockReadBegin(entry.seq);
+        std::memcpy(&desc, &entry.desc, sizeof(streamDescriptor));
+        if(!seqlockReadRetry(entry.seq, s))
+            return desc.stream[0] != '\0';
+    }
+    return false;
+}
+void shmRegistry::write(shmRegistryEntry& entry, const streamDescriptor& desc){
+    seqlockWriteBegin(entry.seq);
+    std::memcpy(&entry.desc, &desc, sizeof(streamDescriptor));
+    seqlockWriteEnd(entry.seq);
+}
+uint64_t shmRegistry::publish(const char* stream, const char* segment, shmKind kind, uint32_t width, uint32_t height, uint32_t format, uint32_t slots){
+    if(m_header == NULL)
+        return 0;
+    const int32_t pid = getpid();
+    streamDescriptor desc;
+    std::memset(&desc, 0, sizeof(desc));
+    copyName(desc.stream, stream, SHM_STREAM_LEN);
+    copyName(desc.segment, segment, SHM_SEGMENT_LEN);
+    desc.kind = kind;
+    desc.width = width;
+    desc.height = height;
+    desc.format = format;
+    desc.slots = slots;
+    desc.pid = pid;
+    desc.generation = m_header->generation.fetch_add(1) + 1;
+    shmRegistryEntry* target = NULL;
+    streamDescriptor current;
+    //Same stream: ours, or left by a dead producer
+    for(int i=0;i<SHM_REGISTRY_ENTRIES && target == NULL;i++){
+        shmRegistryEntry& e = m_header->entries[i];
+        if(!read(e, current) || std::strncmp(current.stream, desc.stream, SHM_STREAM_LEN) != 0)
+            continue;
+        int32_t owner = e.owner.load();
+        if(owner == pid){
+            target = &e;
+        }else if(!alive(owner)){
+            if(e.owner.compare_exchange_strong(owner, pid)){
+                if(std::strncmp(current.segment, desc.segment, SHM_SEGMENT_LEN) != 0)
+                    shared_memory_object::remove(current.segment);
+                target = &e;
+            }
+        }else{
+            m_errorMsg = std::string("ERROR 03: shmRegistry - Stream ") + stream + " belongs to another process";
+            return 0;
+        }
+    }
+    for(int i=0;i<SHM_REGISTRY_ENTRIES && target == NULL;i++){
+        int32_t free = 0;
+        if(m_header->entries[i].owner.compare_exchange_strong(free, pid))
+            target = &m_header->entries[i];
+    }
+    if(target == NULL){
+        m_errorMsg = "ERROR 04: shmRegistry - No free entries";
+        return 0;
+    }
+    write(*target, desc);
+    return desc.generation;
+}
+void shmRegistry::withdraw(const char* stream){
+    if(m_header == NULL)
+        return;
+    const int32_t pid = getpid();
+    streamDescriptor current;
+    for(int i=0;i<SHM_REGISTRY_ENTRIES;i++){
+        shmRegistryEntry& e = m_header->entries[i];
+        if(e.owner.load() != pid || !read(e, current) || std::strncmp(current.stream, stream, SHM_STREAM_LEN) != 0)
+            continue;
+        std::memset(&current, 0, sizeof(current));
+        write(e, current);
+        e.owner.store(0, std::memory_order_release);
+    }
+}
+bool shmRegistry::find(const char* stream, streamDescriptor& desc) const{
+    if(m_header == NULL)
+        return false;
+    for(int i=0;i<SHM_REGISTRY_ENTRIES;i++){
+        if(read(m_header->entries[i], desc) && std::strncmp(desc.stream, stream, SHM_STREAM_LEN) == 0)
+            return true;
+    }
+    return false;
+}
+std::vector<streamDescriptor> shmRegistry::streams() const{
+    std::vector<streamDescriptor> list;
+    streamDescriptor desc;
+    for(int i=0;m_header && i<SHM_REGISTRY_ENTRIES;i++){
+        if(read(m_header->entries[i], desc))
+            list.push_back(desc);
+    }
+    return list;
+}
+int shmRegistry::cleanupStale(){
+    if(m_header == NULL)
+        return 0;
+    int removed = 0;
+    streamDescriptor current;
+    for(int i=0;i<SHM_REGISTRY_ENTRIES;i++){
+        shmRegistryEntry& e = m_header->entries[i];
+        int32_t owner = e.owner.load();
+        if(owner == 0 || alive(owner))
+            continue;
+        bool described = read(e, current);
+        //Only one process wins the entry; the others leave it alone
+        if(!e.owner.compare_exchange_strong(owner, getpid()))
+            continue;
+        if(described)
+            shared_memory_object::remove(current.segment);
+        std::memset(&current, 0, sizeof(current));
+        write(e, current);
+        e.owner.store(0, std::memory_order_release);
+        removed++;
+    }
+    return removed;
+}
+
+// ----------------------------------------------------------
+// shmMapping
+// ----------------------------------------------------------
+shmMapping::shmMapping() : m_width(0), m_height(0), m_format(0), m_generation(0){}
+bool shmMapping::map(const char* segment, uint32_t width, uint32_t height, uint32_t format, uint64_t generation){
+    if(isMapped() && m_segment == segment && m_width == width && m_height == height && m_format == format && m_generation == generation)
+        return true;
+    unmap();
+    try{
+        //The region stays valid after the shared_memory_object is closed
+        shared_memory_object shm(open_only, segment, read_only);
+        mapped_region region(shm, read_only);
+        m_region.swap(region);
+    }catch(interprocess_exception& e){
+        m_errorMsg = std::string("ERROR 01: shmMapping - ") + e.what();
+        return false;
+    }
+    m_segment = segment;
+    m_width = width;
+    m_height = height;
+    m_format = format;
+    m_generation = generation;
+    return true;
+}
+bool shmMapping::map(const streamDescriptor& desc){
+    return map(desc.segment, desc.width, desc.height, desc.format, desc.generation);
+}
+void shmMapping::unmap(){
+    mapped_region().swap(m_region);
+    m_segment.clear();
+}
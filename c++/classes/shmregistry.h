@@ -0,0 +1,104 @@
+#ifndef SHMREGISTRY_H
+#define SHMREGISTRY_H
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <string>
+#include <vector>
+#include "seqlock.h"
+
+/* Registry of the shared memory streams.
+ * Producers (capturer, one per camera or eye) describe the segment they created in a small
+ * descriptor segment; consumers look the stream up by name instead of assuming "m_shared".
+ * Every entry is written by its owner only, under a seqlock, and read without locks.
+ * generation changes every time a producer (re)creates its segment, so consumers know when
+ * their mapping is stale. Entries of dead producers are removed by cleanupStale().*/
+#define SHM_REGISTRY_NAME       "oscann_registry"
+#define SHM_REGISTRY_MAGIC      0x3152534f  //"OSR1"
+#define SHM_REGISTRY_ENTRIES    16
+#define SHM_STREAM_LEN          32
+#define SHM_SEGMENT_LEN         64
+
+#define CAMERA_STREAM           "camera"
+#define EYE_STREAM              "eye"
+
+enum shmKind{
+    SHM_RAW_FRAME = 0,      //One frame, no header ("m_shared")
+    SHM_FRAME_RING = 1,     //framering.h
+    SHM_GAZE_RING = 2       //gazering.h: slots is the capacity, no geometry
+};
+
+struct streamDescriptor{
+    char stream[SHM_STREAM_LEN];        //Logical name: "camera", "eye0", "eye1"...
+    char segment[SHM_SEGMENT_LEN];      //Shared memory object
+    uint32_t kind;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t slots;
+    int32_t pid;
+    uint64_t generation;
+};
+struct shmRegistryEntry{
+    std::atomic<int32_t> owner;         //Producer pid, 0 when free
+    seqCounter seq;
+    streamDescriptor desc;
+};
+struct shmRegistryHeader{
+    std::atomic<uint32_t> magic;
+    std::atomic<uint64_t> generation;
+    shmRegistryEntry entries[SHM_REGISTRY_ENTRIES];
+};
+
+class shmRegistry{
+public:
+    static shmRegistry& instance();
+    bool isOpen() const {return m_header != NULL;}
+    //Producer side
+    uint64_t publish(const char* stream, const char* segment, shmKind kind, uint32_t width, uint32_t height, uint32_t format, uint32_t slots);
+    void withdraw(const char* stream);
+    //Consumer side
+    bool find(const char* stream, streamDescriptor& desc) const;
+    std::vector<streamDescriptor> streams() const;
+    //Remove the segments and entries of producers that are not running anymore
+    int cleanupStale();
+    std::string getLastError(){return m_errorMsg;}
+private:
+    shmRegistry();
+    shmRegistry(const shmRegistry&);
+    shmRegistry& operator=(const shmRegistry&);
+    bool open();
+    bool read(const shmRegistryEntry& entry, streamDescriptor& desc) const;
+    void write(shmRegistryEntry& entry, const streamDescriptor& desc);
+    static bool alive(int32_t pid);
+    boost::interprocess::mapped_region m_region;
+    shmRegistryHeader* m_header;
+    std::string m_errorMsg;
+};
+
+/* Read only mapping of a whole segment, released with the object.
+ * map() does nothing when the segment, its geometry and its generation did not change.*/
+class shmMapping{
+public:
+    shmMapping();
+    bool map(const char* segment, uint32_t width, uint32_t height, uint32_t format, uint64_t generation = 0);
+    bool map(const streamDescriptor& desc);
+    void unmap();
+    bool isMapped() const {return m_region.get_address() != NULL;}
+    void* address() const {return m_region.get_address();}
+    std::size_t size() const {return m_region.get_size();}
+    std::string getLastError(){return m_errorMsg;}
+private:
+    shmMapping(const shmMapping&);
+    shmMapping& operator=(const shmMapping&);
+    boost::interprocess::mapped_region m_region;
+    std::string m_segment;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_format;
+    uint64_t m_generation;
+    std::string m_errorMsg;
+};
+
+#endif // SHMREGISTRY_H
@@ -0,0 +1,206 @@
+#include "streamsync.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+streamAligner::streamAligner(int streams, int64_t toleranceUs, int reference) :
+    m_streams(streams), m_reference(reference), m_tolerance(toleranceUs), m_maxLatency(500000), m_allowPartial(false){
+    reset();
+}
+void streamAligner::setCallback(std::function<void(const syncTuple&)> callback){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_callback = callback;
+}
+void streamAligner::setMaxLatency(int64_t us){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxLatency = us;
+}
+void streamAligner::setAllowPartial(bool value){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_allowPartial = value;
+}
+void streamAligner::setOffset(int stream, double offsetUs){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(stream >= 0 && stream < m_streams)
+        m_clocks[stream].offset = offsetUs;
+}
+void streamAligner::reset(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queues.assign(m_streams, std::deque<syncSample>());
+    clockFit fit;
+    fit.anchored = false;
+    fit.first = 0;
+    fit.sw = fit.sx = fit.sy = fit.sxx = fit.sxy = 0;
+    fit.offset = 0;
+    fit.drift = 0;
+    fit.pairs = 0;
+    m_clocks.assign(m_streams, fit);
+    m_newest.assign(m_streams, std::numeric_limits<int64_t>::min());
+    m_stats.tuples = 0;
+    m_stats.partial = 0;
+    m_stats.unmatched.assign(m_streams, 0);
+}
+double streamAligner::corrected(int stream, int64_t timestamp) const{
+    if(stream == m_reference)
+        return timestamp;
+    const clockFit& fit = m_clocks[stream];
+    return timestamp + fit.offset + fit.drift*((timestamp - fit.first)/1e6);
+}
+void streamAligner::updateClock(int stream, int64_t timestamp, int64_t reference){
+    clockFit& fit = m_clocks[stream];
+    const double x = (timestamp - fit.first)/1e6;
+    const double y = (double)(reference - timestamp);
+    fit.sw = SYNC_FORGETTING*fit.sw + 1;
+    fit.sx = SYNC_FORGETTING*fit.sx + x;
+    fit.sy = SYNC_FORGETTING*fit.sy + y;
+    fit.sxx = SYNC_FORGETTING*fit.sxx + x*x;
+    fit.sxy = SYNC_FORGETTING*fit.sxy + x*y;
+    fit.pairs++;
+    //Drift only once the pairs span some time; before that, offset alone
+    const double det = fit.sw*fit.sxx - fit.sx*fit.sx;
+    if(fit.pairs > 2 && det > 1e-6*fit.sw*fit.sw){
+        fit.drift = (fit.sw*fit.sxy - fit.sx*fit.sy)/det;
+        fit.offset = (fit.sy - fit.drift*fit.sx)/fit.sw;
+    }else{
+        fit.drift = 0;
+        fit.offset = fit.sy/fit.sw;
+    }
+}
+void streamAligner::push(int stream, uint64_t frameId, int64_t timestamp){
+    std::vector<syncTuple> ready;
+    std::function<void(const syncTuple&)> callback;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(stream < 0 || stream >= m_streams)
+            return;
+        clockFit& fit = m_clocks[stream];
+        if(!fit.anchored){
+            fit.anchored = true;
+            fit.first = timestamp;
+        }
+        syncSample sample;
+        sample.stream = stream;
+        sample.frameId = frameId;
+        sample.timestamp = timestamp;
+        std::deque<syncSample>& queue = m_queues[stream];
+        queue.push_back(sample);
+        if(queue.size() > SYNC_MAX_QUEUE){
+            queue.pop_front();
+            m_stats.unmatched[stream]++;
+        }
+        if(timestamp > m_newest[stream])
+            m_newest[stream] = timestamp;
+        process(false, ready);
+        callback = m_callback;
+    }
+    if(callback){
+        for(std::size_t i=0;i<ready.size();i++)
+            callback(ready[i]);
+    }
+}
+void streamAligner::flush(){
+    std::vector<syncTuple> ready;
+    std::function<void(const syncTuple&)> callback;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        process(true, ready);
+        callback = m_callback;
+    }
+    if(callback){
+        for(std::size_t i=0;i<ready.size();i++)
+            callback(ready[i]);
+    }
+}
+void streamAligner::process(bool flushing, std::vector<syncTuple>& ready){
+    std::deque<syncSample>& refQueue = m_queues[m_reference];
+    while(!refQueue.empty()){
+        const syncSample ref = refQueue.front();
+        const double t = ref.timestamp;
+        const bool expired = m_newest[m_reference] - ref.timestamp > m_maxLatency;
+        std::vector<int> best(m_streams, -1);
+        bool decided = true;
+        for(int s=0;s<m_streams && decided;s++){
+            if(s == m_reference)
+                continue;
+            std::deque<syncSample>& queue = m_queues[s];
+            //Too old for this reference frame, so for every later one too
+            while(!queue.empty() && corrected(s, queue.front().timestamp) < t - m_tolerance){
+                queue.pop_front();
+                m_stats.unmatched[s]++;
+            }
+            double bestErr = m_tolerance + 1.0;
+            bool later = false;
+            for(std::size_t i=0;i<queue.size();i++){
+                const double err = corrected(s, queue[i].timestamp) - t;
+                if(err > m_tolerance){
+                    later = true;
+                    break;
+                }
+                if(std::fabs(err) < bestErr){
+                    bestErr = std::fabs(err);
+                    best[s] = i;
+                }
+            }
+            if(!later && !flushing && !expired)
+                decided = false;            //A closer frame may still come
+        }
+        if(!decided)
+            break;
+        syncTuple tuple;
+        tuple.timestamp = ref.timestamp;
+        tuple.spread = 0;
+        tuple.complete = true;
+        tuple.samples.resize(m_streams);
+        for(int s=0;s<m_streams;s++){
+            syncSample& out = tuple.samples[s];
+            out.stream = s;
+            out.frameId = 0;
+            out.timestamp = 0;
+            if(s == m_reference){
+                out = ref;
+                continue;
+            }
+            if(best[s] < 0){
+                tuple.complete = false;
+                continue;
+            }
+            std::deque<syncSample>& queue = m_queues[s];
+            //The frames before the chosen one will never pair
+            m_stats.unmatched[s] += best[s];
+            out = queue[best[s]];
+            queue.erase(queue.begin(), queue.begin() + best[s] + 1);
+            const int64_t spread = std::llabs((int64_t)llround(corrected(s, out.timestamp) - t));
+            if(spread > tuple.spread)
+                tuple.spread = spread;
+            updateClock(s, out.timestamp, ref.timestamp);
+        }
+        refQueue.pop_front();
+        if(!tuple.complete){
+            m_stats.partial++;
+            if(!m_allowPartial){
+                m_stats.unmatched[m_reference]++;
+                continue;
+            }
+        }
+        m_stats.tuples++;
+        ready.push_back(tuple);
+    }
+}
+clockModel streamAligner::clock(int stream) const{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    clockModel model;
+    model.offsetUs = 0;
+    model.drift = 0;
+    model.pairs = 0;
+    if(stream >= 0 && stream < m_streams && stream != m_reference){
+        model.offsetUs = m_clocks[stream].offset;
+        model.drift = m_clocks[stream].drift;
+        model.pairs = m_clocks[stream].pairs;
+    }
+    return model;
+}
+syncStats streamAligner::stats() const{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
@@ -0,0 +1,87 @@
+#ifndef STREAMSYNC_H
+#define STREAMSYNC_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/* Time alignment of several frame streams (one per camera or eye).
+ * Producers push (stream, frameId, capture timestamp); every frame of the reference stream is
+ * paired with the closest frame of each other stream within the tolerance, and the tuple is given
+ * to the callback. A tuple is decided once every other stream has a frame later than
+ * reference + tolerance (nothing closer can come) or after maxLatency.
+ * The clock of every stream against the reference is estimated from the pairs themselves:
+ *      t_ref = t + offset + drift*(t - t_first)     (least squares with forgetting)
+ * so cameras with their own clocks, or a slow drift, still pair. The initial offset must be within
+ * the tolerance (same host clock, frameRingClock) or given with setOffset(). Use the slowest stream as the
+ * reference: every frame of the other streams is used at most once.
+ * push() may be called from any thread; the callback runs in the thread that pushed.*/
+#define SYNC_MAX_QUEUE      256         //Frames kept per stream while waiting
+#define SYNC_FORGETTING     0.995       //Weight of the previous pairs in the clock estimate
+
+struct syncSample{
+    int stream;
+    uint64_t frameId;                   //0: no frame of this stream in the tuple
+    int64_t timestamp;                  //Own clock of the stream, microseconds
+};
+struct syncTuple{
+    int64_t timestamp;                  //Reference clock
+    int64_t spread;                     //Largest |corrected timestamp - timestamp| in the tuple
+    bool complete;
+    std::vector<syncSample> samples;    //One per stream, in stream order
+};
+struct clockModel{
+    double offsetUs;
+    double drift;                       //us per s (ppm)
+    uint64_t pairs;
+};
+struct syncStats{
+    uint64_t tuples;
+    uint64_t partial;                   //Tuples with missing streams (emitted or not)
+    std::vector<uint64_t> unmatched;    //Frames of each stream never paired
+};
+
+class streamAligner{
+public:
+    streamAligner(int streams, int64_t toleranceUs, int reference = 0);
+    void setCallback(std::function<void(const syncTuple&)> callback);
+    void setMaxLatency(int64_t us);
+    //Incomplete tuples are emitted too (missing frameId 0)
+    void setAllowPartial(bool value);
+    //Known offset between clocks, e.g. from the capturer. Refined with the pairs
+    void setOffset(int stream, double offsetUs);
+    void push(int stream, uint64_t frameId, int64_t timestamp);
+    //Decide everything that is waiting, as if no more frames were coming
+    void flush();
+    void reset();
+    clockModel clock(int stream) const;
+    syncStats stats() const;
+private:
+    struct clockFit{
+        bool anchored;
+        int64_t first;
+        double sw, sx, sy, sxx, sxy;
+        double offset;
+        double drift;
+        uint64_t pairs;
+    };
+    double corrected(int stream, int64_t timestamp) const;
+    void updateClock(int stream, int64_t timestamp, int64_t reference);
+    void process(bool flushing, std::vector<syncTuple>& ready);
+
+    int m_streams;
+    int m_reference;
+    int64_t m_tolerance;
+    int64_t m_maxLatency;
+    bool m_allowPartial;
+    std::function<void(const syncTuple&)> m_callback;
+    std::vector<std::deque<syncSample> > m_queues;
+    std::vector<clockFit> m_clocks;
+    std::vector<int64_t> m_newest;
+    syncStats m_stats;
+    mutable std::mutex m_mutex;
+};
+
+#endif // STREAMSYNC_H
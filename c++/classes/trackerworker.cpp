@@ -0,0 +1,181 @@
+#include "trackerworker.h"
+
+#include <chrono>
+#include <cstring>
+
+//Without a frame ring the worker sleeps until frameReady(); the ring is looked up again at this period
+#define LEGACY_WAIT_MS  100
+#define IDLE_WAIT_MS    2
+
+trackerWorker::trackerWorker() : m_running(false), m_ringGeneration(0), m_legacySeq(0), m_legacyId(0), m_eyeGeneration(0), m_width(0), m_height(0), m_channels(1),
+    m_seq(0), m_frames(0), m_tracked(0), m_skipped(0), m_totalUs(0){
+    std::memset(&m_result, 0, sizeof(m_result));
+}
+trackerWorker::~trackerWorker(){
+    stop();
+}
+void trackerWorker::start(int width, int height, int channels){
+    stop();
+    m_width = width;
+    m_height = height;
+    m_channels = channels;
+    m_ring.close();
+    m_eyeRing.close();
+    m_legacy.unmap();
+    m_legacyId = m_legacySeq.load();
+    m_ringGeneration = 0;
+    m_eyeGeneration = 0;
+    m_running = true;
+    m_thread = std::thread(&trackerWorker::run, this);
+}
+void trackerWorker::stop(){
+    if(!m_thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_waitMutex);
+        m_running = false;
+    }
+    m_wait.notify_all();
+    m_thread.join();
+}
+void trackerWorker::frameReady(){
+    {
+        std::lock_guard<std::mutex> lock(m_waitMutex);
+        m_legacySeq++;
+    }
+    m_wait.notify_all();
+}
+bool trackerWorker::latest(trackerResult& result, uint64_t lastFrameId) const{
+    trackerResult copy;
+    uint64_t s;
+    do{
+        s = seqlockReadBegin(m_seq);
+        std::memcpy(&copy, &m_result, sizeof(copy));
+    }while(seqlockReadRetry(m_seq, s));
+    if(copy.frameId == 0 || copy.frameId == lastFrameId)
+        return false;
+    result = copy;
+    return true;
+}
+trackerWorkerStats trackerWorker::stats() const{
+    trackerWorkerStats stats;
+    stats.frames = m_frames.load();
+    stats.tracked = m_tracked.load();
+    stats.skipped = m_skipped.load();
+    stats.meanMs = stats.frames ? m_totalUs.load()/1000.0/stats.frames : 0;
+    return stats;
+}
+bool trackerWorker::grab(cv::Mat& frame, frameInfo& info){
+    //Same lookup as cameraViewer::mapSharedMemory: registry, default ring, "m_shared"
+    streamDescriptor desc;
+    if(shmRegistry::instance().find(CAMERA_STREAM, desc) && desc.kind == SHM_FRAME_RING){
+        if(!m_ring.isOpen() || desc.generation != m_ringGeneration){
+            if(m_ring.open(desc.segment))
+                m_ringGeneration = desc.generation;
+        }
+    }else if(!m_ring.isOpen()){
+        m_ring.open(FRAME_RING_NAME);
+    }
+    if(m_ring.isOpen()){
+        m_legacy.unmap();
+        const uint64_t dropped = m_ring.dropped();
+        bool whole = m_ring.latest(frame, info);
+        if(whole)
+            m_skipped += m_ring.dropped() - dropped;
+        //Newer eye region over the whole frame, which the capturer now sends at low rate
+        return grabEye(frame, info) || whole;
+    }
+    //Same frame as the last one measured: nothing to do until frameReady()
+    const uint64_t seq = m_legacySeq.load();
+    if(m_width <= 0 || m_height <= 0 || seq == m_legacyId)
+        return false;
+    if(!m_legacy.map("m_shared", m_width, m_height, m_channels == 3 ? FRAME_RGB888 : FRAME_GRAY8))
+        return false;
+    if(m_legacy.size() < (std::size_t)m_width*m_height*m_channels)
+        return false;
+    cv::Mat(m_height, m_width, m_channels == 3 ? CV_8UC3 : CV_8UC1, m_legacy.address()).copyTo(frame);
+    //Frames announced while the tracker was busy
+    m_skipped += seq - m_legacyId - 1;
+    m_legacyId = seq;
+    info.frameId = seq;
+    info.timestamp = frameRingClock();
+    info.width = m_width;
+    info.height = m_height;
+    info.format = m_channels == 3 ? FRAME_RGB888 : FRAME_GRAY8;
+    return true;
+}
+bool trackerWorker::grabEye(cv::Mat& frame, frameInfo& info){
+    streamDescriptor desc;
+    if(!shmRegistry::instance().find(EYE_STREAM, desc) || desc.kind != SHM_FRAME_RING){
+        m_eyeRing.close();
+        return false;
+    }
+    if(!m_eyeRing.isOpen() || desc.generation != m_eyeGeneration){
+        if(!m_eyeRing.open(desc.segment))
+            return false;
+        m_eyeGeneration = desc.generation;
+    }
+    frameInfo eye;
+    if(!m_eyeRing.latest(m_eyePlane, eye))
+        return false;
+    const cv::Rect roi(eye.originX, eye.originY, eye.width, eye.height);
+    if(frame.empty() || m_eyePlane.type() != frame.type() || (roi & cv::Rect(0, 0, frame.cols, frame.rows)) != roi)
+        return false;           //No whole frame yet, or of another size
+    if(info.timestamp >= eye.timestamp)
+        return false;           //The whole frame just read is newer
+    m_eyePlane.copyTo(frame(roi));
+    //Ids of the eye stream: the mailbox only compares them with the previous one
+    info.frameId = eye.frameId;
+    info.timestamp = eye.timestamp;
+    info.width = frame.cols;
+    info.height = frame.rows;
+    return true;
+}
+void trackerWorker::publish(const frameInfo& info, int status){
+    trackerResult result;
+    std::memset(&result, 0, sizeof(result));
+    result.frameId = info.frameId;
+    result.timestamp = info.timestamp;
+    result.status = status;
+    result.path = m_tracker.lastPath();
+    if(status == 0){
+        cv::RotatedRect ellipse = m_tracker.ellipse();
+        result.ellipseX = ellipse.center.x;
+        result.ellipseY = ellipse.center.y;
+        result.ellipseWidth = ellipse.size.width;
+        result.ellipseHeight = ellipse.size.height;
+        result.ellipseAngle = ellipse.angle;
+        result.pupilX = m_tracker.pupilPoint().x;
+        result.pupilY = m_tracker.pupilPoint().y;
+        result.leftGlintX = m_tracker.glints().first.x;
+        result.leftGlintY = m_tracker.glints().first.y;
+        result.rightGlintX = m_tracker.glints().second.x;
+        result.rightGlintY = m_tracker.glints().second.y;
+    }
+    seqlockWriteBegin(m_seq);
+    std::memcpy(&m_result, &result, sizeof(result));
+    seqlockWriteEnd(m_seq);
+}
+void trackerWorker::run(){
+    while(m_running){
+        //Zero: no whole frame read in this iteration (see grabEye)
+        frameInfo info = frameInfo();
+        if(!grab(m_frame, info)){
+            //Ring: woken by the next publish (the eye ring is still polled at this period)
+            if(m_ring.isOpen()){
+                m_ring.wait(m_ring.lastId(), IDLE_WAIT_MS);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_waitMutex);
+            m_wait.wait_for(lock, std::chrono::milliseconds(LEGACY_WAIT_MS), [this]{return !m_running || m_legacySeq.load() != m_legacyId;});
+            continue;
+        }
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        int status = m_tracker.measure(m_frame);
+        m_totalUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+        m_frames++;
+        if(status == 0)
+            m_tracked++;
+        publish(info, status);
+    }
+}
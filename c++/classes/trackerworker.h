@@ -0,0 +1,104 @@
+#ifndef TRACKERWORKER_H
+#define TRACKERWORKER_H
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//openCV
+#include <opencv2/core/core.hpp>
+
+#include "otracker.h"
+#include "framering.h"
+#include "shmregistry.h"
+#include "seqlock.h"
+#include "eyeregion.h"
+
+/* Tracker for the live overlay of cameraViewer.
+ * A thread of its own reads the newest camera frame from shared memory, runs OTracker::measure
+ * and leaves the result in a mailbox (seqlock, one writer). The render thread only reads the
+ * last result, so a slow tracker frame never stalls the UI; frames that arrive while the tracker
+ * is busy are skipped.
+ * "m_shared" has no frame id: without a frame ring the worker measures once per frameReady()
+ * (updateImageDBus of the capturer), not by polling the segment.
+ * The overlay does not feed its region back to the capturer: "camera" would drop to
+ * EYE_CONTEXT_FPS for every other reader (eyeregion.h). While the capturer sends only a region
+ * ("eye" stream, asked for by the detector engine), it is pasted over the last whole frame. */
+struct trackerResult{
+    uint64_t frameId;               //0: no result yet
+    int64_t timestamp;              //Capture time of the frame (frameRingClock)
+    int status;                     //OTracker::measure return value
+    int path;                       //detectionPath of the ellipse
+    float ellipseX;
+    float ellipseY;
+    float ellipseWidth;
+    float ellipseHeight;
+    float ellipseAngle;
+    double pupilX;
+    double pupilY;
+    double leftGlintX;
+    double leftGlintY;
+    double rightGlintX;
+    double rightGlintY;
+};
+
+struct trackerWorkerStats{
+    uint64_t frames;                //Frames measured
+    uint64_t tracked;               //measure() == 0
+    uint64_t skipped;               //Frames published while the tracker was busy
+    double meanMs;
+};
+
+class trackerWorker{
+public:
+    trackerWorker();
+    ~trackerWorker();
+    //Geometry of "m_shared", for capturers without frame ring
+    void start(int width, int height, int channels);
+    void stop();
+    bool isRunning() const {return m_running.load();}
+    //A new frame in "m_shared" (GUI thread)
+    void frameReady();
+    //Last result. False when there is none or it is the same as lastFrameId
+    bool latest(trackerResult& result, uint64_t lastFrameId = 0) const;
+    trackerWorkerStats stats() const;
+private:
+    trackerWorker(const trackerWorker&);
+    trackerWorker& operator=(const trackerWorker&);
+    void run();
+    bool grab(cv::Mat& frame, frameInfo& info);
+    bool grabEye(cv::Mat& frame, frameInfo& info);
+    void publish(const frameInfo& info, int status);
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::mutex m_waitMutex;
+    std::condition_variable m_wait;
+    OTracker m_tracker;
+
+    //Only used by the worker thread
+    frameRingReader m_ring;
+    uint64_t m_ringGeneration;
+    shmMapping m_legacy;
+    std::atomic<uint64_t> m_legacySeq;  //frameReady() calls
+    uint64_t m_legacyId;                //m_legacySeq of the last frame measured
+    frameRingReader m_eyeRing;
+    uint64_t m_eyeGeneration;
+    cv::Mat m_eyePlane;
+    int m_width;
+    int m_height;
+    int m_channels;
+    cv::Mat m_frame;
+
+    //Mailbox
+    seqCounter m_seq;
+    trackerResult m_result;
+
+    std::atomic<uint64_t> m_frames;
+    std::atomic<uint64_t> m_tracked;
+    std::atomic<uint64_t> m_skipped;
+    std::atomic<uint64_t> m_totalUs;
+};
+
+#endif // TRACKERWORKER_H
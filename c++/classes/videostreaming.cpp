@@ -7,7 +7,9 @@
 #include <QLabel>
 #include <QMessageBox>
 #include <QRectF>
+#include <QDBusMessage>
 #include <fcntl.h>
+#include <QRunnable>
 
 QStringListModel Videostreaming::modelCam;
 
@@ -20,9 +22,20 @@ QStringListModel Videostreaming::modelCam;
  #define min(a,b) ((a)<(b)?(a):(b))
 #endif
 
-Videostreaming::~Videostreaming(){}
+//sessionIndex::write() on m_indexPool
+class sessionIndexTask : public QRunnable{
+public:
+    explicit sessionIndexTask(const QString& directory) : m_directory(directory){}
+    void run() override {sessionIndex::instance().write(m_directory);}
+private:
+    QString m_directory;
+};
 
-Videostreaming::Videostreaming(){
+Videostreaming::~Videostreaming(){
+    m_indexPool.waitForDone();
+}
+
+Videostreaming::Videostreaming() : m_pool(this), m_gazeGeneration(0), m_capturerStatuses(0){
     numberOfFrames = 0;
     fileInc = 0;
     m_killbgPupilDetectorFlag = false;
@@ -37,41 +50,119 @@ Videostreaming::Videostreaming(){
     mongocxx::instance instance{}; // This should be done only once.
     m_testTimer = NULL;
     m_startTimer = true;
+    shmRegistry::instance().cleanupStale();
+    //One at a time: the videos of the next test are being written meanwhile
+    m_indexPool.setMaxThreadCount(1);
+    //Progress of the processing jobs comes from their worker threads
+    m_scheduler.setJournal(QStandardPaths::writableLocation(QStandardPaths::DataLocation) + "/processing.ini");
+    m_scheduler.setProgressCallback([this](const processingJob& job, double totalPercent){
+        QMetaObject::invokeMethod(this, "processingProgress", Qt::QueuedConnection, Q_ARG(double, job.progress), Q_ARG(double, totalPercent));
+    });
 }
 void Videostreaming::createTimer(){
-    m_testTimer = new OTimer(this);
-    connect(m_testTimer, SIGNAL(timeoutSignal()), this, SLOT(updateTestProgressSlot()));
+    //One OTimer for every test: they all run on the thread of timerService
+    if(!m_testTimer){
+        m_testTimer = new OTimer(this);
+        connect(m_testTimer, SIGNAL(timeoutSignal()), this, SLOT(updateTestProgressSlot()));
+    }
     m_testTimer->start(m_timeInterval);
 }
+#define PING_TIMEOUT_MS     500
+//Liveness probe of processSupervisor: the plugin's connection answers org.freedesktop.DBus.Peer
+static bool pingPlugin(const QString& service){
+    QDBusMessage ping = QDBusMessage::createMethodCall(service, "/", "org.freedesktop.DBus.Peer", "Ping");
+    return QDBusConnection::sessionBus().call(ping, QDBus::Block, PING_TIMEOUT_MS).type() == QDBusMessage::ReplyMessage;
+}
+//Scheduling of a plugin: cores from the caller, the rest from plugins.ini ([bgVideoCapturer] nice=-5, fifo=10, memoryMB=0, restart=true, ping=org.oscann.video)
+static pluginPolicy pluginPolicyFor(const QString name, const QString cores){
+    QSettings settings(QStandardPaths::writableLocation(QStandardPaths::DataLocation) + "/plugins.ini", QSettings::IniFormat);
+    //Service names on the session bus; peer to peer plugins (dbus/p2p) may not own one
+    QString service;
+    if(!settings.value("dbus/p2p", false).toBool()){
+        if(name == "bgVideoCapturer")
+            service = "org.oscann.video";
+        else if(name == "bgPupilDetection")
+            service = "aura.oscann.pupil";
+    }
+    settings.beginGroup(name);
+    pluginPolicy policy;
+    policy.cores = processSupervisor::parseCores(settings.value("cores", cores).toString().toStdString());
+    policy.nice = settings.value("nice", 0).toInt();
+    policy.fifoPriority = settings.value("fifo", 0).toInt();
+    policy.memoryLimit = (std::size_t)settings.value("memoryMB", 0).toULongLong() << 20;
+    policy.restart = settings.value("restart", true).toBool();
+    //Empty: only the exit of the process is seen (two bgImageWriter cannot own one name)
+    service = settings.value("ping", service).toString();
+    if(!service.isEmpty())
+        policy.alive = [service]{return pingPlugin(service);};
+    settings.endGroup();
+    return policy;
+}
 void Videostreaming::setupDbus() {
     //TODO DEBUG: dbus-monitor type='signal' | grep aura.GUIInterface
     new GUIInterfaceAdaptor(this);      // ----- ----- ----- ----- ----- To emit aura.GUIInterface signals: shutdownDBus
     QDBusConnection connection = QDBusConnection::sessionBus();
     connection.registerService("org.oscann.gui");
     connection.registerObject("/gui", this);
-    displayCTIface = new aura::DisplayCTInterface("org.oscann.dct",
+    connectPlugins(connection, false);
+    QSettings settings(QStandardPaths::writableLocation(QStandardPaths::DataLocation) + "/plugins.ini", QSettings::IniFormat);
+    //Plugins straight to the GUI, the session bus only to find it (p2pbus.h); before any plugin starts
+    if(settings.value("dbus/p2p", false).toBool()){
+        p2pBus::instance().addPeerHandler(this, [this](QDBusConnection peer){
+            peer.registerObject("/gui", this);
+            return connectPlugins(peer, true);
+        });
+        if(!p2pBus::instance().listen())
+            qDebug()<<Q_FUNC_INFO<<p2pBus::instance().getLastError().c_str();
+    }
+    //Detector and writers waiting for the first session (pluginpool.h); [standby] in plugins.ini.
+    //Without standby/fps they are launched once the capturer or the first session gives the rate
+    if(settings.value("standby/enabled", true).toBool()){
+        const unsigned int fps = settings.value("standby/fps", 0).toUInt();
+        //In process detection: the external one only for calibration and offline, on demand
+        if(settings.value("detector/engine", "external").toString() != "inprocess")
+            m_pool.setStandby("bgPupilDetection", {{}}, pluginPolicyFor("bgPupilDetection", ""), fps, false);
+        m_pool.setStandby("bgImageWriter", {{"0"}, {"1"}}, pluginPolicyFor("bgImageWriter", "1"), fps, true);
+        m_pool.warmAll();
+    }
+    //A batch the last run did not finish (jobscheduler.h journal)
+    const unsigned int resumed = resumeProcessing(settings.value("processing/concurrency", 0).toUInt());
+    if(resumed)
+        qDebug()<<Q_FUNC_INFO<<" processing jobs resumed: "<<resumed;
+}
+//Proxies of the plugins on a connection. On a peer connection there are no service names: the
+//peer is the plugin, and the members keep pointing to the session bus proxies
+QList<QObject*> Videostreaming::connectPlugins(const QDBusConnection& connection, const bool peer){
+    aura::DisplayCTInterface* displayCT = new aura::DisplayCTInterface(peer ? QString() : "org.oscann.dct",
                                        "/main",
-                                       QDBusConnection::sessionBus(),
+                                       connection,
                                       this);
-    //connect(displayCTIface, SIGNAL(deleteFilesDbus(int)), this, SLOT(deleteFilesSlot(int)));
-    connect(displayCTIface, SIGNAL(deleteFilesDbus()), this, SLOT(deleteFilesSlot()));
-    connect(displayCTIface, SIGNAL(validateDBus()), this, SLOT(validateSlot()));
-    connect(displayCTIface, SIGNAL(testDurationDBus(unsigned int)), this, SLOT(testDurationSlot(unsigned int)));
-    connect(displayCTIface, SIGNAL(finishDemoDbus()), this, SLOT(finishDemoSlot()));
-    detectorIface = new aura::DetectorInterface("aura.oscann.pupil", "/Detector", QDBusConnection::sessionBus(), this);
-    connect(detectorIface, SIGNAL(progressDBus(double, double)), this, SLOT(processingProgress(double, double)));
-    connect(detectorIface, SIGNAL(ready()), this, SLOT(processReady()));
-
-    writerIface = new aura::WriterInterface("org.oscann.writer",
+    //connect(displayCT, SIGNAL(deleteFilesDbus(int)), this, SLOT(deleteFilesSlot(int)));
+    connect(displayCT, SIGNAL(deleteFilesDbus()), this, SLOT(deleteFilesSlot()));
+    connect(displayCT, SIGNAL(validateDBus()), this, SLOT(validateSlot()));
+    connect(displayCT, SIGNAL(testDurationDBus(unsigned int)), this, SLOT(testDurationSlot(unsigned int)));
+    connect(displayCT, SIGNAL(finishDemoDbus()), this, SLOT(finishDemoSlot()));
+    aura::DetectorInterface* detector = new aura::DetectorInterface(peer ? QString() : "aura.oscann.pupil", "/Detector", connection, this);
+    connect(detector, SIGNAL(progressDBus(double, double)), this, SLOT(processingProgress(double, double)));
+    connect(detector, SIGNAL(ready()), this, SLOT(processReady()));
+
+    aura::WriterInterface* writer = new aura::WriterInterface(peer ? QString() : "org.oscann.writer",
                                        "/main",
-                                       QDBusConnection::sessionBus(),
+                                       connection,
                                       this);
-    connect(writerIface, SIGNAL(nextTestDbus()), this, SLOT(nextClbTst()));
-    capturerIface = new aura::CapturerInterface("org.oscann.video",
+    connect(writer, SIGNAL(nextTestDbus()), this, SLOT(nextClbTst()));
+    aura::CapturerInterface* capturer = new aura::CapturerInterface(peer ? QString() : "org.oscann.video",
                                            "/capturer",
-                                           QDBusConnection::sessionBus(),
+                                           connection,
                                                 this);
-    connect(capturerIface, SIGNAL(statusChangedDBus(int, int, int, int)), this, SLOT(capturerReady(int, int, int, int)));
+    connect(capturer, SIGNAL(statusChangedDBus(int, int, int, int)), this, SLOT(capturerReady(int, int, int, int)));
+    if(!peer){
+        displayCTIface = displayCT;
+        detectorIface = detector;
+        writerIface = writer;
+        capturerIface = capturer;
+    }
+    return QList<QObject*>() << displayCT << detector << writer << capturer;
 }
 
 
@@ -79,9 +170,12 @@ void Videostreaming::capturerReady(const int cameraType, const int width, const
     qDebug() << "Entrando en Videostreaming::capturerReady con las variables: " << cameraType << ", " << width << ", " << height << ", " << fps;
     Q_UNUSED(width);
     Q_UNUSED(height);
-    Q_UNUSED(fps);
+    m_capturerStatuses++;
     if(cameraType == -1)
         return;
+    //Standby plugins at the rate of the camera
+    if(fps > 0)
+        m_pool.setRate((unsigned int)fps);
     m_cameraType = cameraType;
     qDebug()<<Q_FUNC_INFO<<" +++++ +++++ +++++ +++++ +++++ +++++ +++++ +++++  m_cameraType: "<<m_cameraType;
 }
@@ -167,30 +261,76 @@ void Videostreaming::sendMessageToServer(const QString sessionName){
 }
 
 void Videostreaming::deleteFilesSlot(){
+    sessionIndex::instance().invalidate(m_directoryName);
     linuxCommand="rm -rf \""+m_directoryName+"\" &";
     system(linuxCommand.toLatin1().data());
 }
 
 void Videostreaming::destruir(){
-    if(memoryName){
-        shared_memory_object::remove(memoryName);
-    }
+    m_indexPool.waitForDone();
+    m_detector.stop();
+    m_pool.shutdown();
+    p2pBus::instance().close();
+    //Segments of capturers that died without removing them
+    shmRegistry::instance().cleanupStale();
     emit shutdownDBus(99);
 }
 
 void Videostreaming::serviceSlot(const unsigned int type, const QString name, const bool run, const QString cores, const unsigned int fps){
+    processSupervisor& supervisor = processSupervisor::instance();
+    //Live detection in this process (detectorengine.h): no plugin to start or to shut down
+    if(!name.compare("bgPupilDetection") && (run ? useDetectorEngine() : m_detector.isRunning())){
+        if(!run){
+            m_detector.stop();
+            return;
+        }
+        QSettings settings(QStandardPaths::writableLocation(QStandardPaths::DataLocation) + "/plugins.ini", QSettings::IniFormat);
+        const int eyes = settings.value("detector/eyes", 1).toInt();
+        //Eye region feedback: only when bgImageWriter merges the "eye" stream too (eyeregion.h)
+        const bool eyeRegion = settings.value("detector/eyeRegion", false).toBool();
+        //What processReady() sends the external detector with configTrackerDBus
+        m_detector.configure(m_imgSize.width(), m_imgSize.height());
+        if(!m_detector.start(eyes, processSupervisor::parseCores(settings.value("detector/cores", cores).toString().toStdString()), eyeRegion))
+            qDebug()<<Q_FUNC_INFO<<" detector engine: "<<m_detector.getLastError().c_str();
+        else if(!m_detector.getLastError().empty())
+            qDebug()<<Q_FUNC_INFO<<" detector engine: "<<m_detector.getLastError().c_str();
+        return;
+    }
     if(run){
+        //Standby plugin of the pool: already running
+        if(m_pool.acquire(name, fps) != STANDBY_NONE)
+            return;
+        pluginPolicy policy = pluginPolicyFor(name, cores);
+        bool started;
         if(!name.compare("bgImageWriter")){
-            system(QString("./%2 0 %3 &").arg(name).arg(fps).toLatin1().data());
-            system(QString("./%2 1 %3 &").arg(name).arg(fps).toLatin1().data());
+            started = supervisor.start(name.toStdString(), {"0", std::to_string(fps)}, policy);
+            started = supervisor.start(name.toStdString(), {"1", std::to_string(fps)}, policy) && started;
             //system(QString("gdb -ex run ./%2 &").arg(name).toLatin1().data());
         }else{
-            system(QString("./%2 %3 &").arg(name).arg(fps).toLatin1().data());
+            started = supervisor.start(name.toStdString(), {std::to_string(fps)}, policy);
         }
+        if(!started)
+            qDebug()<<Q_FUNC_INFO<<supervisor.getLastError().c_str();
+        m_pool.launched(name, fps);
     }else{
+        //The plugin quits by DBus; the supervisor kills it if it is still there after the grace period
         emit shutdownDBus(type);
+        supervisor.stop(name.toStdString());
+        m_pool.release(name);
     }
 }
+//[detector] engine=inprocess in plugins.ini. Calibration needs the d1 file of the external one,
+//and the engine reads the frame ring only: a capturer writing "m_shared" keeps the plugin
+bool Videostreaming::useDetectorEngine(){
+    QSettings settings(QStandardPaths::writableLocation(QStandardPaths::DataLocation) + "/plugins.ini", QSettings::IniFormat);
+    if(settings.value("detector/engine", "external").toString() != "inprocess" || m_isClb || m_offline)
+        return false;
+    if(!detectorEngine::available()){
+        qDebug()<<Q_FUNC_INFO<<" no frame ring for \""<<CAMERA_STREAM<<"\": external bgPupilDetection";
+        return false;
+    }
+    return true;
+}
 void Videostreaming::validateSlot(){
     if(m_validating){
         emit validate();
@@ -227,12 +367,26 @@ void Videostreaming::start_bgPupilDetection(unsigned int fps){
         messageBox.critical(0,"Error","The plugin bgPupilDetection can not be loaded because is not in the same folder as this program. Images will not be processed");
     }
     qDebug()<<Q_FUNC_INFO<<" ===== ===== ===== ===== ===== ===== ===== ===== ===== ===== ===== ===== ===== ===== ";
-    system(QString("./bgPupilDetection %2 &").arg(fps).toLatin1().data());
+    switch(m_pool.acquire("bgPupilDetection", fps)){
+    case STANDBY_READY:     //Its ready() already came: go on as if it came now
+        QMetaObject::invokeMethod(this, "processReady", Qt::QueuedConnection);
+        break;
+    case STANDBY_STARTING:  //processReady() when its ready() comes
+        break;
+    default:
+        if(!processSupervisor::instance().start("bgPupilDetection", {std::to_string(fps)}, pluginPolicyFor("bgPupilDetection", "")))
+            qDebug()<<Q_FUNC_INFO<<processSupervisor::instance().getLastError().c_str();
+        m_pool.launched("bgPupilDetection", fps);
+    }
     qDebug()<<Q_FUNC_INFO<<" ===== ===== ===== ===== ===== ";
 }
 
 
 void Videostreaming::processReady(){
+    //A standby detector that nobody asked for yet: it waits for start_bgPupilDetection()
+    if(m_pool.readied("bgPupilDetection"))
+        return;
+    m_pool.ready("bgPupilDetection");
     qDebug()<<Q_FUNC_INFO<<" -*-*- -*-*- -*-*- -*-*- -*-*- -*-*- -*-*- -*-*- m_offline: "<<m_offline<<", m_freq: "<<m_freq;
     if(m_offline){
         if(m_freq == -1){ //procesamiento offline
@@ -242,17 +396,16 @@ void Videostreaming::processReady(){
         else{ //nunca entra en esta opción ya que m_freq se establece en callOflline y siempre se llama a callOffline con -1 en freq
             emit closeVideo();
         }
-        cv::VideoCapture tryAvi;
-        //se crean dos "handlers" de archivos para gestionar los .avi y los .dat ocultos que contienen la posición del ojo en cada momento
-        QFileInfoList aviCheck=QDir(QString(QString(m_directoryName)+"/raw")).entryInfoList((QStringList("*.avi"),QDir::Files));
+        //los .avi salen del índice de la sesión (sessionindex.h); el .dat oculto contiene la posición del ojo en cada momento
+        sessionEntry aviCheck = sessionIndex::instance().lookup(m_directoryName);
         QFileInfoList datCheck=QDir(m_directoryName).entryInfoList(QStringList("*d1.dat"),QDir::Files|QDir::Hidden);
-        qDebug()<<Q_FUNC_INFO<<" aviCheck.size(): "<<aviCheck.size();//se imprime el numero de archivos avi y .dat oculto del directorio m_directoryName
+        qDebug()<<Q_FUNC_INFO<<" aviCheck.size(): "<<aviCheck.avis.size();//se imprime el numero de archivos avi y .dat oculto del directorio m_directoryName
         qDebug()<<Q_FUNC_INFO<<" datCheck.size(): "<<datCheck.size();
-        if(aviCheck.size()<=0 || datCheck.size()<=0){ //error en el video
+        if(aviCheck.avis.size()<=0 || datCheck.size()<=0){ //error en el video
             qDebug()<<Q_FUNC_INFO<<" emit corruptVideo() -> -> -> -> -> -> -> -> -> -> -> -> -> ";
             emit corruptVideo(); //ejecuta onCorruptVideo de vidstreamproperty en tabcapturerfilter_qml.qml
         }
-        else if(!tryAvi.open(aviCheck.at(0).absoluteFilePath().toLatin1().data())){ // si da problema al abrir el primer .avi
+        else if(!aviCheck.avis.at(0).readable){ // si da problema al abrir el primer .avi
             qDebug()<<Q_FUNC_INFO<<" emit corruptVideo() -> -> -> -> -> -> -> -> -> -> -> -> -> ";
             emit corruptVideo(); //ejecuta onCorruptVideo de vidstreamproperty en tabcapturerfilter_qml.qml
         }
@@ -308,6 +461,8 @@ void Videostreaming::keyHandler(const int key, const bool fromRun=false){//Signa
 void Videostreaming::killbgPupilDetector(){ //Esta función es llamada cuando la barra de porcentaje alcanza el 100%
     if(m_killbgPupilDetectorFlag){
         emit shutdownDBus(2);
+        processSupervisor::instance().stop("bgPupilDetection");
+        m_pool.release("bgPupilDetection");
         m_killbgPupilDetectorFlag         =   false;
     }
 }
@@ -319,6 +474,9 @@ void Videostreaming::normalStateSlot(){
     if(m_testTimer && !m_isClb){
         if(m_testTimer->isActive()){
             emit testProgress(m_testProgress = 101, Q_FUNC_INFO);
+            //Timing of the test clock, before stop() forgets it
+            const timerJitter jitter = m_testTimer->jitter();
+            qDebug()<<Q_FUNC_INFO<<" test timer: "<<jitter.expirations<<" expirations, "<<jitter.overruns<<" overruns, "<<m_testTimer->coalesced()<<" coalesced, late "<<jitter.meanUs<<" +/- "<<jitter.stdUs<<" us (max "<<jitter.maxUs<<")";
             m_testTimer->stop();
             m_startTimer = true;
             qDebug()<<Q_FUNC_INFO<<" ##### ##### ##### ##### ##### ##### ##### ##### ##### ##### ##### ##### m_startTimer: "<<m_startTimer;
@@ -337,7 +495,14 @@ void Videostreaming::callOffline(int freq, unsigned int fps){
 }
 
 int Videostreaming::processQueueAdd(){
+    //Su índice se escribió al acabar la grabación (nextClbTst); si falta, processQueue() lo crea
     m_vector2Process.push_back(m_directoryName);
+    return m_vector2Process.length();
+}
+void Videostreaming::indexSession(const QString& directory){
+    if(directory.isEmpty() || !QDir(directory + "/raw").exists())
+        return;
+    m_indexPool.start(new sessionIndexTask(directory));
 }
 
 int Videostreaming::queueLength(){
@@ -346,39 +511,19 @@ int Videostreaming::queueLength(){
 
 QStringList Videostreaming::processQueue(){
     QStringList directories;
-    QVector<QString> tmp = m_vector2Process;
-    cv::VideoCapture vc;
-    QFileInfoList aviFileName; //nombre de los archivos de video
-    QFileInfoList avis; //archivos de video
+    QStringList tmp = m_vector2Process.toList();
     unsigned int tftp = 0; //total frames to process
-    QString textName;
     bool hasClb = false;
-    while(!tmp.isEmpty()){ //mientras haya videos que procesar en la cola
-        textName = tmp.front(); //nombre del primer Test en el vector de test a procesar
+    //Frames de cada test desde su índice: solo se abren los .avi de los tests sin índice válido (en paralelo)
+    QVector<sessionEntry> entries = sessionIndex::instance().lookup(tmp);
+    for(const sessionEntry& entry : entries){ //mientras haya videos que procesar en la cola
+        const QString& textName = entry.directory; //nombre del Test
         if(textName.contains("CC") || textName.contains("CA"))//significa que son calibraciones
             hasClb = true;
-        //TODO: Add _0.avi, _1.avi
-        //aviFileName    =   QDir(QString("%1/raw").arg(textName)).entryInfoList(QStringList("*.avi"),QDir::Files);
-
-        avis=QDir(QString("%1/raw").arg(textName)).entryInfoList(QStringList("*.avi"),QDir::Files);
-        qDebug()<<Q_FUNC_INFO<<" m_NOV: "<<avis.length(); //imprimimos el nombre de la función y el numero de archivos de video que contiene
-        switch(avis.length()){ //si en la lista hay uno o dos archivos de video se capturan los videos y se contabiliza el número de frames totales
-        case 1:
-            vc = cv::VideoCapture(QString(textName+"/raw/"+textName.split("/").last()+"_0.avi").toLatin1().data());
-            tftp += vc.get(cv::CAP_PROP_FRAME_COUNT);
-            break;
-        case 2:
-            qDebug()<<Q_FUNC_INFO<<" 1: "<<QString(textName+"/raw/"+textName.split("/").last()+"_0.avi");
-            vc = cv::VideoCapture(QString(textName+"/raw/"+textName.split("/").last()+"_0.avi").toLatin1().data());
-            tftp += vc.get(cv::CAP_PROP_FRAME_COUNT);
-            qDebug()<<Q_FUNC_INFO<<" 1: "<<QString(textName+"/raw/"+textName.split("/").last()+"_1.avi");
-            vc = cv::VideoCapture(QString(textName+"/raw/"+textName.split("/").last()+"_1.avi").toLatin1().data());
-            tftp += vc.get(cv::CAP_PROP_FRAME_COUNT);
-            break;
-        }
-        avis.clear();
+        qDebug()<<Q_FUNC_INFO<<" m_NOV: "<<entry.avis.size(); //imprimimos el nombre de la función y el numero de archivos de video que contiene
+        if(entry.avis.size() == 1 || entry.avis.size() == 2) //si en la lista hay uno o dos archivos de video se contabiliza el número de frames de _0.avi y _1.avi
+            tftp += entry.frames();
         directories.push_back(textName);//guardamos la info en el QStringList
-        tmp.pop_front(); //borramos el primero tras sacar los tftp
     }
     if(tftp != 0 && hasClb){ //hay calibración y los videos tenian frames
         setTotalFramesToProcess(tftp); //indicamos el número total de frames a procesar
@@ -388,6 +533,53 @@ QStringList Videostreaming::processQueue(){
     return directories;
 }
 
+unsigned int Videostreaming::processBatch(const QStringList& directories, unsigned int fps, unsigned int concurrency){
+    //Same rule as processQueue(): the batch is processed only when it has a calibration
+    QVector<sessionEntry> entries = sessionIndex::instance().lookup(directories);
+    bool hasClb = false;
+    for(const QString& textName : directories)
+        if(textName.contains("CC") || textName.contains("CA"))
+            hasClb = true;
+    if(!hasClb)
+        return 0;
+    for(const sessionEntry& entry : entries){
+        QSettings settings(entry.directory + "/camera.ini", QSettings::IniFormat);
+        processingJob job;
+        job.directory = entry.directory;
+        job.priority = entry.directory.contains("CC") || entry.directory.contains("CA") ? JOB_PRIORITY_CALIBRATION : JOB_PRIORITY_TEST;
+        job.frames = entry.frames();
+        job.width = settings.value("image/width", m_imgSize.width()).toInt();
+        job.height = settings.value("image/height", m_imgSize.height()).toInt();
+        job.freq = -1;      //Offline, as callOffline()
+        job.fps = fps;
+        m_scheduler.submit(job);
+    }
+    m_scheduler.setConcurrency(concurrency);
+    m_scheduler.start();
+    return entries.size();
+}
+unsigned int Videostreaming::resumeProcessing(unsigned int concurrency){
+    unsigned int jobs = m_scheduler.resume();
+    if(jobs){
+        m_scheduler.setConcurrency(concurrency);
+        m_scheduler.start();
+    }
+    return jobs;
+}
+std::size_t Videostreaming::readGaze(std::vector<gazeSample>& samples, std::size_t max){
+    //A new detector (new generation) starts with what it has already pushed
+    streamDescriptor desc;
+    if(!shmRegistry::instance().find(GAZE_STREAM, desc) || desc.kind != SHM_GAZE_RING)
+        return 0;
+    if(!m_gaze.isOpen() || desc.generation != m_gazeGeneration){
+        if(!m_gaze.open(desc.segment, true)){
+            qDebug()<<Q_FUNC_INFO<<QString::fromStdString(m_gaze.getLastError());
+            return 0;
+        }
+        m_gazeGeneration = desc.generation;
+    }
+    return m_gaze.read(samples, max);
+}
 
 QString Videostreaming::returnDefaultDir(){ //función que devuelve la ruta donde se guardan los pacientes
     return QStandardPaths::standardLocations(QStandardPaths::PicturesLocation).first()+"/Default";
@@ -37,6 +37,7 @@
 #include "oscann_interface.h"
 
 #include <QDBusConnection>
+#include <QThreadPool>
 
 //openCV
 #include <opencv2/core/core.hpp>
@@ -46,6 +47,14 @@
 
 #include "utilsprocess.h"
 #include "qutils.h"
+#include "shmregistry.h"
+#include "sessionindex.h"
+#include "jobscheduler.h"
+#include "processsupervisor.h"
+#include "pluginpool.h"
+#include "gazering.h"
+#include "p2pbus.h"
+#include "detectorengine.h"
 
 using namespace std;
 using namespace boost::interprocess;
@@ -160,8 +169,28 @@ public:
     QString tableTitle(){return m_tableTitle;}
     void killDisplayCT();
     int getCameraType(){return m_cameraType;}
+    //statusChangedDBus received from the capturer, by the session bus or a peer connection
+    unsigned int capturerStatuses(){return m_capturerStatuses;}
+    //Parallel offline processing of the queue (jobscheduler.h). concurrency 0: one job per core
+    unsigned int processBatch(unsigned int fps, unsigned int concurrency = 0){return processBatch(m_vector2Process.toList(), fps, concurrency);}
+    unsigned int processBatch(const QStringList& directories, unsigned int fps, unsigned int concurrency = 0);
+    //Jobs of a batch interrupted by a crash or a shutdown (setupDbus() takes them up at startup)
+    unsigned int resumeProcessing(unsigned int concurrency = 0);
+    bool cancelProcessing(unsigned int jobId){return m_scheduler.cancel(jobId);}
+    QVector<processingJob> processingJobs(){return m_scheduler.jobs();}
+    //From start_bgPupilDetection() to the detector's ready(), standby or cold (pluginpool.h)
+    standbyLatency startLatency(const QString& name = "bgPupilDetection"){return m_pool.latency(name);}
+    //Pid, restarts, CPU and RSS of the plugins started by serviceSlot
+    std::vector<pluginStats> pluginStatistics(){return processSupervisor::instance().stats();}
+    //Detector samples not read yet, oldest first, appended to samples (gazering.h)
+    std::size_t readGaze(std::vector<gazeSample>& samples, std::size_t max = GAZE_RING_CAPACITY);
+    //Samples the detector overwrote before readGaze got to them
+    uint64_t gazeLost(){return m_gaze.lost();}
+    //In process detector, while it runs the live detection (detectorengine.h)
+    detectorEngineStats detectorStatistics(){return m_detector.stats();}
+    //Delivery of pupilAtDBus signals through dbus-daemon and peer to peer (p2pbus.h). Blocks for seconds per rate and mode
+    std::vector<busBenchmarkResult> dbusBenchmark(const std::vector<unsigned int>& rates = {30, 120, 520}, unsigned int seconds = 2){return p2pBus::benchmark(rates, seconds);}
 
-    char memoryName[255];
     QString linuxCommand;
 
     QString dataFileName;
@@ -216,6 +245,16 @@ private:
 
 
     QVector<QString> m_vector2Process;
+    QThreadPool m_indexPool;            //Session indexes of the recorded tests (sessionindex.h)
+    void indexSession(const QString& directory);
+    jobScheduler m_scheduler;
+    pluginPool m_pool;
+    gazeRingReader m_gaze;
+    uint64_t m_gazeGeneration;
+    unsigned int m_capturerStatuses;
+    QList<QObject*> connectPlugins(const QDBusConnection& connection, const bool peer);
+    detectorEngine m_detector;
+    bool useDetectorEngine();
     int m_frequency;
     int m_laps;
     QString m_tableTitle;
@@ -574,6 +613,8 @@ public slots:
 
     void nextClbTst(){    //Signal from displayCT(Dbus) and QML (from video Corrupted L192 (videocapturerfilter_qml.qml))
         qDebug()<<"ENTRA EN ESTA FUNCION RARA!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!"<<Q_FUNC_INFO;
+        //bgImageWriter closed the videos of the test: index them now, not when they are queued
+        indexSession(m_directoryName);
         emit nextTest();                         //Signal to QML: videostreamingproperty onNextTest
         if(m_testTimer && !m_isClb){
             if(m_testTimer->isActive()){
@@ -0,0 +1,283 @@
+#include "p2pbus.h"
+#include "oscann_interface.h"
+#include "processsupervisor.h"
+#include "runningstats.h"
+
+#include <QDBusConnectionInterface>
+#include <QDBusMessage>
+#include <QDBusReply>
+#include <QDir>
+#include <QThread>
+#include <QTimer>
+#include <QDebug>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+#define BENCH_PATH          "/Detector"
+#define BENCH_TIMEOUT_MS    1000        //Drain of a run; first signal of a connection
+
+// ----------------------------------------------------------
+// Discovery: a single method, answered by hand
+// ----------------------------------------------------------
+//org.oscann.p2p.address on the session bus
+class p2pDiscovery : public QDBusVirtualObject{
+public:
+    QString introspect(const QString&) const{
+        return "  <interface name=\"" P2P_INTERFACE "\">\n"
+               "    <method name=\"address\">\n"
+               "      <arg direction=\"out\" type=\"s\"/>\n"
+               "    </method>\n"
+               "  </interface>\n";
+    }
+    bool handleMessage(const QDBusMessage& message, const QDBusConnection& connection){
+        if(message.type() != QDBusMessage::MethodCallMessage || message.member() != "address")
+            return false;
+        return connection.send(message.createReply(p2pBus::instance().address()));
+    }
+};
+p2pBus& p2pBus::instance(){
+    static p2pBus bus;
+    return bus;
+}
+//Qt objects are released by close(), before the application goes
+p2pBus::p2pBus() : m_server(NULL), m_discovery(NULL){}
+bool p2pBus::listen(){
+    if(m_server != NULL)
+        return true;
+    QDBusServer* server = new QDBusServer("unix:tmpdir=" + QDir::tempPath());
+    if(!server->isConnected()){
+        m_errorMsg = "ERROR 01: p2pBus - " + server->lastError().message().toStdString();
+        delete server;
+        return false;
+    }
+    m_server = server;
+    QObject::connect(m_server, &QDBusServer::newConnection, m_server, [this](const QDBusConnection& connection){
+        accept(connection);
+    });
+    //Plugins started from now on inherit it (processSupervisor passes environ)
+    qputenv(P2P_ADDRESS_ENV, address().toUtf8());
+    m_discovery = new p2pDiscovery();
+    if(!QDBusConnection::sessionBus().registerVirtualObject(P2P_DISCOVERY_PATH, m_discovery))
+        qDebug()<<Q_FUNC_INFO<<" "<<P2P_DISCOVERY_PATH<<" not registered: plugins only find the address in "<<P2P_ADDRESS_ENV;
+    qDebug()<<Q_FUNC_INFO<<" "<<address();
+    return true;
+}
+void p2pBus::close(){
+    if(m_server == NULL)
+        return;
+    QDBusConnection::sessionBus().unregisterObject(P2P_DISCOVERY_PATH);
+    delete m_discovery;
+    m_discovery = NULL;
+    for(int i=0;i<m_peers.size();i++){
+        for(int k=0;k<m_peers[i].objects.size();k++)
+            delete m_peers[i].objects[k].data();
+        QDBusConnection::disconnectFromPeer(m_peers[i].name);
+    }
+    m_peers.clear();
+    delete m_server;
+    m_server = NULL;
+    qunsetenv(P2P_ADDRESS_ENV);
+}
+QString p2pBus::address() const{
+    return m_server ? m_server->address() : QString();
+}
+void p2pBus::addPeerHandler(QObject* context, const peerHandler& handler){
+    m_handlers.push_back(std::make_pair(QPointer<QObject>(context), handler));
+    prune();
+    for(int i=0;i<m_peers.size();i++){
+        QList<QObject*> objects = handler(QDBusConnection(m_peers[i].name));
+        for(int k=0;k<objects.size();k++)
+            m_peers[i].objects.append(objects[k]);
+    }
+}
+QStringList p2pBus::peers(){
+    prune();
+    QStringList names;
+    for(int i=0;i<m_peers.size();i++)
+        names.append(m_peers[i].name);
+    return names;
+}
+void p2pBus::accept(const QDBusConnection& connection){
+    prune();
+    peer p;
+    p.name = connection.name();
+    for(std::size_t i=0;i<m_handlers.size();i++){
+        if(m_handlers[i].first.isNull())
+            continue;               //Its context is gone
+        QList<QObject*> objects = m_handlers[i].second(connection);
+        for(int k=0;k<objects.size();k++)
+            p.objects.append(objects[k]);
+    }
+    m_peers.append(p);
+    qDebug()<<Q_FUNC_INFO<<" "<<p.name<<", "<<m_peers.size()<<" peers";
+}
+void p2pBus::prune(){
+    //A plugin that quit leaves its connection closed: its proxies go with it
+    for(int i=m_peers.size()-1;i>=0;i--){
+        if(QDBusConnection(m_peers[i].name).isConnected())
+            continue;
+        for(int k=0;k<m_peers[i].objects.size();k++)
+            delete m_peers[i].objects[k].data();
+        QDBusConnection::disconnectFromPeer(m_peers[i].name);
+        m_peers.removeAt(i);
+    }
+    for(std::size_t i=m_handlers.size();i-->0;)
+        if(m_handlers[i].first.isNull())
+            m_handlers.erase(m_handlers.begin() + i);
+}
+
+// ----------------------------------------------------------
+// Benchmark
+// ----------------------------------------------------------
+//CPU seconds of a process (0: this one), -1 if it is not there
+static double cpuSeconds(qint64 pid){
+    const long long ticks = processSupervisor::cpuTicks(pid > 0 ? (pid_t)pid : getpid());
+    return ticks < 0 ? -1 : (double)ticks/sysconf(_SC_CLK_TCK);
+}
+//Receiving end: the generated proxy, as the GUI uses it. pupilAtDBus(sequence, sent at, run, 0)
+struct benchReceiver{
+    typedef std::chrono::steady_clock clock;
+    explicit benchReceiver(std::size_t capacity) : us(capacity, 0), received(0), run(-1){}
+    void connect(aura::DetectorInterface* proxy){
+        QObject::connect(proxy, &aura::DetectorInterface::pupilAtDBus, [this](double sequence, double sent, double signalRun, double){
+            const double now = std::chrono::duration<double, std::micro>(clock::now().time_since_epoch()).count();
+            //Late ones of a previous run (or of the first signal probe) are not counted
+            if((int)signalRun != run.load(std::memory_order_acquire) || sequence < 0 || sequence >= us.size())
+                return;
+            us[(std::size_t)sequence] = now - sent;
+            received.fetch_add(1, std::memory_order_release);
+        });
+    }
+    std::vector<double> us;             //Latency of every signal of the run
+    std::atomic<unsigned int> received;
+    std::atomic<int> run;
+};
+static bool sendPupil(const QDBusConnection& sender, double sequence, int run){
+    typedef std::chrono::steady_clock clock;
+    QDBusMessage pupil = QDBusMessage::createSignal(BENCH_PATH, aura::DetectorInterface::staticInterfaceName(), "pupilAtDBus");
+    pupil << sequence << std::chrono::duration<double, std::micro>(clock::now().time_since_epoch()).count() << (double)run << 0.0;
+    return sender.send(pupil);
+}
+//Signals until one arrives: the match rule of the proxy (bus) or the peer's proxy (p2p) is in place
+static bool firstSignal(const QDBusConnection& sender, benchReceiver& receiver){
+    receiver.received = 0;
+    receiver.run.store(-2, std::memory_order_release);
+    for(int i=0;i<BENCH_TIMEOUT_MS/10 && receiver.received.load(std::memory_order_acquire) == 0;i++){
+        sendPupil(sender, 0, -2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return receiver.received.load(std::memory_order_acquire) != 0;
+}
+static busBenchmarkResult deliveries(const QDBusConnection& sender, benchReceiver& receiver, int run, const QString& mode, unsigned int rate, unsigned int seconds, qint64 daemonPid){
+    typedef std::chrono::steady_clock clock;
+    busBenchmarkResult result;
+    result.mode = mode;
+    result.rate = rate;
+    result.messages = 0;
+    result.failed = 0;
+    result.meanUs = result.stdUs = result.maxUs = 0;
+    const unsigned int count = std::min<std::size_t>(rate*seconds, receiver.us.size());
+    std::fill(receiver.us.begin(), receiver.us.begin() + count, -1.0);
+    receiver.received = 0;
+    receiver.run.store(run, std::memory_order_release);
+    const clock::duration period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0/rate));
+    const double process0 = cpuSeconds(0);
+    const double daemon0 = cpuSeconds(daemonPid);
+    const clock::time_point start = clock::now();
+    for(unsigned int i=0;i<count;i++){
+        //Absolute deadlines: a slow send does not lower the rate
+        std::this_thread::sleep_until(start + period*i);
+        if(!sendPupil(sender, i, run))
+            result.failed++;
+    }
+    //What is still on its way
+    const clock::time_point drain = clock::now() + std::chrono::milliseconds(BENCH_TIMEOUT_MS);
+    while(receiver.received.load(std::memory_order_acquire) < count - result.failed && clock::now() < drain)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    receiver.run.store(-1, std::memory_order_release);
+    runningStats latency;
+    for(unsigned int i=0;i<count;i++)
+        if(receiver.us[i] >= 0)
+            latency.add(receiver.us[i]);
+    result.messages = latency.count;
+    result.failed = count - result.messages;
+    result.meanUs = latency.mean;
+    result.stdUs = latency.std();
+    result.maxUs = latency.max;
+    result.processCpu = elapsed > 0 ? 100*(cpuSeconds(0) - process0)/elapsed : 0;
+    const double daemon1 = cpuSeconds(daemonPid);
+    result.daemonCpu = daemonPid > 0 && daemon0 >= 0 && daemon1 >= 0 && elapsed > 0 ? 100*(daemon1 - daemon0)/elapsed : -1;
+    return result;
+}
+std::vector<busBenchmarkResult> p2pBus::benchmark(const std::vector<unsigned int>& rates, unsigned int seconds){
+    std::vector<busBenchmarkResult> results;
+    //The connections have fixed names
+    static std::atomic<bool> running(false);
+    if(running.exchange(true))
+        return results;
+    std::size_t capacity = 0;
+    for(std::size_t i=0;i<rates.size();i++)
+        capacity = std::max<std::size_t>(capacity, rates[i]*seconds);
+    benchReceiver receiver(capacity);
+    //The receiving end has an event loop and connections of its own, like the GUI; the sends
+    //below are made from this thread on other connections, like a plugin
+    QThread thread;
+    QObject context;
+    context.moveToThread(&thread);
+    thread.start();
+    QDBusConnection bus = QDBusConnection::connectToBus(QDBusConnection::SessionBus, "oscann-bench-sender");
+    const QString senderName = bus.isConnected() ? bus.baseService() : QString();
+    std::promise<QString> ready;
+    QTimer::singleShot(0, &context, [&](){
+        QDBusConnection receiverBus = QDBusConnection::connectToBus(QDBusConnection::SessionBus, "oscann-bench-receiver");
+        if(receiverBus.isConnected() && !senderName.isEmpty())
+            receiver.connect(new aura::DetectorInterface(senderName, BENCH_PATH, receiverBus, &context));
+        QDBusServer* server = new QDBusServer("unix:tmpdir=" + QDir::tempPath(), &context);
+        QObject::connect(server, &QDBusServer::newConnection, server, [&receiver, &context](QDBusConnection connection){
+            //Peer connection: no service name, the peer is the sender (p2pbus.h)
+            receiver.connect(new aura::DetectorInterface(QString(), BENCH_PATH, connection, &context));
+        });
+        ready.set_value(server->isConnected() ? server->address() : QString());
+    });
+    const QString address = ready.get_future().get();
+
+    int run = 0;
+    if(!senderName.isEmpty() && firstSignal(bus, receiver)){
+        QDBusReply<uint> daemon = bus.interface()->servicePid("org.freedesktop.DBus");
+        for(std::size_t i=0;i<rates.size();i++)
+            if(rates[i] > 0)
+                results.push_back(deliveries(bus, receiver, run++, "bus", rates[i], seconds, daemon.isValid() ? daemon.value() : 0));
+    }
+    QDBusConnection::disconnectFromBus("oscann-bench-sender");
+    if(!address.isEmpty()){
+        QDBusConnection peer = QDBusConnection::connectToPeer(address, "oscann-bench-peer");
+        if(peer.isConnected() && firstSignal(peer, receiver)){
+            for(std::size_t i=0;i<rates.size();i++)
+                if(rates[i] > 0)
+                    results.push_back(deliveries(peer, receiver, run++, "p2p", rates[i], seconds, 0));
+        }
+        QDBusConnection::disconnectFromPeer("oscann-bench-peer");
+    }
+
+    std::promise<void> done;
+    QTimer::singleShot(0, &context, [&](){
+        QDBusConnection::disconnectFromBus("oscann-bench-receiver");
+        qDeleteAll(context.children());
+        done.set_value();
+    });
+    done.get_future().wait();
+    thread.quit();
+    thread.wait();
+    for(std::size_t i=0;i<results.size();i++)
+        qDebug()<<Q_FUNC_INFO<<" "<<results[i].mode<<" "<<results[i].rate<<"/s: "<<results[i].meanUs<<" +- "<<results[i].stdUs<<" us (max "<<results[i].maxUs
+                <<"), CPU "<<results[i].processCpu<<"%, dbus-daemon "<<results[i].daemonCpu<<"%, lost "<<results[i].failed;
+    running = false;
+    return results;
+}
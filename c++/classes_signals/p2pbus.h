@@ -0,0 +1,85 @@
+#ifndef P2PBUS_H
+#define P2PBUS_H
+
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QDBusConnection>
+#include <QDBusServer>
+#include <QDBusVirtualObject>
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* Peer to peer DBus between the GUI and the plugins (optional, [dbus] p2p in plugins.ini).
+ * On the session bus every signal goes plugin -> dbus-daemon -> GUI and is matched against the
+ * rules of every client. Here the GUI listens on a private socket (QDBusServer) and each plugin
+ * connects straight to it: one hop, no match rules.
+ * The session bus is left for discovery: the address is in OSCANN_DBUS_P2P (inherited by the
+ * plugins started after listen()) and is also answered by org.oscann.p2p.address at /p2p of
+ * org.oscann.gui. A plugin in this mode emits its signals on the peer connection only.
+ * The generated adaptors and proxies are used as they are: the GUI registers its objects on
+ * every peer connection and creates its proxies there with an empty service name (the peer is
+ * the plugin). Whoever needs them adds a peer handler.
+ * GUI thread only, except benchmark().*/
+#define P2P_ADDRESS_ENV     "OSCANN_DBUS_P2P"
+#define P2P_DISCOVERY_PATH  "/p2p"
+#define P2P_INTERFACE       "org.oscann.p2p"
+
+//Delivery of pupilAtDBus signals at a fixed rate, from the send to the slot of the proxy.
+//Sender and receiver are threads of one process (no second scheduling, no cross process
+//wake-up), so the latencies are a lower bound of what a plugin sees
+struct busBenchmarkResult{
+    QString mode;                   //"bus" or "p2p"
+    unsigned int rate;              //Signals per second sent
+    unsigned int messages;          //Received
+    unsigned int failed;            //Not sent, or not received within a second of the last send
+    double meanUs;                  //Send to delivery
+    double stdUs;
+    double maxUs;
+    double processCpu;              //% of one core: both ends run in this process
+    double daemonCpu;               //dbus-daemon, % of one core. -1: p2p or not known
+};
+
+class p2pBus{
+public:
+    //Registers the objects of context on a new peer and creates its proxies there.
+    //Returns the objects to delete when the peer goes
+    typedef std::function<QList<QObject*>(QDBusConnection)> peerHandler;
+    static p2pBus& instance();
+    bool listen();
+    void close();
+    bool isListening() const {return m_server != NULL;}
+    QString address() const;
+    //Also called for the peers already connected. Dropped when context is destroyed
+    void addPeerHandler(QObject* context, const peerHandler& handler);
+    QStringList peers();
+    std::string getLastError(){return m_errorMsg;}
+    //rates: signals per second, seconds per rate. The sender is the calling thread; the receiver
+    //(a generated aura::DetectorInterface proxy) has a thread and connections of its own.
+    //Blocks for about rates.size()*2*(seconds + 1) s: not on the GUI thread. One run at a
+    //time, a second one returns no results
+    static std::vector<busBenchmarkResult> benchmark(const std::vector<unsigned int>& rates, unsigned int seconds);
+private:
+    struct peer{
+        QString name;
+        QList<QPointer<QObject>> objects;
+    };
+    p2pBus();
+    p2pBus(const p2pBus&);
+    p2pBus& operator=(const p2pBus&);
+    void accept(const QDBusConnection& connection);
+    void prune();
+
+    QDBusServer* m_server;
+    QDBusVirtualObject* m_discovery;
+    std::vector<std::pair<QPointer<QObject>, peerHandler>> m_handlers;
+    QList<peer> m_peers;
+    std::string m_errorMsg;
+};
+
+#endif // P2PBUS_H
@@ -19,6 +19,10 @@
 #include <chrono>
 #include <thread>
 #include <future>
+#include <atomic>
+#include <QEvent>
+#include <QCoreApplication>
+#include "timerservice.h"
 
 
 #include "utilsprocess.h"
@@ -59,16 +63,64 @@ Q_CLASSINFO("Status", "Active")
  * boost::asio: It is not an option because io_service runs a method that blocks the program and the UI
  *              The timer accuracy is suitable. For ten milliseconds aprox mean 10.070 std 0.02
  *
- *
+ * All the OTimers share the thread of timerService (timerservice.h), which keeps absolute deadlines.
+ * timeoutSignal() is emitted from the thread of the OTimer: the service posts an event, and does not
+ * post another one while the last one is not delivered (the missed expirations are counted instead).
  * */
 class OTimer : public QObject{
     Q_OBJECT
-    std::thread m_th;
-    bool m_running = false;
+    std::atomic<bool> m_running;
+    std::atomic<unsigned int> m_pending;        //Generation of the undelivered event, 0: none
+    std::atomic<unsigned int> m_generation;     //Events of a stopped start() are dropped
+    std::atomic<uint64_t> m_coalesced;
     std::chrono::microseconds m_interval;
+    bool m_repeat = false;
+    timerService::timerId m_id = 0;
+    class timeoutEvent : public QEvent{
+    public:
+        explicit timeoutEvent(unsigned int generation) : QEvent(eventType()), generation(generation){}
+        static QEvent::Type eventType(){
+            static const QEvent::Type t = static_cast<QEvent::Type>(QEvent::registerEventType());
+            return t;
+        }
+        const unsigned int generation;
+    };
+    void schedule(const std::chrono::nanoseconds &interval, const bool repeat){
+        stop();
+        unsigned int generation = ++m_generation;
+        if(generation == 0)
+            generation = ++m_generation;        //0 is "no event pending"
+        m_repeat = repeat;
+        m_running = true;
+        m_id = timerService::instance().add(interval, repeat, [this, generation](uint64_t){
+            //Service thread: the event loop of this object gets at most one pending timeout. One
+            //of a previous start() still queued is not ours: it is dropped, so ours is posted
+            if(m_pending.exchange(generation) == generation){
+                m_coalesced++;
+                return;
+            }
+            QCoreApplication::postEvent(this, new timeoutEvent(generation));
+        });
+    }
+protected:
+    bool event(QEvent *e){
+        if(e->type() != timeoutEvent::eventType())
+            return QObject::event(e);
+        const timeoutEvent *timeout = static_cast<timeoutEvent*>(e);
+        //Only its own event clears it: after a stale one, the current generation still has one queued
+        unsigned int generation = timeout->generation;
+        m_pending.compare_exchange_strong(generation, 0);
+        if(m_running && timeout->generation == m_generation){
+            if(!m_repeat)
+                m_running = false;
+            emit timeoutSignal();
+        }
+        return true;
+    }
 public:
-    OTimer(QObject *parent) : QObject(parent){}
+    OTimer(QObject *parent) : QObject(parent), m_running(false), m_pending(0), m_generation(0), m_coalesced(0), m_interval(0){}
     virtual ~OTimer(){
+        stop();
     }
     typedef std::chrono::microseconds Interval;
     typedef std::chrono::nanoseconds NanoInterval;
@@ -77,46 +129,27 @@ public:
         m_interval = interval;
     }
     void start(){
-        Interval interval = m_interval;
-        m_running = true;
-        m_th = std::thread([=](){
-            while (m_running == true) {
-                std::this_thread::sleep_for(interval);
-                emit timeoutSignal();
-            }
-            m_th.detach();
-        });
+        schedule(m_interval, true);
     }
     void start(const Interval &interval){
-        m_running = true;
-        m_th = std::thread([=](){
-            while (m_running == true) {
-                std::this_thread::sleep_for(interval);
-                emit timeoutSignal();
-            }
-            m_th.detach();
-        });
-
+        schedule(interval, true);
     }
     void stop(){
         m_running = false;
+        if(m_id != 0)
+            timerService::instance().cancel(m_id);
+        m_id = 0;
     }
     void singleShot(const Interval &interval){
-        m_running = true;
-        m_th = std::thread([=](){
-                std::this_thread::sleep_for(interval);
-                if(m_running)
-                    emit timeoutSignal();
-        });
+        schedule(interval, false);
     }
     void singleShotNano(const NanoInterval &interval){
-        m_running = true;
-        m_th = std::thread([=](){
-                std::this_thread::sleep_for(interval);
-                if(m_running)
-                    emit timeoutSignal();
-        });
+        schedule(interval, false);
     }
+    //Lateness of the expirations of the running periodic timer
+    timerJitter jitter(){return timerService::instance().jitter(m_id);}
+    //Expirations not delivered because the previous timeoutSignal() was still pending
+    uint64_t coalesced(){return m_coalesced;}
 signals:
     void timeoutSignal();
 };
@@ -0,0 +1,152 @@
+#include "timerservice.h"
+
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+
+#include <algorithm>
+#include <vector>
+
+void timerJitter::add(double lateUs){
+    lateness.add(lateUs);
+    expirations = lateness.count;
+    meanUs = lateness.mean;
+    stdUs = lateness.std();
+    maxUs = lateness.max;
+}
+
+timerService& timerService::instance(){
+    static timerService service;
+    return service;
+}
+timerService::timerService() : m_nextId(1), m_firing(0), m_running(true){
+    m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    m_wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    m_thread = std::thread(&timerService::run, this);
+}
+timerService::~timerService(){
+    m_running = false;
+    wake();
+    m_thread.join();
+    close(m_timerFd);
+    close(m_wakeFd);
+}
+int64_t timerService::now(){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+void timerService::wake(){
+    uint64_t one = 1;
+    ssize_t r = write(m_wakeFd, &one, sizeof(one));
+    (void)r;
+}
+timerService::timerId timerService::add(std::chrono::nanoseconds interval, bool repeat, const callback& fn){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    timer t;
+    t.interval = std::max<int64_t>(1, interval.count());
+    t.deadline = now() + t.interval;
+    t.repeat = repeat;
+    t.fn = fn;
+    const timerId id = m_nextId++;
+    m_timers[id] = t;
+    wake();
+    return id;
+}
+void timerService::cancel(timerId id){
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_timers.erase(id);
+    //From another thread: wait for a callback of this timer in progress
+    if(std::this_thread::get_id() != m_thread.get_id())
+        m_idle.wait(lock, [this, id]{return m_firing != id;});
+    wake();
+}
+timerJitter timerService::jitter(timerId id) const{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::map<timerId, timer>::const_iterator it = m_timers.find(id);
+    return it != m_timers.end() ? it->second.jitter : timerJitter();
+}
+timerJitter timerService::jitter() const{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_jitter;
+}
+void timerService::arm(){
+    //Nearest deadline; none: disarmed
+    int64_t nearest = -1;
+    for(std::map<timerId, timer>::const_iterator it=m_timers.begin();it!=m_timers.end();++it)
+        if(nearest < 0 || it->second.deadline < nearest)
+            nearest = it->second.deadline;
+    itimerspec spec = itimerspec();
+    if(nearest >= 0){
+        spec.it_value.tv_sec = nearest/1000000000LL;
+        spec.it_value.tv_nsec = nearest%1000000000LL;
+        if(spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+            spec.it_value.tv_nsec = 1;      //Zero would disarm it
+    }
+    timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+void timerService::run(){
+    //Default slack (50 us) would be added to every wake-up
+    prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+    pollfd fds[2];
+    fds[0].fd = m_timerFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = m_wakeFd;
+    fds[1].events = POLLIN;
+    std::vector<std::pair<timerId, uint64_t>> due;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(m_running){
+        arm();
+        lock.unlock();
+        poll(fds, 2, -1);
+        uint64_t count;
+        ssize_t r = read(m_timerFd, &count, sizeof(count));
+        r = read(m_wakeFd, &count, sizeof(count));
+        (void)r;
+        lock.lock();
+        const int64_t t = now();
+        due.clear();
+        for(std::map<timerId, timer>::iterator it=m_timers.begin();it!=m_timers.end();){
+            timer& tm = it->second;
+            if(tm.deadline > t){
+                ++it;
+                continue;
+            }
+            const double lateUs = (t - tm.deadline)/1000.0;
+            tm.jitter.add(lateUs);
+            m_jitter.add(lateUs);
+            uint64_t overruns = 0;
+            if(tm.repeat){
+                //Next deadline on the grid of the first one; whole periods already gone are skipped
+                overruns = (uint64_t)((t - tm.deadline)/tm.interval);
+                tm.deadline += (int64_t)(overruns + 1)*tm.interval;
+                tm.jitter.overruns += overruns;
+                m_jitter.overruns += overruns;
+            }
+            due.push_back(std::make_pair(it->first, overruns));
+            if(!tm.repeat){
+                //Kept for the callback below, erased after it
+                tm.deadline = INT64_MAX;
+            }
+            ++it;
+        }
+        for(std::size_t i=0;i<due.size();i++){
+            std::map<timerId, timer>::iterator it = m_timers.find(due[i].first);
+            if(it == m_timers.end())
+                continue;           //Cancelled by a previous callback
+            callback fn = it->second.fn;
+            const bool single = !it->second.repeat;
+            m_firing = due[i].first;
+            lock.unlock();
+            fn(due[i].second);
+            lock.lock();
+            m_firing = 0;
+            m_idle.notify_all();
+            if(single)
+                m_timers.erase(due[i].first);
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef TIMERSERVICE_H
+#define TIMERSERVICE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "runningstats.h"
+
+/* One thread for all the OTimers.
+ * Deadlines are absolute (CLOCK_MONOTONIC): a periodic timer fires at start + k*interval, so
+ * late wake-ups do not add up. The thread sleeps in poll() on a timerfd armed for the nearest
+ * deadline (TFD_TIMER_ABSTIME, timer slack of 1 ns) and on an eventfd that wakes it when the
+ * timer list changes.
+ * Callbacks run on the service thread and must be short: OTimer only posts an event to its
+ * own thread. Periods missed entirely are not replayed, they are passed as overruns.
+ * Lateness of every expiration (wake-up time - deadline) is kept per timer and for the service.*/
+struct timerJitter{
+    uint64_t expirations = 0;
+    uint64_t overruns = 0;          //Periods skipped because the previous expiration was too late
+    double meanUs = 0;              //Lateness
+    double stdUs = 0;
+    double maxUs = 0;
+    runningStats lateness;
+    void add(double lateUs);
+};
+
+class timerService{
+public:
+    typedef unsigned int timerId;
+    typedef std::function<void(uint64_t overruns)> callback;
+    static timerService& instance();
+    //interval > 0. The first expiration is one interval from now
+    timerId add(std::chrono::nanoseconds interval, bool repeat, const callback& fn);
+    //When it returns the callback is not running and will not run again
+    void cancel(timerId id);
+    timerJitter jitter(timerId id) const;
+    timerJitter jitter() const;
+private:
+    struct timer{
+        int64_t deadline;           //ns, CLOCK_MONOTONIC
+        int64_t interval;
+        bool repeat;
+        callback fn;
+        timerJitter jitter;
+    };
+    timerService();
+    ~timerService();
+    timerService(const timerService&);
+    timerService& operator=(const timerService&);
+    static int64_t now();
+    void wake();
+    void arm();
+    void run();
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_idle;
+    std::map<timerId, timer> m_timers;
+    timerId m_nextId;
+    timerId m_firing;               //Callback being run (0: none)
+    timerJitter m_jitter;
+    int m_timerFd;
+    int m_wakeFd;
+    std::atomic<bool> m_running;
+    std::thread m_thread;
+};
+
+#endif // TIMERSERVICE_H
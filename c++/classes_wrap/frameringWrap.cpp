@@ -0,0 +1,204 @@
+#include "frameringWrap.h"
+
+#if V8_MAJOR_VERSION < 8
+#error "frameringWrap needs v8::BackingStore (Node 14 or later)"
+#endif
+
+using v8::ArrayBuffer;
+using v8::BackingStore;
+using v8::Boolean;
+using v8::Context;
+using v8::Function;
+using v8::FunctionCallbackInfo;
+using v8::FunctionTemplate;
+using v8::Isolate;
+using v8::Local;
+using v8::Null;
+using v8::Number;
+using v8::Object;
+using v8::ObjectTemplate;
+using v8::String;
+using v8::Uint8Array;
+using v8::Value;
+
+frameringWrap::frameringWrap(const std::string& stream) : stream_(stream), generation_(0) {
+}
+
+frameringWrap::~frameringWrap() {
+}
+
+void frameringWrap::Init(Local<Object> exports) {
+  Isolate* isolate = exports->GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  Local<ObjectTemplate> addon_data_tpl = ObjectTemplate::New(isolate);
+  addon_data_tpl->SetInternalFieldCount(1);  // 1 field for the frameringWrap::New()
+  Local<Object> addon_data =
+      addon_data_tpl->NewInstance(context).ToLocalChecked();
+
+  // Prepare constructor template
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(isolate, New, addon_data);
+  tpl->SetClassName(String::NewFromUtf8(isolate, "frameringWrap").ToLocalChecked());
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  // Prototype
+  NODE_SET_PROTOTYPE_METHOD(tpl, "latest", Latest);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "next", Next);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "isValid", IsValid);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "head", Head);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "dropped", Dropped);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "close", Close);
+
+  Local<Function> constructor = tpl->GetFunction(context).ToLocalChecked();
+  addon_data->SetInternalField(0, constructor);
+  exports->Set(context, String::NewFromUtf8(
+      isolate, "frameringWrap").ToLocalChecked(),
+      constructor).FromJust();
+}
+
+// new frameringWrap([stream]): "camera" by default, or any stream of shmRegistry
+void frameringWrap::New(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  if (args.IsConstructCall()) {
+    std::string stream = CAMERA_STREAM;
+    if (args[0]->IsString())
+      stream = *String::Utf8Value(isolate, args[0]);
+    frameringWrap* obj = new frameringWrap(stream);
+    obj->Wrap(args.This());
+    args.GetReturnValue().Set(args.This());
+  } else {
+    const int argc = 1;
+    Local<Value> argv[argc] = { args[0] };
+    Local<Function> cons =
+        args.Data().As<Object>()->GetInternalField(0).As<Function>();
+    Local<Object> result =
+        cons->NewInstance(context, argc, argv).ToLocalChecked();
+    args.GetReturnValue().Set(result);
+  }
+}
+
+bool frameringWrap::open() {
+  streamDescriptor desc;
+  const bool registered = shmRegistry::instance().find(stream_.c_str(), desc) && desc.kind == SHM_FRAME_RING;
+  if (ring_ && ring_->isOpen() && (!registered || desc.generation == generation_))
+    return true;
+  const char* segment = registered ? desc.segment : (stream_ == CAMERA_STREAM ? FRAME_RING_NAME : NULL);
+  if (segment == NULL)
+    return false;
+  // A new reader: the buffers of the old one keep its mapping until they are collected
+  std::shared_ptr<frameRingReader> ring = std::make_shared<frameRingReader>();
+  if (!ring->open(segment, true))
+    return false;
+  ring_ = ring;
+  generation_ = registered ? desc.generation : 0;
+  buffers_.clear();
+  buffers_.resize(ring_->slots());
+  return true;
+}
+
+Local<Value> frameringWrap::frame(Isolate* isolate, const frameView& view) {
+  Local<Context> context = isolate->GetCurrentContext();
+  v8::Global<ArrayBuffer>& cached = buffers_[view.slot];
+  Local<ArrayBuffer> buffer;
+  if (cached.IsEmpty()) {
+    std::shared_ptr<frameRingReader>* owner = new std::shared_ptr<frameRingReader>(ring_);
+    std::unique_ptr<BackingStore> store = ArrayBuffer::NewBackingStore(
+        const_cast<uchar*>(ring_->slotPixels(view.slot)), ring_->slotBytes(),
+        [](void*, size_t, void* owner) { delete static_cast<std::shared_ptr<frameRingReader>*>(owner); },
+        owner);
+    buffer = ArrayBuffer::New(isolate, std::move(store));
+    cached.Reset(isolate, buffer);
+  } else {
+    buffer = cached.Get(isolate);
+  }
+
+  Local<Object> result = Object::New(isolate);
+  result->Set(context, String::NewFromUtf8(isolate, "data").ToLocalChecked(), Uint8Array::New(buffer, 0, view.bytes)).FromJust();
+  static const char* names[] = {"frameId", "timestamp", "width", "height", "step", "channels", "originX", "originY", "slot", "seq", "generation"};
+  const double values[] = {(double)view.info.frameId, (double)view.info.timestamp, (double)view.info.width, (double)view.info.height, (double)view.step,
+                           view.info.format == FRAME_RGB888 ? 3.0 : 1.0, (double)view.info.originX, (double)view.info.originY, (double)view.slot, (double)view.seq, (double)generation_};
+  for (std::size_t k = 0; k < sizeof(values)/sizeof(values[0]); k++)
+    result->Set(context, String::NewFromUtf8(isolate, names[k]).ToLocalChecked(), Number::New(isolate, values[k])).FromJust();
+  return result;
+}
+
+// latest(): newest frame not returned yet, or null
+void frameringWrap::Latest(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+
+  frameringWrap* obj = ObjectWrap::Unwrap<frameringWrap>(args.Holder());
+  frameView view;
+  if (!obj->open() || !obj->ring_->viewLatest(view)) {
+    args.GetReturnValue().Set(Null(isolate));
+    return;
+  }
+  args.GetReturnValue().Set(obj->frame(isolate, view));
+}
+
+// next(): oldest frame not returned yet (recorders), or null. See dropped()
+void frameringWrap::Next(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+
+  frameringWrap* obj = ObjectWrap::Unwrap<frameringWrap>(args.Holder());
+  frameView view;
+  if (!obj->open() || !obj->ring_->viewNext(view)) {
+    args.GetReturnValue().Set(Null(isolate));
+    return;
+  }
+  args.GetReturnValue().Set(obj->frame(isolate, view));
+}
+
+// isValid(frame) or isValid(slot, seq[, generation]): the slot still holds that frame, in the
+// ring it was read from (a recreated ring has another generation). No copy, no syscall
+void frameringWrap::IsValid(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  frameringWrap* obj = ObjectWrap::Unwrap<frameringWrap>(args.Holder());
+  frameView view;
+  uint64_t generation = obj->generation_;
+  if (args[0]->IsObject()) {
+    Local<Object> frame = args[0].As<Object>();
+    view.slot = frame->Get(context, String::NewFromUtf8(isolate, "slot").ToLocalChecked()).ToLocalChecked()->Uint32Value(context).FromMaybe(0);
+    view.seq = (uint64_t)frame->Get(context, String::NewFromUtf8(isolate, "seq").ToLocalChecked()).ToLocalChecked()->NumberValue(context).FromMaybe(1);
+    Local<Value> value;
+    if (!frame->Get(context, String::NewFromUtf8(isolate, "generation").ToLocalChecked()).ToLocal(&value) || !value->IsNumber()) {
+      args.GetReturnValue().Set(Boolean::New(isolate, false));
+      return;
+    }
+    generation = (uint64_t)value.As<Number>()->Value();
+  } else {
+    view.slot = args[0]->Uint32Value(context).FromMaybe(0);
+    view.seq = (uint64_t)args[1]->NumberValue(context).FromMaybe(1);
+    if (args.Length() > 2)
+      generation = (uint64_t)args[2]->NumberValue(context).FromMaybe(0);
+  }
+  // The registry may already hold a new ring: open() moves to it and changes generation_
+  const bool valid = obj->open() && generation == obj->generation_ && obj->ring_->isValid(view);
+  args.GetReturnValue().Set(Boolean::New(isolate, valid));
+}
+
+void frameringWrap::Head(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+
+  frameringWrap* obj = ObjectWrap::Unwrap<frameringWrap>(args.Holder());
+  obj->open();
+  args.GetReturnValue().Set(Number::New(isolate, obj->ring_ ? (double)obj->ring_->head() : 0));
+}
+
+void frameringWrap::Dropped(const FunctionCallbackInfo<Value>& args) {
+  Isolate* isolate = args.GetIsolate();
+
+  frameringWrap* obj = ObjectWrap::Unwrap<frameringWrap>(args.Holder());
+  args.GetReturnValue().Set(Number::New(isolate, obj->ring_ ? (double)obj->ring_->dropped() : 0));
+}
+
+// close(): the mapping goes when the frames already returned are collected
+void frameringWrap::Close(const FunctionCallbackInfo<Value>& args) {
+  frameringWrap* obj = ObjectWrap::Unwrap<frameringWrap>(args.Holder());
+  obj->buffers_.clear();
+  obj->ring_.reset();
+  obj->generation_ = 0;
+}
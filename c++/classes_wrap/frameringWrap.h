@@ -0,0 +1,51 @@
+#ifndef FRAMERINGWRAP_H
+#define FRAMERINGWRAP_H
+
+#include <node.h>
+#include <node_object_wrap.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "framering.h"
+#include "shmregistry.h"
+
+/* Frames of a shared memory ring for JS, without copies.
+ * Each slot of the ring is an external ArrayBuffer over the mapped pixels (created once per
+ * slot); latest()/next() return a Uint8Array over the bytes of the frame with its metadata and
+ * the seqlock value of the slot and the generation of the ring. The capturer keeps writing the
+ * ring, and may create a new one: the pixels belong to the frame only while isValid(frame) is
+ * true, so check it after using them (or copy them first).
+ * The mapping is copy on write: a write from JS does not reach the ring, but that page of the
+ * slot then stops following it in this process. Do not write into the frames.
+ * The buffers keep the mapping alive: it is released with the last of them.
+ * Needs V8 external backing stores: not available with the V8 sandbox (Electron >= 21).*/
+class frameringWrap : public node::ObjectWrap {
+ public:
+  static void Init(v8::Local<v8::Object> exports);
+
+ private:
+  explicit frameringWrap(const std::string& stream);
+  ~frameringWrap();
+
+  //(Re)opens the ring when the producer created a new one
+  bool open();
+  v8::Local<v8::Value> frame(v8::Isolate* isolate, const frameView& view);
+
+  std::string stream_;
+  uint64_t generation_;
+  std::shared_ptr<frameRingReader> ring_;
+  std::vector<v8::Global<v8::ArrayBuffer>> buffers_;   //One per slot of ring_
+
+  static void New(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Latest(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Next(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void IsValid(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Head(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Dropped(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Close(const v8::FunctionCallbackInfo<v8::Value>& args);
+};
+
+
+#endif
@@ -1,5 +1,12 @@
 #include "usbdevWrap.h"
 
+#include <QEventLoop>
+#include <QTimer>
+
+#include <thread>
+
+using v8::Array;
+using v8::Boolean;
 using v8::Context;
 using v8::Function;
 using v8::FunctionCallbackInfo;
@@ -9,10 +16,11 @@ using v8::Local;
 using v8::Number;
 using v8::Object;
 using v8::ObjectTemplate;
+using v8::Promise;
 using v8::String;
 using v8::Value;
 
-usbdevWrap::usbdevWrap(double value) : value_(value) {
+usbdevWrap::usbdevWrap(double value) : value_(value), oscannlight(NULL), VS(NULL), CV(NULL), app(NULL) {
 }
 
 usbdevWrap::~usbdevWrap() {
@@ -36,6 +44,14 @@ void usbdevWrap::Init(Local<Object> exports) {
   NODE_SET_PROTOTYPE_METHOD(tpl, "plusOneWrap", plusOne);
   NODE_SET_PROTOTYPE_METHOD(tpl, "openDeviceWrap", openDevice);
   NODE_SET_PROTOTYPE_METHOD(tpl, "serviceSlotWrap", serviceSlot);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "processBatchWrap", processBatch);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "resumeProcessingWrap", resumeProcessing);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "cancelProcessingWrap", cancelProcessing);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "processingJobsWrap", processingJobs);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "startLatencyWrap", startLatency);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "gazeSamplesWrap", gazeSamples);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "pluginStatisticsWrap", pluginStatistics);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "dbusBenchmarkWrap", dbusBenchmark);
   NODE_SET_PROTOTYPE_METHOD(tpl, "MainWrap", mainWrap);
 
   Local<Function> constructor = tpl->GetFunction(context).ToLocalChecked();
@@ -86,6 +102,9 @@ void usbdevWrap::openDevice(const FunctionCallbackInfo<v8::Value>& args){
   args.GetReturnValue().Set(Number::New(isolate, res));
 }
 
+#define CAPTURER_WAIT_MS 5000
+#define CAPTURER_POLL_MS 5
+
 void usbdevWrap::serviceSlot(const FunctionCallbackInfo<v8::Value>& args){
   Isolate* isolate = args.GetIsolate();
 
@@ -94,10 +113,21 @@ void usbdevWrap::serviceSlot(const FunctionCallbackInfo<v8::Value>& args){
 
   qDebug() << "cameraType: " << obj->VS->getCameraType();
 
+  const unsigned int statuses = obj->VS->capturerStatuses();
   obj->VS->serviceSlot(1, "bgVideoCapturer", 1, "", 120);
   //obj->VS.serviceSlot(1, "bgVideoCapturer", 0, "", 120);
 
-  usleep(5000000);
+  //Until the capturer reports its camera (statusChangedDBus), 5 s at most. Counted by
+  //Videostreaming::capturerReady, which the peer proxies of a p2p capturer reach too
+  QEventLoop wait;
+  QTimer poll;
+  QObject::connect(&poll, &QTimer::timeout, &wait, [&](){
+    if (obj->VS->capturerStatuses() != statuses)
+      wait.quit();
+  });
+  poll.start(CAPTURER_POLL_MS);
+  QTimer::singleShot(CAPTURER_WAIT_MS, &wait, &QEventLoop::quit);
+  wait.exec();
 
   qDebug() << "cameraType: " << obj->VS->getCameraType();
 
@@ -140,4 +170,228 @@ int usbdevWrap::main(){
   //return 20;
 }
 
+// processBatchWrap([directories], fps, [concurrency]): jobs submitted; without directories, the queue
+void usbdevWrap::processBatch(const FunctionCallbackInfo<v8::Value>& args){
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  usbdevWrap* obj = ObjectWrap::Unwrap<usbdevWrap>(args.Holder());
+  if (!obj->VS)
+    return;                 // Before MainWrap()
+  const int first = args[0]->IsArray() ? 1 : 0;
+  unsigned int jobs = 0;
+  unsigned int fps = args[first]->IsUndefined() ? 120 : args[first]->Uint32Value(context).FromMaybe(120);
+  unsigned int concurrency = args[first + 1]->IsUndefined() ? 0 : args[first + 1]->Uint32Value(context).FromMaybe(0);
+  if (first) {
+    Local<Array> list = args[0].As<Array>();
+    QStringList directories;
+    for (uint32_t i = 0; i < list->Length(); i++)
+      directories.push_back(QString::fromUtf8(*String::Utf8Value(isolate, list->Get(context, i).ToLocalChecked())));
+    jobs = obj->VS->processBatch(directories, fps, concurrency);
+  } else {
+    jobs = obj->VS->processBatch(fps, concurrency);
+  }
+  args.GetReturnValue().Set(Number::New(isolate, jobs));
+}
+
+// resumeProcessingWrap([concurrency]): jobs of the journal queued again
+void usbdevWrap::resumeProcessing(const FunctionCallbackInfo<v8::Value>& args){
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  usbdevWrap* obj = ObjectWrap::Unwrap<usbdevWrap>(args.Holder());
+  if (!obj->VS)
+    return;                 // Before MainWrap()
+  unsigned int concurrency = args[0]->IsUndefined() ? 0 : args[0]->Uint32Value(context).FromMaybe(0);
+  args.GetReturnValue().Set(Number::New(isolate, obj->VS->resumeProcessing(concurrency)));
+}
+
+// cancelProcessingWrap(id)
+void usbdevWrap::cancelProcessing(const FunctionCallbackInfo<v8::Value>& args){
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  usbdevWrap* obj = ObjectWrap::Unwrap<usbdevWrap>(args.Holder());
+  if (!obj->VS)
+    return;                 // Before MainWrap()
+  unsigned int id = args[0]->Uint32Value(context).FromMaybe(0);
+  args.GetReturnValue().Set(Boolean::New(isolate, obj->VS->cancelProcessing(id)));
+}
 
+// processingJobsWrap(): state (jobscheduler.h jobState) and progress of every job of the batch
+void usbdevWrap::processingJobs(const FunctionCallbackInfo<v8::Value>& args){
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  usbdevWrap* obj = ObjectWrap::Unwrap<usbdevWrap>(args.Holder());
+  if (!obj->VS)
+    return;                 // Before MainWrap()
+  QVector<processingJob> jobs = obj->VS->processingJobs();
+
+  Local<Array> result = Array::New(isolate, jobs.size());
+  for (int i = 0; i < jobs.size(); i++) {
+    const processingJob& j = jobs.at(i);
+    Local<Object> job = Object::New(isolate);
+    job->Set(context, String::NewFromUtf8(isolate, "directory").ToLocalChecked(), String::NewFromUtf8(isolate, j.directory.toUtf8().constData()).ToLocalChecked()).FromJust();
+    static const char* names[] = {"id", "priority", "frames", "state", "progress"};
+    const double values[] = {(double)j.id, (double)j.priority, (double)j.frames, (double)j.state, j.progress};
+    for (std::size_t k = 0; k < sizeof(values)/sizeof(values[0]); k++)
+      job->Set(context, String::NewFromUtf8(isolate, names[k]).ToLocalChecked(), Number::New(isolate, values[k])).FromJust();
+    result->Set(context, i, job).FromJust();
+  }
+  args.GetReturnValue().Set(result);
+}
+
+// startLatencyWrap([name]): ms from the session asking for the plugin to its readiness (bgPupilDetection)
+void usbdevWrap::startLatency(const FunctionCallbackInfo<v8::Value>& args){
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  usbdevWrap* obj = ObjectWrap::Unwrap<usbdevWrap>(args.Holder());
+  if (!obj->VS)
+    return;                 // Before MainWrap()
+  QString name = "bgPupilDetection";
+  if (args[0]->IsString())
+    name = QString::fromUtf8(*String::Utf8Value(isolate, args[0]));
+  standbyLatency latency = obj->VS->startLatency(name);
+
+  Local<Object> result = Object::New(isolate);
+  static const char* names[] = {"sessions", "standby", "lastMs", "meanMs", "maxMs"};
+  const double values[] = {(double)latency.sessions, (double)latency.standby, latency.lastMs, latency.meanMs, latency.maxMs};
+  for (std::size_t k = 0; k < sizeof(values)/sizeof(values[0]); k++)
+    result->Set(context, String::NewFromUtf8(isolate, names[k]).ToLocalChecked(), Number::New(isolate, values[k])).FromJust();
+  args.GetReturnValue().Set(result);
+}
+
+// gazeSamplesWrap([max]): detector samples not read yet, oldest first
+void usbdevWrap::gazeSamples(const FunctionCallbackInfo<v8::Value>& args){
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  usbdevWrap* obj = ObjectWrap::Unwrap<usbdevWrap>(args.Holder());
+  if (!obj->VS)
+    return;                 // Before MainWrap()
+  double max = args[0]->IsUndefined() ?
+      GAZE_RING_CAPACITY : args[0]->NumberValue(context).FromMaybe(GAZE_RING_CAPACITY);
+  std::vector<gazeSample> samples;
+  obj->VS->readGaze(samples, max > 0 ? (std::size_t)max : 0);
+
+  static const char* names[] = {"frameId", "timestamp", "pupilX", "pupilY", "ellipseX", "ellipseY", "ellipseWidth", "ellipseHeight", "ellipseAngle",
+                                "leftGlintX", "leftGlintY", "rightGlintX", "rightGlintY", "error", "flags"};
+  Local<Array> result = Array::New(isolate, samples.size());
+  for (std::size_t i = 0; i < samples.size(); i++) {
+    const gazeSample& s = samples[i];
+    Local<Object> sample = Object::New(isolate);
+    const double values[] = {(double)s.frameId, (double)s.timestamp, s.pupilX, s.pupilY, s.ellipseX, s.ellipseY, s.ellipseWidth, s.ellipseHeight, s.ellipseAngle,
+                             s.leftGlintX, s.leftGlintY, s.rightGlintX, s.rightGlintY, (double)s.error, (double)s.flags};
+    for (std::size_t k = 0; k < sizeof(values)/sizeof(values[0]); k++)
+      sample->Set(context, String::NewFromUtf8(isolate, names[k]).ToLocalChecked(), Number::New(isolate, values[k])).FromJust();
+    result->Set(context, i, sample).FromJust();
+  }
+  args.GetReturnValue().Set(result);
+}
+
+// pluginStatisticsWrap(): pid, restarts, hangs, CPU (% of one core) and RSS (bytes) of every plugin
+void usbdevWrap::pluginStatistics(const FunctionCallbackInfo<v8::Value>& args){
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  usbdevWrap* obj = ObjectWrap::Unwrap<usbdevWrap>(args.Holder());
+  if (!obj->VS)
+    return;                 // Before MainWrap()
+  std::vector<pluginStats> plugins = obj->VS->pluginStatistics();
+
+  Local<Array> result = Array::New(isolate, plugins.size());
+  for (std::size_t i = 0; i < plugins.size(); i++) {
+    const pluginStats& p = plugins[i];
+    Local<Object> plugin = Object::New(isolate);
+    plugin->Set(context, String::NewFromUtf8(isolate, "name").ToLocalChecked(), String::NewFromUtf8(isolate, p.name.c_str()).ToLocalChecked()).FromJust();
+    Local<Array> pluginArgs = Array::New(isolate, p.args.size());
+    for (std::size_t k = 0; k < p.args.size(); k++)
+      pluginArgs->Set(context, k, String::NewFromUtf8(isolate, p.args[k].c_str()).ToLocalChecked()).FromJust();
+    plugin->Set(context, String::NewFromUtf8(isolate, "args").ToLocalChecked(), pluginArgs).FromJust();
+    static const char* names[] = {"pid", "restarts", "hangs", "cpu", "rss", "lastStatus"};
+    const double values[] = {(double)p.pid, (double)p.restarts, (double)p.hangs, p.cpu, (double)p.rss, (double)p.lastStatus};
+    for (std::size_t k = 0; k < sizeof(values)/sizeof(values[0]); k++)
+      plugin->Set(context, String::NewFromUtf8(isolate, names[k]).ToLocalChecked(), Number::New(isolate, values[k])).FromJust();
+    result->Set(context, i, plugin).FromJust();
+  }
+  args.GetReturnValue().Set(result);
+}
+
+// Run of dbusBenchmarkWrap: the worker fills results, the loop of node settles the promise
+struct dbusBenchmarkRequest {
+  uv_async_t async;
+  Isolate* isolate;
+  v8::Global<Context> context;
+  v8::Global<Promise::Resolver> resolver;
+  std::vector<unsigned int> rates;
+  unsigned int seconds;
+  std::vector<busBenchmarkResult> results;
+};
+
+static void dbusBenchmarkDone(uv_async_t* async) {
+  dbusBenchmarkRequest* request = static_cast<dbusBenchmarkRequest*>(async->data);
+  Isolate* isolate = request->isolate;
+  v8::HandleScope scope(isolate);
+  Local<Context> context = request->context.Get(isolate);
+  Context::Scope contextScope(context);
+  // Runs the microtasks of the promise when it closes
+  node::CallbackScope callbackScope(isolate, Object::New(isolate), node::async_context{0, 0});
+
+  Local<Promise::Resolver> resolver = request->resolver.Get(isolate);
+  if (request->results.empty()) {
+    resolver->Reject(context, v8::Exception::Error(String::NewFromUtf8(isolate,
+        "dbusBenchmark: no results (no session bus, or another run in progress)").ToLocalChecked())).FromJust();
+  } else {
+    Local<Array> result = Array::New(isolate, request->results.size());
+    for (std::size_t i = 0; i < request->results.size(); i++) {
+      const busBenchmarkResult& r = request->results[i];
+      Local<Object> run = Object::New(isolate);
+      run->Set(context, String::NewFromUtf8(isolate, "mode").ToLocalChecked(), String::NewFromUtf8(isolate, r.mode.toUtf8().constData()).ToLocalChecked()).FromJust();
+      static const char* names[] = {"rate", "messages", "failed", "meanUs", "stdUs", "maxUs", "processCpu", "daemonCpu"};
+      const double values[] = {(double)r.rate, (double)r.messages, (double)r.failed, r.meanUs, r.stdUs, r.maxUs, r.processCpu, r.daemonCpu};
+      for (std::size_t k = 0; k < sizeof(values)/sizeof(values[0]); k++)
+        run->Set(context, String::NewFromUtf8(isolate, names[k]).ToLocalChecked(), Number::New(isolate, values[k])).FromJust();
+      result->Set(context, i, run).FromJust();
+    }
+    resolver->Resolve(context, result).FromJust();
+  }
+  uv_close(reinterpret_cast<uv_handle_t*>(async), [](uv_handle_t* handle) {
+    delete static_cast<dbusBenchmarkRequest*>(handle->data);
+  });
+}
+
+// dbusBenchmarkWrap([rates], [seconds]): promise of the signal delivery by dbus-daemon and peer to
+// peer. Runs on a thread of its own (about 2*(seconds + 1) s per rate). Sender and receiver are
+// in this process: the latencies are a lower bound (p2pbus.h)
+void usbdevWrap::dbusBenchmark(const FunctionCallbackInfo<v8::Value>& args){
+  Isolate* isolate = args.GetIsolate();
+  Local<Context> context = isolate->GetCurrentContext();
+
+  usbdevWrap* obj = ObjectWrap::Unwrap<usbdevWrap>(args.Holder());
+  if (!obj->VS)
+    return;                 // Before MainWrap()
+  dbusBenchmarkRequest* request = new dbusBenchmarkRequest();
+  request->rates = {30, 120, 520};
+  if (args[0]->IsArray()) {
+    Local<Array> list = args[0].As<Array>();
+    request->rates.clear();
+    for (uint32_t i = 0; i < list->Length(); i++)
+      request->rates.push_back(list->Get(context, i).ToLocalChecked()->Uint32Value(context).FromMaybe(0));
+  }
+  request->seconds = args[1]->IsUndefined() ? 2 : args[1]->Uint32Value(context).FromMaybe(2);
+  request->isolate = isolate;
+  request->context.Reset(isolate, context);
+  Local<Promise::Resolver> resolver = Promise::Resolver::New(context).ToLocalChecked();
+  request->resolver.Reset(isolate, resolver);
+  request->async.data = request;
+  uv_async_init(node::GetCurrentEventLoop(isolate), &request->async, dbusBenchmarkDone);
+
+  Videostreaming* VS = obj->VS;
+  std::thread([VS, request]() {
+    request->results = VS->dbusBenchmark(request->rates, request->seconds);
+    uv_async_send(&request->async);
+  }).detach();
+  args.GetReturnValue().Set(resolver->GetPromise());
+}
@@ -31,6 +31,14 @@ class usbdevWrap : public node::ObjectWrap {
   static void openDevice(const v8::FunctionCallbackInfo<v8::Value>& args);
 
   static void serviceSlot(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void processBatch(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void resumeProcessing(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void cancelProcessing(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void processingJobs(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void startLatency(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void gazeSamples(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void pluginStatistics(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void dbusBenchmark(const v8::FunctionCallbackInfo<v8::Value>& args);
 
   static void mainWrap(const v8::FunctionCallbackInfo<v8::Value>& args);
 
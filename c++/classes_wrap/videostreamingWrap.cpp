@@ -1,5 +1,6 @@
 #include "videostreamingWrap.h"
 
+using v8::Array;
 using v8::Context;
 using v8::Function;
 using v8::FunctionCallbackInfo;
@@ -0,0 +1,22 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdio>
+
+/* Checks of the standalone tests (binding.gyp "*_test" targets, npm test).
+ * A failed check is printed and counted; main() returns checkFailures().*/
+static int g_checkFailures = 0;
+
+#define CHECK(cond) do{ \
+        if(!(cond)){ \
+            std::printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            g_checkFailures++; \
+        } \
+    }while(0)
+
+inline int checkFailures(const char* test){
+    std::printf("%s: %s\n", test, g_checkFailures == 0 ? "OK" : "FAILED");
+    return g_checkFailures == 0 ? 0 : 1;
+}
+
+#endif // CHECK_H
@@ -0,0 +1,108 @@
+#include <unistd.h>
+
+#include "eyeregion.h"
+#include "check.h"
+
+/* Capturer side (eyeStreamWriter, run by bgVideoCapturer outside this tree) against the region
+ * feedback and the merged reader of the full rate consumers.
+ * Frame k has the pixel (x + y + k) & 255, so every merged frame can be checked: inside the
+ * eye region it is frame k, outside it the last whole frame.*/
+#define TEST_SLOTS      8
+#define TEST_WIDTH      640
+#define TEST_HEIGHT     480
+#define TEST_FPS        500
+#define TEST_FRAMES     100
+
+static bool holds(const cv::Mat& frame, const cv::Rect& roi, int k){
+    for(int y=roi.y;y<roi.y + roi.height;y++){
+        const uchar* row = frame.ptr(y);
+        for(int x=roi.x;x<roi.x + roi.width;x++)
+            if(row[x] != (uchar)(x + y + k))
+                return false;
+    }
+    return true;
+}
+
+class session{
+public:
+    session() : m_k(0), m_eye(0), m_t0(frameRingClock()){
+        m_frame.create(TEST_HEIGHT, TEST_WIDTH, CV_8UC1);
+    }
+    //Captures one frame and reads what the consumer gets
+    void capture(eyeStreamWriter& capturer, eyeStreamReader& reader, const cv::Rect& pupil){
+        for(int y=0;y<m_frame.rows;y++){
+            uchar* row = m_frame.ptr(y);
+            for(int x=0;x<m_frame.cols;x++)
+                row[x] = (uchar)(x + y + m_k);
+        }
+        capturer.publish(m_frame, m_t0 + m_k*(1000000/TEST_FPS));
+        cv::Mat merged;
+        frameInfo info;
+        bool eye;
+        CHECK(reader.next(merged, info, eye));
+        CHECK(info.timestamp == m_t0 + m_k*(1000000/TEST_FPS));
+        CHECK(merged.cols == TEST_WIDTH && merged.rows == TEST_HEIGHT);
+        CHECK(holds(merged, eye ? pupil : cv::Rect(0, 0, TEST_WIDTH, TEST_HEIGHT), m_k));
+        CHECK(!reader.next(merged, info, eye));
+        if(eye)
+            m_eye++;
+        m_k++;
+    }
+    int eyeFrames() const {return m_eye;}
+private:
+    cv::Mat m_frame;
+    int m_k;
+    int m_eye;
+    int64_t m_t0;
+};
+
+int main(){
+    eyeStreamWriter capturer;
+    CHECK(capturer.create(TEST_SLOTS, TEST_WIDTH, TEST_HEIGHT, 1, TEST_FPS));
+    eyeStreamReader reader;
+    CHECK(reader.open());
+    session frames;
+    const cv::Rect pupil(300, 200, 60, 50);
+
+    //No region: every frame whole
+    for(int k=0;k<10;k++)
+        frames.capture(capturer, reader, pupil);
+    eyeStreamStats stats = capturer.stats();
+    CHECK(stats.fullFrames == 10 && stats.eyeFrames == 0 && frames.eyeFrames() == 0);
+
+    //Tracker region: the eye plane at full rate, the whole frame at EYE_CONTEXT_FPS. The
+    //capturer looks for the region segment at most every EYE_REGION_TIMEOUT_US
+    eyeRegionWriter tracker;
+    CHECK(tracker.publishEyeRegion(pupil, TEST_WIDTH, TEST_HEIGHT, 10));
+    usleep(EYE_REGION_TIMEOUT_US + 10000);
+    CHECK(tracker.publishEyeRegion(pupil, TEST_WIDTH, TEST_HEIGHT, 10));
+    const eyeStreamStats before = capturer.stats();
+    CHECK(reader.open());           //The consumer finds the eye ring
+    for(int k=0;k<TEST_FRAMES;k++)
+        frames.capture(capturer, reader, pupil);
+    stats = capturer.stats();
+    const uint64_t eyeFrames = stats.eyeFrames - before.eyeFrames;
+    const uint64_t fullFrames = stats.fullFrames - before.fullFrames;
+    const uint64_t bytes = stats.bytes - before.bytes;
+    CHECK(eyeFrames == TEST_FRAMES);
+    CHECK(fullFrames + 1 >= TEST_FRAMES*EYE_CONTEXT_FPS/TEST_FPS && fullFrames <= TEST_FRAMES*EYE_CONTEXT_FPS/TEST_FPS + 1);
+    CHECK(bytes < (uint64_t)TEST_FRAMES*TEST_WIDTH*TEST_HEIGHT/4);
+    //Every frame reached the consumer: whole ones and eye planes pasted on them
+    CHECK(frames.eyeFrames() == TEST_FRAMES - (int)fullFrames);
+    CHECK(reader.dropped() == 0);
+    std::printf("%d frames at %d fps with a %dx%d region: %lu eye, %lu whole, %.1f MB instead of %.1f MB\n",
+                TEST_FRAMES, TEST_FPS, pupil.width, pupil.height, (unsigned long)eyeFrames, (unsigned long)fullFrames,
+                bytes/1e6, (double)TEST_FRAMES*TEST_WIDTH*TEST_HEIGHT/1e6);
+
+    //Lost: whole frames again
+    tracker.clear();
+    const int eye = frames.eyeFrames();
+    for(int k=0;k<10;k++)
+        frames.capture(capturer, reader, pupil);
+    CHECK(frames.eyeFrames() == eye);
+
+    reader.close();
+    capturer.destroy();
+    boost::interprocess::shared_memory_object::remove(EYE_REGION_NAME);
+    return checkFailures("eyeregion_test");
+}
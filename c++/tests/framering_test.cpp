@@ -0,0 +1,187 @@
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "framering.h"
+#include "check.h"
+
+/* frameRingWriter -> frameRingReader in one process: the capturer that writes the ring in
+ * production (bgVideoCapturer) is built outside this tree.
+ * Frames are filled with their id, so a torn copy or view shows as mixed bytes.*/
+#define TEST_RING       "oscann_test_ring"
+#define TEST_STREAM     "test_camera"
+#define TEST_SLOTS      4
+#define TEST_WIDTH      64
+#define TEST_HEIGHT     48
+#define TEST_FRAMES     100000
+
+static std::vector<uchar> g_pixels(TEST_WIDTH*TEST_HEIGHT);
+
+static uint64_t publish(frameRingWriter& writer, uint64_t id){
+    std::fill(g_pixels.begin(), g_pixels.end(), (uchar)id);
+    return writer.publish(g_pixels.data(), TEST_WIDTH, TEST_HEIGHT, TEST_WIDTH, FRAME_GRAY8, frameRingClock());
+}
+static bool uniform(const uchar* pixels, std::size_t bytes, uchar value){
+    for(std::size_t i=0;i<bytes;i++)
+        if(pixels[i] != value)
+            return false;
+    return true;
+}
+
+static void testRegistry(){
+    frameRingWriter writer;
+    CHECK(writer.create(TEST_RING, TEST_SLOTS, TEST_WIDTH, TEST_HEIGHT, 1, TEST_STREAM));
+    streamDescriptor desc;
+    CHECK(shmRegistry::instance().find(TEST_STREAM, desc));
+    CHECK(desc.kind == SHM_FRAME_RING && std::string(desc.segment) == TEST_RING && desc.slots == TEST_SLOTS);
+    const uint64_t generation = desc.generation;
+    writer.destroy();
+    CHECK(!shmRegistry::instance().find(TEST_STREAM, desc));
+    CHECK(writer.create(TEST_RING, TEST_SLOTS, TEST_WIDTH, TEST_HEIGHT, 1, TEST_STREAM));
+    CHECK(shmRegistry::instance().find(TEST_STREAM, desc) && desc.generation != generation);
+}
+
+static void testSequence(){
+    frameRingWriter writer;
+    CHECK(writer.create(TEST_RING, TEST_SLOTS, TEST_WIDTH, TEST_HEIGHT, 1, NULL));
+    frameRingReader reader;
+    CHECK(reader.open(TEST_RING));
+    cv::Mat frame;
+    frameInfo info;
+    CHECK(!reader.latest(frame, info));
+    //Too big for a slot
+    std::vector<uchar> big((TEST_WIDTH + 1)*TEST_HEIGHT);
+    CHECK(writer.publish(big.data(), TEST_WIDTH + 1, TEST_HEIGHT, TEST_WIDTH + 1, FRAME_GRAY8, frameRingClock()) == 0);
+
+    //A new reader starts at the newest frame, then follows every id
+    CHECK(publish(writer, 1) == 1);
+    CHECK(reader.next(frame, info) && info.frameId == 1 && uniform(frame.data, frame.total(), 1));
+    CHECK(publish(writer, 2) == 2 && publish(writer, 3) == 3);
+    CHECK(reader.next(frame, info) && info.frameId == 2 && uniform(frame.data, frame.total(), 2));
+    CHECK(reader.latest(frame, info) && info.frameId == 3);
+    CHECK(!reader.next(frame, info));
+    CHECK(reader.dropped() == 0);
+    //Lapped: the frames overwritten before being read are counted
+    for(uint64_t id=4;id<=3 + 2*TEST_SLOTS;id++)
+        publish(writer, id);
+    CHECK(reader.next(frame, info) && info.frameId == 4 + TEST_SLOTS);
+    CHECK(reader.dropped() == TEST_SLOTS);
+    CHECK(info.width == TEST_WIDTH && info.height == TEST_HEIGHT && info.format == FRAME_GRAY8);
+}
+
+static void testViews(){
+    frameRingWriter writer;
+    CHECK(writer.create(TEST_RING, TEST_SLOTS, TEST_WIDTH, TEST_HEIGHT, 1, NULL));
+    frameRingReader reader;
+    CHECK(reader.open(TEST_RING));
+    publish(writer, 1);
+    frameView view;
+    CHECK(reader.viewLatest(view) && view.info.frameId == 1 && view.bytes == TEST_WIDTH*TEST_HEIGHT);
+    CHECK(view.pixels == reader.slotPixels(view.slot));
+    CHECK(reader.isValid(view) && uniform(view.pixels, view.bytes, 1));
+    //The writer laps the ring: the slot of the view is reused
+    for(uint64_t id=2;id<=1 + TEST_SLOTS;id++)
+        publish(writer, id);
+    CHECK(!reader.isValid(view));
+
+    //Concurrent writer: every view still valid after use holds one whole frame
+    std::atomic<bool> done(false);
+    uint64_t valid = 0, torn = 0;
+    std::thread consumer([&](){
+        frameView v;
+        while(!done){
+            if(!reader.viewLatest(v))
+                continue;
+            const bool whole = uniform(v.pixels, v.bytes, (uchar)v.info.frameId);
+            if(!reader.isValid(v))
+                continue;
+            valid++;
+            if(!whole)
+                torn++;
+        }
+    });
+    for(uint64_t id=2 + TEST_SLOTS;id<=TEST_FRAMES;id++){
+        publish(writer, id);
+        if(id % 4 == 0)
+            usleep(1);
+    }
+    done = true;
+    consumer.join();
+    CHECK(valid > 0);
+    CHECK(torn == 0);
+    std::printf("views: %lu valid, %lu torn\n", (unsigned long)valid, (unsigned long)torn);
+}
+
+static void testCopyOnWrite(){
+    frameRingWriter writer;
+    CHECK(writer.create(TEST_RING, TEST_SLOTS, TEST_WIDTH, TEST_HEIGHT, 1, NULL));
+    publish(writer, 1);
+    frameRingReader js, other;
+    CHECK(js.open(TEST_RING, true) && other.open(TEST_RING));
+    const uint32_t slot = 1 % TEST_SLOTS;
+    const_cast<uchar*>(js.slotPixels(slot))[0] = 77;
+    CHECK(other.slotPixels(slot)[0] == 1);
+    cv::Mat frame;
+    frameInfo info;
+    CHECK(other.latest(frame, info) && uniform(frame.data, frame.total(), 1));
+}
+
+static void testWake(){
+    frameRingWriter writer;
+    CHECK(writer.create(TEST_RING, TEST_SLOTS, TEST_WIDTH, TEST_HEIGHT, 1, NULL));
+    frameRingReader reader;
+    CHECK(reader.open(TEST_RING));
+    //Timeout without frames
+    int64_t t0 = frameRingClock();
+    CHECK(!reader.wait(reader.head(), 50));
+    CHECK(frameRingClock() - t0 >= 40000);
+    //Woken by the publish, well before the timeout
+    std::thread producer([&](){
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        publish(writer, 1);
+    });
+    t0 = frameRingClock();
+    CHECK(reader.wait(reader.head(), 2000));
+    CHECK(frameRingClock() - t0 < 1000000);
+    CHECK(reader.head() == 1 && reader.publishedAt() > 0);
+    producer.join();
+
+    //eventfd of the notifier: every frame counted once
+    frameRingNotifier notifier;
+    CHECK(notifier.start(TEST_RING));
+    const uint64_t frames = 500;
+    std::thread burst([&](){
+        for(uint64_t id=2;id<=frames + 1;id++){
+            publish(writer, id);
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    });
+    pollfd fd;
+    fd.fd = notifier.fd();
+    fd.events = POLLIN;
+    uint64_t total = 0;
+    while(total < frames && poll(&fd, 1, 1000) > 0)
+        total += notifier.acknowledge();
+    burst.join();
+    CHECK(total == frames);
+    frameNotifyStats stats = notifier.stats();
+    CHECK(stats.frames == frames && stats.notifications + stats.coalesced == frames);
+    std::printf("notifier: %lu wake-ups, latency mean %.1f max %.1f us\n", (unsigned long)stats.notifications, stats.meanUs, stats.maxUs);
+    notifier.stop();
+}
+
+int main(){
+    testRegistry();
+    testSequence();
+    testViews();
+    testCopyOnWrite();
+    testWake();
+    frameRingWriter cleanup;
+    cleanup.create(TEST_RING, TEST_SLOTS, TEST_WIDTH, TEST_HEIGHT, 1, NULL);
+    cleanup.destroy();
+    return checkFailures("framering_test");
+}
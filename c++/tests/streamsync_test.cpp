@@ -0,0 +1,106 @@
+#include <cmath>
+#include <random>
+
+#include "streamsync.h"
+#include "check.h"
+
+/* Simulated producers for streamAligner: synthetic capture times with a known offset, drift,
+ * jitter and lost frames, so the pairs, the clock estimate and the spread can be checked.
+ * Stream 0 (reference) runs at 250 fps, stream 1 at 500 fps: frame m of the reference and frame
+ * 2m of stream 1 are the same instant.*/
+#define REF_PERIOD_US       4000.0
+#define FAST_PERIOD_US      2000.0
+#define OFFSET_US           700.0       //Stream 1 clock behind the reference
+#define DRIFT_PPM           80.0
+#define JITTER_US           50.0
+#define TOLERANCE_US        1000
+#define SECONDS             20
+
+struct result{
+    uint64_t tuples = 0;
+    uint64_t wrong = 0;                 //Paired with another instant
+    uint64_t partial = 0;
+    int64_t maxSpread = 0;
+    double meanSpread = 0;
+};
+
+//lossEvery: every lossEvery-th frame of stream 1 is lost (0: none)
+static result simulate(int lossEvery, syncStats& stats, clockModel& clock){
+    streamAligner aligner(2, TOLERANCE_US, 0);
+    aligner.setMaxLatency(5*REF_PERIOD_US);
+    aligner.setAllowPartial(true);
+    result r;
+    aligner.setCallback([&](const syncTuple& t){
+        r.tuples++;
+        if(!t.complete){
+            r.partial++;
+            return;
+        }
+        if(t.samples[1].frameId != 2*t.samples[0].frameId)
+            r.wrong++;
+        r.maxSpread = std::max(r.maxSpread, t.spread);
+        r.meanSpread += t.spread;
+    });
+    std::mt19937 rng(1);
+    std::normal_distribution<double> jitter(0, JITTER_US);
+    uint64_t ref = 0, fast = 0;
+    //Both producers in time order, as the capture threads would push
+    for(double now=0;now<SECONDS*1e6;now+=100){
+        while(ref*REF_PERIOD_US <= now){
+            aligner.push(0, ref, (int64_t)(ref*REF_PERIOD_US + jitter(rng)));
+            ref++;
+        }
+        while(fast*FAST_PERIOD_US <= now){
+            const double truth = fast*FAST_PERIOD_US;
+            if(lossEvery == 0 || fast % lossEvery != 0)
+                aligner.push(1, fast, (int64_t)(truth - OFFSET_US + truth*DRIFT_PPM*1e-6 + jitter(rng)));
+            fast++;
+        }
+    }
+    aligner.flush();
+    stats = aligner.stats();
+    clock = aligner.clock(1);
+    const uint64_t complete = r.tuples - r.partial;
+    r.meanSpread = complete ? r.meanSpread/complete : 0;
+    return r;
+}
+
+static void testAlignment(){
+    syncStats stats;
+    clockModel clock;
+    result r = simulate(0, stats, clock);
+    const uint64_t refFrames = (uint64_t)(SECONDS*1e6/REF_PERIOD_US);
+    CHECK(r.tuples + 1 >= refFrames);
+    CHECK(r.wrong == 0);
+    CHECK(r.partial == 0);
+    //Correction of stream 1 recovered from the pairs: adds the offset back, removes the drift
+    CHECK(std::fabs(clock.offsetUs - OFFSET_US) < 3*JITTER_US);
+    CHECK(std::fabs(clock.drift + DRIFT_PPM) < 10);
+    //Odd frames of stream 1 have no reference frame
+    CHECK(stats.unmatched[1] + 2 >= refFrames && stats.unmatched[1] <= refFrames + 2);
+    //Corrected timestamps: only the jitter of both streams is left
+    CHECK(r.maxSpread < TOLERANCE_US);
+    CHECK(r.meanSpread < 2*JITTER_US);
+    std::printf("aligned: %lu tuples, spread mean %.1f max %ld us, offset %.1f us, drift %.1f ppm\n",
+                (unsigned long)r.tuples, r.meanSpread, (long)r.maxSpread, clock.offsetUs, clock.drift);
+}
+
+static void testLoss(){
+    //Stream 1 loses every 10th frame: the reference frames that needed them are partial
+    syncStats stats;
+    clockModel clock;
+    result r = simulate(10, stats, clock);
+    CHECK(r.wrong == 0);
+    const uint64_t refFrames = (uint64_t)(SECONDS*1e6/REF_PERIOD_US);
+    //Frames 2m lost: m multiple of 5
+    CHECK(r.partial + 2 >= refFrames/5 && r.partial <= refFrames/5 + 2);
+    CHECK(r.maxSpread < TOLERANCE_US);
+    std::printf("10%% loss: %lu partial of %lu tuples, %lu frames of stream 1 unpaired\n",
+                (unsigned long)r.partial, (unsigned long)r.tuples, (unsigned long)stats.unmatched[1]);
+}
+
+int main(){
+    testAlignment();
+    testLoss();
+    return checkFailures("streamsync_test");
+}